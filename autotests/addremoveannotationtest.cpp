@@ -26,6 +26,7 @@ private slots:
     void testAddAnnotations();
     void testAddAnnotationUndoWithRotate_Bug318091();
     void testRemoveAnnotations();
+    void testUndoHistoryMemoryBudget();
 
 private:
     Okular::Document *m_document;
@@ -187,5 +188,50 @@ void AddRemoveAnnotationTest::testRemoveAnnotations()
     QVERIFY( TestingUtils::AnnotationDisposeWatcher::disposedAnnotationName() == annot1Name );
 }
 
+void AddRemoveAnnotationTest::testUndoHistoryMemoryBudget()
+{
+    // The low memory profile keeps a few MB of undo history
+    Okular::SettingsCore::setMemoryLevel( Okular::SettingsCore::EnumMemoryLevel::Low );
+    Okular::SettingsCore::self()->save();
+
+    // Removed annotations belong to the undo history, so add and remove
+    // big ones until they take more than the budget
+    const int annotCount = 8;
+    QList< Okular::Annotation * > annots;
+    for ( int i = 0; i < annotCount; ++i )
+    {
+        QLinkedList< Okular::NormalizedPoint > path;
+        for ( int j = 0; j < 20000; ++j )
+            path << Okular::NormalizedPoint( 0.1 + ( j % 100 ) / 500.0, 0.1 + ( j / 100 ) / 500.0 );
+        Okular::InkAnnotation *ink = new Okular::InkAnnotation();
+        ink->setInkPaths( QList< QLinkedList< Okular::NormalizedPoint > >() << path );
+        ink->setBoundingRectangle( Okular::NormalizedRect( 0.1, 0.1, 0.3, 0.5 ) );
+        m_document->addPageAnnotation( 0, ink );
+        annots << ink;
+    }
+    foreach ( Okular::Annotation *annot, annots )
+        m_document->removePageAnnotation( 0, annot );
+    QVERIFY( m_document->page( 0 )->annotations().isEmpty() );
+
+    // Only the latest removals can be undone
+    int undone = 0;
+    while ( m_document->canUndo() )
+    {
+        m_document->undo();
+        ++undone;
+    }
+    QVERIFY( undone > 0 );
+    QVERIFY( undone < annotCount );
+    QCOMPARE( m_document->page( 0 )->annotations().size(), undone );
+
+    // and they can all be redone
+    while ( m_document->canRedo() )
+        m_document->redo();
+    QVERIFY( m_document->page( 0 )->annotations().isEmpty() );
+
+    Okular::SettingsCore::setMemoryLevel( Okular::SettingsCore::EnumMemoryLevel::Normal );
+    Okular::SettingsCore::self()->save();
+}
+
 QTEST_MAIN( AddRemoveAnnotationTest )
 #include "addremoveannotationtest.moc"
@@ -0,0 +1,335 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <QtTest>
+
+#include <QPainter>
+#include <QPdfWriter>
+
+#include "../core/area.h"
+#include "../core/document.h"
+#include "../core/generator.h"
+#include "../core/observer.h"
+#include "../core/page.h"
+#include "../core/textpage.h"
+#include "../settings_core.h"
+
+Q_DECLARE_METATYPE(Okular::Document::SearchStatus)
+
+// Counts the pixmaps the document gives to it
+class RenderObserver : public Okular::DocumentObserver
+{
+    public:
+        RenderObserver()
+            : m_renderedPixmaps( 0 )
+        {
+        }
+
+        void notifyPageChanged( int page, int flags ) override
+        {
+            Q_UNUSED( page );
+            if ( flags & Okular::DocumentObserver::Pixmap )
+                ++m_renderedPixmaps;
+        }
+
+        int m_renderedPixmaps;
+};
+
+// Measures the hot paths of the core on the files of autotests/data and on
+// synthetic PDFs of different lengths: opening a document, rendering its
+// first page and all its pages, extracting its text, searching it and
+// laying out the text of a page.
+//
+// Run with "-o results.xml,xml" (or "-csv") to get the results in a
+// machine readable format; the "benchmarks" build target does it for all
+// the benchmarks.
+class DocumentBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void benchmarkOpen_data();
+        void benchmarkOpen();
+        void benchmarkRenderFirstPage_data();
+        void benchmarkRenderFirstPage();
+        void benchmarkRenderAllPages_data();
+        void benchmarkRenderAllPages();
+        void benchmarkTextExtraction_data();
+        void benchmarkTextExtraction();
+        void benchmarkSearchAllDocument_data();
+        void benchmarkSearchAllDocument();
+        void benchmarkTextPageLayout_data();
+        void benchmarkTextPageLayout();
+
+    private:
+        void addFiles();
+        bool openDocument( const QString &fileName );
+
+        Okular::Document *m_document;
+        RenderObserver *m_observer;
+        QTemporaryDir m_syntheticDir;
+};
+
+// width of the rendered pixmaps, their height follows the page ratio
+static const int RenderWidth = 1000;
+
+static const int SyntheticLinesPerPage = 50;
+
+static bool writeSyntheticPdf( const QString &fileName, int pages )
+{
+    QPdfWriter writer( fileName );
+    writer.setPageSize( QPageSize( QPageSize::A4 ) );
+    writer.setResolution( 72 );
+
+    QPainter painter;
+    if ( !painter.begin( &writer ) )
+        return false;
+
+    QFont font = painter.font();
+    font.setPointSize( 10 );
+    painter.setFont( font );
+    for ( int page = 0; page < pages; ++page )
+    {
+        if ( page > 0 )
+            writer.newPage();
+        for ( int line = 0; line < SyntheticLinesPerPage; ++line )
+        {
+            painter.drawText( 50, 60 + line * 14,
+                              QStringLiteral( "Line %1 of page %2: the quick brown fox jumps over the lazy dog." ).arg( line + 1 ).arg( page + 1 ) );
+        }
+        painter.drawRect( 40, 40, 500, SyntheticLinesPerPage * 14 + 20 );
+    }
+    return painter.end();
+}
+
+void DocumentBenchmark::initTestCase()
+{
+    qRegisterMetaType<Okular::Document::SearchStatus>();
+    Okular::SettingsCore::instance( QStringLiteral("documentbenchmark") );
+    m_document = new Okular::Document( 0 );
+    m_observer = new RenderObserver;
+    m_document->addObserver( m_observer );
+
+    QVERIFY( m_syntheticDir.isValid() );
+    QVERIFY( writeSyntheticPdf( m_syntheticDir.path() + QStringLiteral("/synthetic-10.pdf"), 10 ) );
+    QVERIFY( writeSyntheticPdf( m_syntheticDir.path() + QStringLiteral("/synthetic-200.pdf"), 200 ) );
+}
+
+void DocumentBenchmark::cleanupTestCase()
+{
+    m_document->closeDocument();
+    m_document->removeObserver( m_observer );
+    delete m_observer;
+    delete m_document;
+}
+
+void DocumentBenchmark::addFiles()
+{
+    QTest::addColumn<QString>("fileName");
+
+    QTest::newRow("file1.pdf") << QStringLiteral(KDESRCDIR "data/file1.pdf");
+    QTest::newRow("file2.pdf") << QStringLiteral(KDESRCDIR "data/file2.pdf");
+    QTest::newRow("tocreload.pdf") << QStringLiteral(KDESRCDIR "data/tocreload.pdf");
+    QTest::newRow("contents.epub") << QStringLiteral(KDESRCDIR "data/contents.epub");
+    QTest::newRow("synthetic-10.pdf") << m_syntheticDir.path() + QStringLiteral("/synthetic-10.pdf");
+    QTest::newRow("synthetic-200.pdf") << m_syntheticDir.path() + QStringLiteral("/synthetic-200.pdf");
+}
+
+bool DocumentBenchmark::openDocument( const QString &fileName )
+{
+    m_document->closeDocument();
+    QMimeDatabase db;
+    const QMimeType mime = db.mimeTypeForFile( fileName );
+    return m_document->openDocument( fileName, QUrl(), mime ) == Okular::Document::OpenSuccess;
+}
+
+void DocumentBenchmark::benchmarkOpen_data()
+{
+    addFiles();
+}
+
+void DocumentBenchmark::benchmarkOpen()
+{
+    QFETCH( QString, fileName );
+
+    if ( !openDocument( fileName ) )
+        QSKIP( "No generator could open the file" );
+    m_document->closeDocument();
+
+    QMimeDatabase db;
+    const QMimeType mime = db.mimeTypeForFile( fileName );
+    QBENCHMARK
+    {
+        QCOMPARE( m_document->openDocument( fileName, QUrl(), mime ), Okular::Document::OpenSuccess );
+        m_document->closeDocument();
+    }
+}
+
+void DocumentBenchmark::benchmarkRenderFirstPage_data()
+{
+    addFiles();
+}
+
+void DocumentBenchmark::benchmarkRenderFirstPage()
+{
+    QFETCH( QString, fileName );
+
+    if ( !openDocument( fileName ) )
+        QSKIP( "No generator could open the file" );
+
+    Okular::Page *page = const_cast<Okular::Page *>( m_document->page( 0 ) );
+    const int height = qRound( RenderWidth * page->ratio() );
+    QBENCHMARK
+    {
+        page->deletePixmap( m_observer );
+        m_observer->m_renderedPixmaps = 0;
+        Okular::PixmapRequest *request = new Okular::PixmapRequest( m_observer, 0, RenderWidth, height, 1, Okular::PixmapRequest::NoFeature );
+        m_document->requestPixmaps( QLinkedList<Okular::PixmapRequest*>() << request );
+        QTRY_COMPARE( m_observer->m_renderedPixmaps, 1 );
+    }
+    QVERIFY( page->hasPixmap( m_observer, RenderWidth, height ) );
+}
+
+void DocumentBenchmark::benchmarkRenderAllPages_data()
+{
+    addFiles();
+}
+
+void DocumentBenchmark::benchmarkRenderAllPages()
+{
+    QFETCH( QString, fileName );
+
+    if ( !openDocument( fileName ) )
+        QSKIP( "No generator could open the file" );
+
+    const int pages = m_document->pages();
+    QBENCHMARK
+    {
+        QLinkedList<Okular::PixmapRequest*> requests;
+        for ( int i = 0; i < pages; ++i )
+        {
+            Okular::Page *page = const_cast<Okular::Page *>( m_document->page( i ) );
+            page->deletePixmap( m_observer );
+            requests << new Okular::PixmapRequest( m_observer, i, RenderWidth, qRound( RenderWidth * page->ratio() ), 1, Okular::PixmapRequest::Asynchronous );
+        }
+        m_observer->m_renderedPixmaps = 0;
+        m_document->requestPixmaps( requests );
+        QTRY_COMPARE_WITH_TIMEOUT( m_observer->m_renderedPixmaps, pages, 60000 );
+    }
+}
+
+void DocumentBenchmark::benchmarkTextExtraction_data()
+{
+    addFiles();
+}
+
+void DocumentBenchmark::benchmarkTextExtraction()
+{
+    QFETCH( QString, fileName );
+
+    if ( !openDocument( fileName ) )
+        QSKIP( "No generator could open the file" );
+    if ( !m_document->supportsSearching() )
+        QSKIP( "The generator does not provide text" );
+
+    QBENCHMARK
+    {
+        for ( uint i = 0; i < m_document->pages(); ++i )
+        {
+            Okular::Page *page = const_cast<Okular::Page *>( m_document->page( i ) );
+            page->setTextPage( 0 );
+            m_document->requestTextPage( i );
+            QVERIFY( page->hasTextPage() );
+        }
+    }
+}
+
+void DocumentBenchmark::benchmarkSearchAllDocument_data()
+{
+    addFiles();
+}
+
+void DocumentBenchmark::benchmarkSearchAllDocument()
+{
+    QFETCH( QString, fileName );
+
+    if ( !openDocument( fileName ) )
+        QSKIP( "No generator could open the file" );
+    if ( !m_document->supportsSearching() )
+        QSKIP( "The generator does not provide text" );
+
+    // the text extraction has its own benchmark, so only the matching is
+    // measured here (as long as the text pages are kept in memory)
+    for ( uint i = 0; i < m_document->pages(); ++i )
+        m_document->requestTextPage( i );
+
+    QSignalSpy spy( m_document, SIGNAL(searchFinished(int,Okular::Document::SearchStatus)) );
+    const int searchId = 0;
+    QBENCHMARK
+    {
+        spy.clear();
+        m_document->searchText( searchId, QStringLiteral("the"), true, Qt::CaseInsensitive, Okular::Document::AllDocument, false, QColor( Qt::yellow ) );
+        QTRY_COMPARE_WITH_TIMEOUT( spy.count(), 1, 60000 );
+        m_document->resetSearch( searchId );
+    }
+}
+
+void DocumentBenchmark::benchmarkTextPageLayout_data()
+{
+    QTest::addColumn<int>("columns");
+    QTest::addColumn<int>("lines");
+
+    QTest::newRow("1 column, 50 lines") << 1 << 50;
+    QTest::newRow("2 columns, 50 lines") << 2 << 50;
+    QTest::newRow("3 columns, 100 lines") << 3 << 100;
+}
+
+void DocumentBenchmark::benchmarkTextPageLayout()
+{
+    QFETCH( int, columns );
+    QFETCH( int, lines );
+
+    // words of a page of text in columns, as a generator would give them
+    static const int WordsPerLine = 8;
+    QVector<QString> words;
+    QVector<Okular::NormalizedRect> rects;
+    const double columnWidth = 0.9 / columns;
+    const double wordWidth = columnWidth * 0.9 / WordsPerLine;
+    const double lineHeight = 0.9 / lines;
+    for ( int column = 0; column < columns; ++column )
+    {
+        for ( int line = 0; line < lines; ++line )
+        {
+            for ( int word = 0; word < WordsPerLine; ++word )
+            {
+                const double left = 0.05 + column * columnWidth + word * wordWidth;
+                const double top = 0.05 + line * lineHeight;
+                words << ( word == WordsPerLine - 1 ? QStringLiteral("word\n") : QStringLiteral("word ") );
+                rects << Okular::NormalizedRect( left, top, left + wordWidth * 0.8, top + lineHeight * 0.8 );
+            }
+        }
+    }
+
+    QBENCHMARK
+    {
+        Okular::TextPage *tp = new Okular::TextPage;
+        tp->reserve( words.count() );
+        for ( int i = 0; i < words.count(); ++i )
+            tp->append( words.at( i ), rects.at( i ) );
+
+        // setTextPage() runs the layout analysis of the text
+        Okular::Page page( 0, 600, 800, Okular::Rotation0 );
+        page.setTextPage( tp );
+    }
+}
+
+QTEST_MAIN( DocumentBenchmark )
+#include "documentbenchmark.moc"
@@ -11,9 +11,12 @@
 
 #include <threadweaver/queue.h>
 
+#include "../core/annotations.h"
 #include "../core/document.h"
+#include "../core/document_p.h"
 #include "../core/generator.h"
 #include "../core/observer.h"
+#include "../core/page.h"
 #include "../core/rotationjob_p.h"
 #include "../settings_core.h"
 
@@ -24,6 +27,7 @@ class DocumentTest
 
     private slots:
         void testCloseDuringRotationJob();
+        void testDocDataStore();
 };
 
 // Test that we don't crash if the document is closed while a RotationJob
@@ -59,5 +63,47 @@ void DocumentTest::testCloseDuringRotationJob()
     qApp->processEvents();
 }
 
+// Test that the annotations are saved in the binary docdata store, and
+// restored from it when the document is opened again
+void DocumentTest::testDocDataStore()
+{
+    QStandardPaths::setTestModeEnabled( true );
+    Okular::SettingsCore::instance( QStringLiteral("documenttest") );
+    const QString testFile = QStringLiteral(KDESRCDIR "data/file1.pdf");
+    const QUrl testUrl = QUrl::fromLocalFile( testFile );
+    QMimeDatabase db;
+    const QMimeType mime = db.mimeTypeForFile( testFile );
+
+    const QString xmlFileName = Okular::DocumentPrivate::docDataFileName( testUrl, QFileInfo( testFile ).size() );
+    const QString storeFileName = Okular::DocumentPrivate::docDataStoreFileName( xmlFileName );
+    QFile::remove( xmlFileName );
+    QFile::remove( storeFileName );
+
+    Okular::Document *m_document = new Okular::Document( 0 );
+    QCOMPARE( m_document->openDocument( testFile, testUrl, mime ), Okular::Document::OpenSuccess );
+    Okular::TextAnnotation *annot = new Okular::TextAnnotation();
+    annot->setBoundingRectangle( Okular::NormalizedRect( 0.1, 0.1, 0.15, 0.15 ) );
+    annot->setContents( QStringLiteral("stored") );
+    m_document->addPageAnnotation( 0, annot );
+    m_document->closeDocument();
+
+    QVERIFY( QFile::exists( storeFileName ) );
+    QFile xmlFile( xmlFileName );
+    QVERIFY( xmlFile.open( QIODevice::ReadOnly ) );
+    QVERIFY( !xmlFile.readAll().contains( "pageList" ) );
+    xmlFile.close();
+
+    QCOMPARE( m_document->openDocument( testFile, testUrl, mime ), Okular::Document::OpenSuccess );
+    // the page data is loaded when the page is first shown
+    m_document->setViewport( Okular::DocumentViewport( 0 ) );
+    QTRY_COMPARE( m_document->page( 0 )->annotations().count(), 1 );
+    QCOMPARE( m_document->page( 0 )->annotations().first()->contents(), QStringLiteral("stored") );
+    m_document->closeDocument();
+
+    delete m_document;
+    QFile::remove( xmlFileName );
+    QFile::remove( storeFileName );
+}
+
 QTEST_MAIN( DocumentTest )
 #include "documenttest.moc"
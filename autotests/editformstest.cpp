@@ -31,6 +31,7 @@ private slots:
     void testTextLineForm();
     void testTextAreaForm();
     void testFileEditForm();
+    void testTextChangedOutsideUndoStack();
     void testComboEditForm();
     void testListSingleEdit();
     void testListMultiEdit();
@@ -235,6 +236,40 @@ void EditFormsTest::testFileEditForm()
     verifyTextForm( m_fileEditForm );
 }
 
+void EditFormsTest::testTextChangedOutsideUndoStack()
+{
+    Okular::FormFieldText *form = m_textLineForm;
+    m_document->editFormText(0, form, QStringLiteral("Hello"), 5, 0, 0);
+    m_document->editFormText(0, form, QStringLiteral("Hello!"), 6, 5, 5);
+
+    // A script changes the text, as kjs_field.cpp does
+    form->setText( QStringLiteral("Hello?") );
+
+    // The text the edits were made on is gone, so they can not be undone
+    // without corrupting the new one: each undo drops an edit instead
+    m_document->undo();
+    QCOMPARE( form->text(), QStringLiteral("Hello?") );
+    QVERIFY( m_document->canUndo() );
+    QVERIFY( !m_document->canRedo() );
+    m_document->undo();
+    QCOMPARE( form->text(), QStringLiteral("Hello?") );
+    QVERIFY( !m_document->canUndo() );
+    QVERIFY( !m_document->canRedo() );
+
+    // Typing after the change is not merged with the edit before it
+    m_document->editFormText(0, form, QStringLiteral("Hello?x"), 7, 6, 6);
+    m_document->undo();
+    QCOMPARE( form->text(), QStringLiteral("Hello?") );
+    QVERIFY( m_document->canRedo() );
+
+    // The same once the edit was undone: it can not be redone
+    form->setText( QStringLiteral("Hello!") );
+    m_document->redo();
+    QCOMPARE( form->text(), QStringLiteral("Hello!") );
+    QVERIFY( !m_document->canUndo() );
+    QVERIFY( !m_document->canRedo() );
+}
+
 void EditFormsTest::testComboEditForm()
 {
     // Editable combo with predefined choices:
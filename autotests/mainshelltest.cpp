@@ -149,6 +149,7 @@ void MainShellTest::init()
         QFileInfo fileReadTest( url.toLocalFile() );
         const QString docDataPath = Okular::DocumentPrivate::docDataFileName(url, fileReadTest.size());
         QFile::remove(docDataPath);
+        QFile::remove(Okular::DocumentPrivate::docDataStoreFileName(docDataPath));
     }
 }
 
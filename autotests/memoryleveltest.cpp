@@ -0,0 +1,261 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <QtTest>
+
+#include "../core/area.h"
+#include "../core/document.h"
+#include "../core/document_p.h"
+#include "../core/generator.h"
+#include "../core/observer.h"
+#include "../core/page.h"
+#include "../settings_core.h"
+
+// the memory of the system the document sees
+static const qulonglong TotalMemory = Q_UINT64_C(256) * 1024 * 1024;
+static const qulonglong FreeMemory = Q_UINT64_C(128) * 1024 * 1024;
+
+// the size of the pages of memorytestgenerator, at 100% zoom
+static const int PageCount = 100;
+static const int PageWidth = 1000;
+static const int PageHeight = 1300;
+
+// An observer that shows some pages, like PageView does: the pixmaps of the
+// visible pages can not be unloaded
+class ViewObserver : public Okular::DocumentObserver
+{
+    public:
+        bool canUnloadPixmap( int page ) const override
+        {
+            return !m_visiblePages.contains( page );
+        }
+
+        QSet< int > m_visiblePages;
+};
+
+// Scrolls and zooms through a document of blank pages with every memory
+// level, and checks after each step that the pixmaps (tiles included) and
+// the text pages kept by the document stay within the bounds of the level.
+class MemoryLevelTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void testScrollAndZoom_data();
+        void testScrollAndZoom();
+        void testBackwardSearch();
+
+    private:
+        // shows the pages from 'first' to 'last' at the given width, and
+        // requests their pixmaps and text pages; a null rect means the whole
+        // pages are visible
+        void showPages( int first, int last, int width, const Okular::NormalizedRect &visibleRect = Okular::NormalizedRect() );
+        void checkMemory( const char *step );
+
+        QTemporaryFile m_emptyFile;
+        Okular::Document *m_document;
+        ViewObserver *m_observer;
+
+        // the memory the pixmaps of the document can take beyond the ones
+        // of the visible pages, and the number of the largest pixmaps the
+        // document can keep beyond that
+        qulonglong m_limit;
+        int m_slackPixmaps;
+        int m_maxTextPages;
+
+        qulonglong m_visiblePixmapsMemory;
+        qulonglong m_largestPixmapMemory;
+};
+
+void MemoryLevelTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled( true );
+    Okular::SettingsCore::instance( QStringLiteral("memoryleveltest") );
+
+    // the generator of blank pages, built with the test
+    QCoreApplication::addLibraryPath( QStringLiteral(MEMORYTEST_PLUGIN_DIR) );
+    QVERIFY( m_emptyFile.open() );
+    m_emptyFile.close();
+
+    Okular::DocumentPrivate::setSystemMemoryOverride( TotalMemory, FreeMemory, 0 );
+}
+
+void MemoryLevelTest::cleanupTestCase()
+{
+    Okular::DocumentPrivate::setSystemMemoryOverride( 0, 0, 0 );
+}
+
+void MemoryLevelTest::testScrollAndZoom_data()
+{
+    QTest::addColumn<int>("memoryLevel");
+    QTest::addColumn<qulonglong>("limit");
+    QTest::addColumn<int>("slackPixmaps");
+    QTest::addColumn<int>("maxTextPages");
+
+    // Low frees everything that is not visible; Normal keeps a third of
+    // the memory; Aggressive and Greedy (as there is no swap) free half of
+    // what is over the free memory, so the cache can keep one more pixmap.
+    // The levels keep 2, 50, 250 and 1250 text pages per 512 MiB of memory,
+    // rounded, and at least once.
+    QTest::newRow("Low") << (int)Okular::SettingsCore::EnumMemoryLevel::Low << Q_UINT64_C(0) << 1 << 2;
+    QTest::newRow("Normal") << (int)Okular::SettingsCore::EnumMemoryLevel::Normal << TotalMemory / 3 << 1 << 50;
+    QTest::newRow("Aggressive") << (int)Okular::SettingsCore::EnumMemoryLevel::Aggressive << FreeMemory << 2 << 250;
+    QTest::newRow("Greedy") << (int)Okular::SettingsCore::EnumMemoryLevel::Greedy << FreeMemory << 2 << 1250;
+}
+
+void MemoryLevelTest::testScrollAndZoom()
+{
+    QFETCH( int, memoryLevel );
+    QFETCH( qulonglong, limit );
+    QFETCH( int, slackPixmaps );
+    QFETCH( int, maxTextPages );
+
+    m_limit = limit;
+    m_slackPixmaps = slackPixmaps;
+    m_maxTextPages = maxTextPages;
+    m_largestPixmapMemory = 0;
+
+    // the document reads the memory level when created
+    Okular::SettingsCore::setMemoryLevel( memoryLevel );
+    m_document = new Okular::Document( 0 );
+    m_observer = new ViewObserver;
+    m_document->addObserver( m_observer );
+
+    QMimeDatabase db;
+    const QMimeType mime = db.mimeTypeForName( QStringLiteral("application/x-zerosize") );
+    QCOMPARE( m_document->openDocument( m_emptyFile.fileName(), QUrl(), mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( (int)m_document->pages(), PageCount );
+
+    // scroll through the whole document, two pages at a time
+    for ( int page = 0; page < PageCount - 1; ++page )
+    {
+        showPages( page, page + 1, PageWidth );
+        checkMemory( "scrolling" );
+    }
+
+    // zoom in the middle of the document, up to the size that uses tiles,
+    // and out again
+    const int zoomWidths[] = { PageWidth * 3 / 2, PageWidth * 2, PageWidth * 3, PageWidth * 4, PageWidth * 2, PageWidth };
+    for ( int width : zoomWidths )
+    {
+        if ( (qint64)width * width * PageHeight / PageWidth > 8000000 )
+            showPages( 50, 50, width, Okular::NormalizedRect( 0.25, 0.25, 0.75, 0.75 ) );
+        else
+            showPages( 50, 51, width );
+        checkMemory( "zooming" );
+    }
+
+    // scroll back to the start of the document, with large pages
+    for ( int page = 50; page >= 0; page -= 5 )
+    {
+        showPages( page, page, PageWidth * 2 );
+        checkMemory( "scrolling back" );
+    }
+
+    m_document->closeDocument();
+    QCOMPARE( m_document->renderStatistics().allocatedPixmapsMemory, Q_UINT64_C(0) );
+    QCOMPARE( m_document->renderStatistics().allocatedTextPages, 0 );
+
+    m_document->removeObserver( m_observer );
+    delete m_observer;
+    delete m_document;
+}
+
+void MemoryLevelTest::testBackwardSearch()
+{
+    // the Low level keeps fewer text pages than a search asks for at once
+    Okular::SettingsCore::setMemoryLevel( Okular::SettingsCore::EnumMemoryLevel::Low );
+    Okular::Document document( 0 );
+
+    QMimeDatabase db;
+    const QMimeType mime = db.mimeTypeForName( QStringLiteral("application/x-zerosize") );
+    QCOMPARE( document.openDocument( m_emptyFile.fileName(), QUrl(), mime ), Okular::Document::OpenSuccess );
+
+    int finishedCount = 0;
+    Okular::Document::SearchStatus status = Okular::Document::NoMatchFound;
+    connect( &document, &Okular::Document::searchFinished, [&finishedCount, &status]( int, Okular::Document::SearchStatus s ) {
+        ++finishedCount;
+        status = s;
+    } );
+
+    // from the last page backward, each page must be searched
+    const int searchId = 0;
+    document.searchText( searchId, QStringLiteral( "Page 40, line 1" ), true, Qt::CaseSensitive, Okular::Document::PreviousMatch, false, QColor() );
+    QTRY_COMPARE( finishedCount, 1 );
+    QCOMPARE( status, Okular::Document::MatchFound );
+    QVERIFY( document.page( 39 )->hasHighlights( searchId ) );
+
+    document.closeDocument();
+}
+
+void MemoryLevelTest::showPages( int first, int last, int width, const Okular::NormalizedRect &visibleRect )
+{
+    const int height = width * PageHeight / PageWidth;
+    const bool tiled = !visibleRect.isNull();
+
+    m_observer->m_visiblePages.clear();
+    QVector< Okular::VisiblePageRect * > visibleRects;
+    QLinkedList< Okular::PixmapRequest * > requests;
+    m_visiblePixmapsMemory = 0;
+    for ( int page = first; page <= last; ++page )
+    {
+        m_observer->m_visiblePages.insert( page );
+        visibleRects << new Okular::VisiblePageRect( page, tiled ? visibleRect : Okular::NormalizedRect( 0, 0, 1, 1 ) );
+
+        Okular::PixmapRequest *request = new Okular::PixmapRequest( m_observer, page, width, height, 1, Okular::PixmapRequest::NoFeature );
+        if ( tiled )
+        {
+            // as PageView, the document switches to tiles by itself
+            request->setNormalizedRect( visibleRect );
+            request->setTile( m_document->page( page )->hasTilesManager( m_observer ) );
+        }
+        requests << request;
+
+        // the tiles of a page can not take more than the whole page
+        const qulonglong pixmapMemory = 4 * (qulonglong)width * height;
+        m_visiblePixmapsMemory += pixmapMemory;
+        m_largestPixmapMemory = qMax( m_largestPixmapMemory, pixmapMemory );
+    }
+
+    m_document->setViewportPage( first );
+    m_document->setVisiblePageRects( visibleRects );
+    m_document->requestPixmaps( requests );
+
+    for ( int page = first; page <= last; ++page )
+    {
+        QTRY_VERIFY( m_document->page( page )->hasPixmap( m_observer, width, height, tiled ? visibleRect : Okular::NormalizedRect() ) );
+        if ( !m_document->page( page )->hasTextPage() )
+            m_document->requestTextPage( page );
+        QVERIFY( m_document->page( page )->hasTextPage() );
+    }
+}
+
+void MemoryLevelTest::checkMemory( const char *step )
+{
+    const Okular::RenderStatistics stats = m_document->renderStatistics();
+
+    const qulonglong maxPixmapsMemory = m_limit + m_slackPixmaps * m_largestPixmapMemory + m_visiblePixmapsMemory;
+    QVERIFY2( stats.allocatedPixmapsMemory <= maxPixmapsMemory,
+              qPrintable( QStringLiteral( "%1: %2 bytes of pixmaps, more than %3" ).arg( QLatin1String( step ) ).arg( stats.allocatedPixmapsMemory ).arg( maxPixmapsMemory ) ) );
+
+    int textPages = 0;
+    for ( uint i = 0; i < m_document->pages(); ++i )
+    {
+        if ( m_document->page( i )->hasTextPage() )
+            ++textPages;
+    }
+    QCOMPARE( stats.allocatedTextPages, textPages );
+    QVERIFY2( textPages <= m_maxTextPages,
+              qPrintable( QStringLiteral( "%1: %2 text pages, more than %3" ).arg( QLatin1String( step ) ).arg( textPages ).arg( m_maxTextPages ) ) );
+}
+
+QTEST_MAIN( MemoryLevelTest )
+#include "memoryleveltest.moc"
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <QImage>
+
+#include "../core/area.h"
+#include "../core/generator.h"
+#include "../core/page.h"
+#include "../core/textpage.h"
+
+// A generator of blank pages, whatever the file: memorytest opens empty
+// files with it, so that the pixmaps have exactly the requested size.
+class MemoryTestGenerator : public Okular::Generator
+{
+    Q_OBJECT
+    Q_INTERFACES( Okular::Generator )
+
+    public:
+        static const int PageCount = 100;
+        static const int PageWidth = 1000;
+        static const int PageHeight = 1300;
+
+        MemoryTestGenerator( QObject *parent, const QVariantList &args )
+            : Okular::Generator( parent, args )
+        {
+            setFeature( TiledRendering );
+            setFeature( TextExtraction );
+        }
+
+        bool loadDocument( const QString &fileName, QVector< Okular::Page * > &pagesVector ) override
+        {
+            Q_UNUSED( fileName );
+            pagesVector.resize( PageCount );
+            for ( int i = 0; i < PageCount; ++i )
+                pagesVector[i] = new Okular::Page( i, PageWidth, PageHeight, Okular::Rotation0 );
+            return true;
+        }
+
+    protected:
+        bool doCloseDocument() override
+        {
+            return true;
+        }
+
+        QImage image( Okular::PixmapRequest *request ) override
+        {
+            // a tile request only wants its part of the page
+            const QSize size = request->isTile() ? request->normalizedRect().geometry( request->width(), request->height() ).size()
+                                                 : QSize( request->width(), request->height() );
+            QImage image( size, QImage::Format_RGB32 );
+            image.fill( Qt::white );
+            return image;
+        }
+
+        Okular::TextPage* textPage( Okular::Page *page ) override
+        {
+            Okular::TextPage *tp = new Okular::TextPage;
+            for ( int line = 0; line < 40; ++line )
+            {
+                const double top = 0.05 + line * 0.02;
+                tp->append( QStringLiteral( "Page %1, line %2\n" ).arg( page->number() + 1 ).arg( line + 1 ),
+                            Okular::NormalizedRect( 0.1, top, 0.9, top + 0.015 ) );
+            }
+            return tp;
+        }
+};
+
+OKULAR_EXPORT_PLUGIN(MemoryTestGenerator, "memorytestgenerator.json")
+
+#include "memorytestgenerator.moc"
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <QtTest>
+
+#include "../core/area.h"
+#include "../core/textpage.h"
+
+// Measures how fast synthetic characters are converted into TextPage
+// objects. The text extraction of real
+// documents is measured by documentbenchmark.
+class TextPageBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testAppendOverloads();
+        void benchmarkAppend();
+};
+
+static const int BenchmarkWords = 20000;
+
+static QString wordText( int word )
+{
+    static const QString words[] = {
+        QStringLiteral("Lorem"), QStringLiteral("ipsum"), QStringLiteral("dolor"),
+        QStringLiteral("sit"), QStringLiteral("amet"), QStringLiteral("fínal")
+    };
+    return words[ word % 6 ];
+}
+
+void TextPageBenchmark::testAppendOverloads()
+{
+    Okular::TextPage *oldTp = new Okular::TextPage;
+    Okular::TextPage *newTp = new Okular::TextPage;
+    newTp->reserve( 100 );
+    for ( int i = 0; i < 100; ++i )
+    {
+        const QString text = wordText( i );
+        const Okular::NormalizedRect rect( i / 100.0, 0.1, ( i + 1 ) / 100.0, 0.2 );
+        oldTp->append( text, new Okular::NormalizedRect( rect ) );
+        newTp->append( text, rect );
+    }
+
+    QCOMPARE( newTp->text(), oldTp->text() );
+    // the composed character is normalized by both
+    QVERIFY( newTp->text().contains( QStringLiteral("fínal").normalized( QString::NormalizationForm_KC ) ) );
+
+    delete oldTp;
+    delete newTp;
+}
+
+void TextPageBenchmark::benchmarkAppend()
+{
+    QBENCHMARK
+    {
+        Okular::TextPage *tp = new Okular::TextPage;
+        tp->reserve( BenchmarkWords * 6 );
+        for ( int i = 0; i < BenchmarkWords; ++i )
+        {
+            const QString word = wordText( i );
+            for ( int j = 0; j < word.length(); ++j )
+                tp->append( word.mid( j, 1 ), Okular::NormalizedRect( j / 10.0, 0.1, ( j + 1 ) / 10.0, 0.2 ) );
+        }
+        delete tp;
+    }
+}
+
+QTEST_MAIN( TextPageBenchmark )
+#include "textpagebenchmark.moc"
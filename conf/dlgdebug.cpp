@@ -27,6 +27,7 @@ DlgDebug::DlgDebug( QWidget * parent )
 
     DEBUG_SIMPLE_BOOL( "DebugDrawBoundaries", lay );
     DEBUG_SIMPLE_BOOL( "DebugDrawAnnotationRect", lay );
+    DEBUG_SIMPLE_BOOL( "DebugDrawPerformanceOverlay", lay );
     DEBUG_SIMPLE_BOOL( "TocPageColumn", lay );
 
     lay->addItem( new QSpacerItem( 5, 5, QSizePolicy::Fixed, QSizePolicy::MinimumExpanding ) );
@@ -0,0 +1,263 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "docdatastore_p.h"
+
+// qt/kde includes
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+
+// local includes
+#include "debug_p.h"
+
+using namespace Okular;
+
+static const quint32 DocDataStoreMagic = 0x4f4b4444; // "OKDD"
+static const quint32 DocDataStoreVersion = 1;
+static const qint64 HeaderSize = 8;
+static const qint64 RecordHeaderSize = 8;
+
+static void writeRecord( QDataStream &stream, int page, const QByteArray &contents )
+{
+    stream << (qint32)page << (quint32)contents.size();
+    stream.writeRawData( contents.constData(), contents.size() );
+}
+
+DocDataStore::DocDataStore( const QString &fileName )
+    : m_fileName( fileName ), m_fileSize( 0 ), m_usedSize( 0 )
+{
+}
+
+bool DocDataStore::load()
+{
+    m_records.clear();
+    m_fileSize = 0;
+    m_usedSize = 0;
+
+    QFile file( m_fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+        return false;
+
+    QDataStream stream( &file );
+    quint32 magic, version;
+    stream >> magic >> version;
+    if ( stream.status() != QDataStream::Ok || magic != DocDataStoreMagic || version != DocDataStoreVersion )
+    {
+        qCWarning(OkularCoreDebug) << "Invalid docdata store" << m_fileName;
+        return false;
+    }
+
+    // a record cut by a crash in the middle of a save ends the valid part of
+    // the file, the next save overwrites it
+    const qint64 available = file.size();
+    qint64 pos = HeaderSize;
+    while ( pos + RecordHeaderSize <= available )
+    {
+        qint32 page;
+        quint32 size;
+        stream >> page >> size;
+        if ( stream.status() != QDataStream::Ok || pos + RecordHeaderSize + size > available )
+            break;
+
+        QHash< int, Record >::iterator it = m_records.find( page );
+        if ( it != m_records.end() )
+        {
+            m_usedSize -= RecordHeaderSize + it->size;
+            m_records.erase( it );
+        }
+        if ( size > 0 )
+        {
+            const Record record = { pos + RecordHeaderSize, size };
+            m_records.insert( page, record );
+            m_usedSize += RecordHeaderSize + size;
+        }
+
+        pos += RecordHeaderSize + size;
+        if ( !file.seek( pos ) )
+            break;
+    }
+    m_fileSize = pos;
+
+    return true;
+}
+
+QList< int > DocDataStore::pages() const
+{
+    return m_records.keys();
+}
+
+bool DocDataStore::contains( int page ) const
+{
+    return m_records.contains( page );
+}
+
+QByteArray DocDataStore::pageContents( int page ) const
+{
+    const QHash< int, Record >::const_iterator it = m_records.constFind( page );
+    if ( it == m_records.constEnd() )
+        return QByteArray();
+
+    QFile file( m_fileName );
+    if ( !file.open( QIODevice::ReadOnly ) || !file.seek( it->offset ) )
+        return QByteArray();
+
+    QByteArray contents = file.read( it->size );
+    if ( contents.size() != (int)it->size )
+        return QByteArray();
+    return contents;
+}
+
+bool DocDataStore::save( const QMap< int, QByteArray > &contents )
+{
+    // leave out what would not change the stored data
+    QMap< int, QByteArray > changed;
+    QMap< int, QByteArray >::const_iterator it = contents.constBegin(), itEnd = contents.constEnd();
+    for ( ; it != itEnd; ++it )
+    {
+        const QHash< int, Record >::const_iterator recordIt = m_records.constFind( it.key() );
+        if ( recordIt == m_records.constEnd() )
+        {
+            if ( it.value().isEmpty() )
+                continue;
+        }
+        else if ( recordIt->size == (quint32)it.value().size() && pageContents( it.key() ) == it.value() )
+        {
+            continue;
+        }
+        changed.insert( it.key(), it.value() );
+    }
+
+    if ( changed.isEmpty() )
+        return true;
+
+    // compute the size of the file after appending the changes, and how much
+    // of it would be still used
+    qint64 newFileSize = m_fileSize > 0 ? m_fileSize : HeaderSize;
+    qint64 newUsedSize = m_usedSize;
+    for ( it = changed.constBegin(), itEnd = changed.constEnd(); it != itEnd; ++it )
+    {
+        const QHash< int, Record >::const_iterator recordIt = m_records.constFind( it.key() );
+        if ( recordIt != m_records.constEnd() )
+            newUsedSize -= RecordHeaderSize + recordIt->size;
+        if ( !it.value().isEmpty() )
+            newUsedSize += RecordHeaderSize + it.value().size();
+        newFileSize += RecordHeaderSize + it.value().size();
+    }
+
+    if ( m_fileSize == 0 || ( newFileSize - HeaderSize ) > 2 * newUsedSize )
+        return rewrite( changed );
+    return append( changed );
+}
+
+void DocDataStore::clear()
+{
+    m_records.clear();
+    m_fileSize = 0;
+    m_usedSize = 0;
+    QFile::remove( m_fileName );
+}
+
+bool DocDataStore::append( const QMap< int, QByteArray > &contents )
+{
+    QFile file( m_fileName );
+    if ( !file.open( QIODevice::ReadWrite ) )
+    {
+        qCWarning(OkularCoreDebug) << "Failed to open docdata store" << m_fileName;
+        return false;
+    }
+
+    // drop a record possibly left incomplete by a previous save
+    if ( file.size() != m_fileSize && !file.resize( m_fileSize ) )
+        return false;
+    if ( !file.seek( m_fileSize ) )
+        return false;
+
+    QDataStream stream( &file );
+    qint64 pos = m_fileSize;
+    QMap< int, QByteArray >::const_iterator it = contents.constBegin(), itEnd = contents.constEnd();
+    for ( ; it != itEnd; ++it )
+    {
+        writeRecord( stream, it.key(), it.value() );
+
+        QHash< int, Record >::iterator recordIt = m_records.find( it.key() );
+        if ( recordIt != m_records.end() )
+        {
+            m_usedSize -= RecordHeaderSize + recordIt->size;
+            m_records.erase( recordIt );
+        }
+        if ( !it.value().isEmpty() )
+        {
+            const Record record = { pos + RecordHeaderSize, (quint32)it.value().size() };
+            m_records.insert( it.key(), record );
+            m_usedSize += RecordHeaderSize + record.size;
+        }
+        pos += RecordHeaderSize + it.value().size();
+    }
+
+    if ( stream.status() != QDataStream::Ok || !file.flush() )
+    {
+        qCWarning(OkularCoreDebug) << "Failed to write docdata store" << m_fileName;
+        // the records written so far may be incomplete, read them again
+        file.close();
+        load();
+        return false;
+    }
+    m_fileSize = pos;
+
+    return true;
+}
+
+bool DocDataStore::rewrite( const QMap< int, QByteArray > &contents )
+{
+    // merge the valid stored records with the new ones
+    QMap< int, QByteArray > all = contents;
+    QHash< int, Record >::const_iterator recordIt = m_records.constBegin(), recordEnd = m_records.constEnd();
+    for ( ; recordIt != recordEnd; ++recordIt )
+    {
+        if ( !all.contains( recordIt.key() ) )
+            all.insert( recordIt.key(), pageContents( recordIt.key() ) );
+    }
+
+    QSaveFile file( m_fileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+    {
+        qCWarning(OkularCoreDebug) << "Failed to open docdata store" << m_fileName;
+        return false;
+    }
+
+    QDataStream stream( &file );
+    stream << DocDataStoreMagic << DocDataStoreVersion;
+
+    QHash< int, Record > records;
+    qint64 pos = HeaderSize;
+    QMap< int, QByteArray >::const_iterator it = all.constBegin(), itEnd = all.constEnd();
+    for ( ; it != itEnd; ++it )
+    {
+        if ( it.value().isEmpty() )
+            continue;
+
+        writeRecord( stream, it.key(), it.value() );
+        const Record record = { pos + RecordHeaderSize, (quint32)it.value().size() };
+        records.insert( it.key(), record );
+        pos += RecordHeaderSize + record.size;
+    }
+
+    if ( stream.status() != QDataStream::Ok || !file.commit() )
+    {
+        qCWarning(OkularCoreDebug) << "Failed to write docdata store" << m_fileName;
+        return false;
+    }
+
+    m_records = records;
+    m_fileSize = pos;
+    m_usedSize = pos - HeaderSize;
+
+    return true;
+}
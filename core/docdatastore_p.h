@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_DOCDATASTORE_P_H_
+#define _OKULAR_DOCDATASTORE_P_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+
+namespace Okular {
+
+/* Append-only binary store of the per page document data (annotations,
+ * form values, bounding box) that lives next to the docdata XML file.
+ *
+ * The file is a header followed by records, each holding the contents of
+ * one page (the serialized <page> element, or nothing if the page has no
+ * data any more). A newer record of a page replaces the older ones, so a
+ * save only appends the pages that changed; when the replaced records take
+ * more space than the valid ones the file is rewritten compacted.
+ * Only the position of the records is read when opening, their contents
+ * are read when the page needs them. */
+class DocDataStore
+{
+    public:
+        explicit DocDataStore( const QString &fileName );
+
+        // reads the position of the records, returns false if there is no
+        // valid store in the file
+        bool load();
+
+        // the pages with stored contents
+        QList< int > pages() const;
+        bool contains( int page ) const;
+
+        // reads the stored contents of the given page
+        QByteArray pageContents( int page ) const;
+
+        // writes the given contents (an empty one removes the page), leaving
+        // out the ones equal to what is already stored
+        bool save( const QMap< int, QByteArray > &contents );
+
+        // removes the store file
+        void clear();
+
+    private:
+        struct Record
+        {
+            qint64 offset;
+            quint32 size;
+        };
+
+        bool append( const QMap< int, QByteArray > &contents );
+        bool rewrite( const QMap< int, QByteArray > &contents );
+
+        QString m_fileName;
+        QHash< int, Record > m_records;
+        // end of the last valid record, and bytes taken by the valid records
+        qint64 m_fileSize;
+        qint64 m_usedSize;
+};
+
+}
+
+#endif
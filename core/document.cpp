@@ -31,12 +31,12 @@
 #include <QtCore/qtemporaryfile.h>
 #include <QtCore/QTextStream>
 #include <QtCore/QTimer>
+#include <QtCore/QXmlStreamReader>
+#include <QtGui/QPainter>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QLabel>
 #include <QtPrintSupport/QPrinter>
 #include <QtPrintSupport/QPrintDialog>
-#include <QStack>
-#include <QUndoCommand>
 #include <QMimeDatabase>
 #include <QDesktopServices>
 #include <QPageSize>
@@ -66,6 +66,7 @@
 #include "bookmarkmanager.h"
 #include "chooseenginedialog_p.h"
 #include "debug_p.h"
+#include "docdatastore_p.h"
 #include "generator_p.h"
 #include "interfaces/configinterface.h"
 #include "interfaces/guiinterface.h"
@@ -83,6 +84,7 @@
 #include "texteditors_p.h"
 #include "tile.h"
 #include "tilesmanager_p.h"
+#include "tracer_p.h"
 #include "utils_p.h"
 #include "view.h"
 #include "view_p.h"
@@ -142,6 +144,13 @@ struct RunningSearch
 
 #define OKULAR_HISTORY_MAXSTEPS 100
 #define OKULAR_HISTORY_SAVEDSTEPS 10
+#define OKULAR_TEXTPAGES_BATCH 16
+// how long to wait before loading again the page data that could not be
+// loaded while the generator was busy (msecs)
+#define OKULAR_PAGEDATA_RETRY_DELAY 50
+// the largest pixmaps (pixels) that can be scaled down from the ones of other
+// observers, as the thumbnails: larger ones are better rendered
+#define OKULAR_DERIVED_PIXMAP_MAX_AREA 262144
 
 /***** Document ******/
 
@@ -381,8 +390,23 @@ AllocatedPixmap * DocumentPrivate::searchLowestPriorityPixmap( bool unloadableOn
     return selectedPixmap;
 }
 
+// the memory of the system as set by setSystemMemoryOverride()
+static qulonglong s_totalMemoryOverride = 0;
+static qulonglong s_freeMemoryOverride = 0;
+static qulonglong s_freeSwapOverride = 0;
+
+void DocumentPrivate::setSystemMemoryOverride( qulonglong totalMemory, qulonglong freeMemory, qulonglong freeSwap )
+{
+    s_totalMemoryOverride = totalMemory;
+    s_freeMemoryOverride = freeMemory;
+    s_freeSwapOverride = freeSwap;
+}
+
 qulonglong DocumentPrivate::getTotalMemory()
 {
+    if ( s_totalMemoryOverride )
+        return s_totalMemoryOverride;
+
     static qulonglong cachedValue = 0;
     if ( cachedValue )
         return cachedValue;
@@ -419,6 +443,13 @@ qulonglong DocumentPrivate::getTotalMemory()
 
 qulonglong DocumentPrivate::getFreeMemory( qulonglong *freeSwap )
 {
+    if ( s_totalMemoryOverride )
+    {
+        if (freeSwap)
+            *freeSwap = s_freeSwapOverride;
+        return s_freeMemoryOverride;
+    }
+
     static QTime lastUpdate = QTime::currentTime().addSecs(-3);
     static qulonglong cachedValue = 0;
     static qulonglong cachedFreeSwap = 0;
@@ -531,8 +562,21 @@ void DocumentPrivate::loadDocumentInfo()
     if ( m_xmlFileName.isEmpty() )
         return;
 
+    // the contents of the pages are in the binary store, and they are
+    // restored when the pages are loaded (see loadPageData())
+    delete m_docDataStore;
+    m_docDataStore = new DocDataStore( docDataStoreFileName( m_xmlFileName ) );
+    m_docDataStore->load();
+
     QFile infoFile( m_xmlFileName );
     loadDocumentInfo( infoFile );
+
+    // form values are needed as soon as the views are set up
+    foreach ( int page, m_docDataStore->pages() )
+    {
+        if ( page >= 0 && page < m_pagesVector.count() && !m_pagesVector[ page ]->formFields().isEmpty() )
+            loadPageData( page, false );
+    }
 }
 
 void DocumentPrivate::loadDocumentInfo( QFile &infoFile )
@@ -540,80 +584,75 @@ void DocumentPrivate::loadDocumentInfo( QFile &infoFile )
     if ( !infoFile.exists() || !infoFile.open( QIODevice::ReadOnly ) )
         return;
 
-    // Load DOM from XML file
-    QDomDocument doc( QStringLiteral("documentInfo") );
-    if ( !doc.setContent( &infoFile ) )
+    // Read the XML file as a stream, without building a DOM of all of it
+    QXmlStreamReader reader( &infoFile );
+    if ( !reader.readNextStartElement() || reader.name() != QLatin1String("documentInfo") )
     {
         qCDebug(OkularCoreDebug) << "Can't load XML pair! Check for broken xml.";
         infoFile.close();
         return;
     }
-    infoFile.close();
 
-    QDomElement root = doc.documentElement();
-    if ( root.tagName() != QLatin1String("documentInfo") )
-        return;
-
-    // Parse the DOM tree
-    QDomNode topLevelNode = root.firstChild();
-    while ( topLevelNode.isElement() )
+    while ( reader.readNextStartElement() )
     {
-        QString catName = topLevelNode.toElement().tagName();
-
-        // Restore page attributes (bookmark, annotations, ...) from the DOM
-        if ( catName == QLatin1String("pageList") )
+        // Restore page attributes (bookmark, annotations, ...) from the XML
+        if ( reader.name() == QLatin1String("pageList") )
         {
-            QDomNode pageNode = topLevelNode.firstChild();
-            while ( pageNode.isElement() )
+            // the page contents saved in the XML by older versions are newer
+            // than the binary store, if any: restore them and migrate them to
+            // a new store at the next save
+            if ( m_docDataStore )
+                m_docDataStore->clear();
+
+            while ( reader.readNextStartElement() )
             {
-                QDomElement pageElement = pageNode.toElement();
-                if ( pageElement.hasAttribute( QStringLiteral("number") ) )
+                // get page number (node's attribute)
+                bool ok = false;
+                int pageNumber = -1;
+                if ( reader.name() == QLatin1String("page") )
+                    pageNumber = reader.attributes().value( QStringLiteral("number") ).toInt( &ok );
+
+                // pass the reader to the right page, to read config data from
+                if ( ok && pageNumber >= 0 && pageNumber < (int)m_pagesVector.count() )
                 {
-                    // get page number (node's attribute)
-                    bool ok;
-                    int pageNumber = pageElement.attribute( QStringLiteral("number") ).toInt( &ok );
-
-                    // pass the domElement to the right page, to read config data from
-                    if ( ok && pageNumber >= 0 && pageNumber < (int)m_pagesVector.count() )
-                        m_pagesVector[ pageNumber ]->d->restoreLocalContents( pageElement );
+                    m_pagesVector[ pageNumber ]->d->restoreLocalContents( reader );
+                    m_dirtyDocDataPages.insert( pageNumber );
+                }
+                else
+                {
+                    reader.skipCurrentElement();
                 }
-                pageNode = pageNode.nextSibling();
             }
         }
 
-        // Restore 'general info' from the DOM
-        else if ( catName == QLatin1String("generalInfo") )
+        // Restore 'general info' from the XML
+        else if ( reader.name() == QLatin1String("generalInfo") )
         {
-            QDomNode infoNode = topLevelNode.firstChild();
-            while ( infoNode.isElement() )
+            while ( reader.readNextStartElement() )
             {
-                QDomElement infoElement = infoNode.toElement();
-
                 // restore viewports history
-                if ( infoElement.tagName() == QLatin1String("history") )
+                if ( reader.name() == QLatin1String("history") )
                 {
                     // clear history
                     m_viewportHistory.clear();
                     // append old viewports
-                    QDomNode historyNode = infoNode.firstChild();
-                    while ( historyNode.isElement() )
+                    while ( reader.readNextStartElement() )
                     {
-                        QDomElement historyElement = historyNode.toElement();
-                        if ( historyElement.hasAttribute( QStringLiteral("viewport") ) )
+                        const QStringRef vpString = reader.attributes().value( QStringLiteral("viewport") );
+                        if ( !vpString.isNull() )
                         {
-                            QString vpString = historyElement.attribute( QStringLiteral("viewport") );
                             m_viewportIterator = m_viewportHistory.insert( m_viewportHistory.end(),
-                                    DocumentViewport( vpString ) );
+                                    DocumentViewport( vpString.toString() ) );
                         }
-                        historyNode = historyNode.nextSibling();
+                        reader.skipCurrentElement();
                     }
                     // consistancy check
                     if ( m_viewportHistory.isEmpty() )
                         m_viewportIterator = m_viewportHistory.insert( m_viewportHistory.end(), DocumentViewport() );
                 }
-                else if ( infoElement.tagName() == QLatin1String("rotation") )
+                else if ( reader.name() == QLatin1String("rotation") )
                 {
-                    QString str = infoElement.text();
+                    const QString str = reader.readElementText( QXmlStreamReader::SkipChildElements );
                     bool ok = true;
                     int newrotation = !str.isEmpty() ? ( str.toInt( &ok ) % 4 ) : 0;
                     if ( ok && newrotation != 0 )
@@ -621,45 +660,56 @@ void DocumentPrivate::loadDocumentInfo( QFile &infoFile )
                         setRotationInternal( newrotation, false );
                     }
                 }
-                else if ( infoElement.tagName() == QLatin1String("views") )
+                else if ( reader.name() == QLatin1String("views") )
                 {
-                    QDomNode viewNode = infoNode.firstChild();
-                    while ( viewNode.isElement() )
+                    while ( reader.readNextStartElement() )
                     {
-                        QDomElement viewElement = viewNode.toElement();
-                        if ( viewElement.tagName() == QLatin1String("view") )
+                        View *wantedView = 0;
+                        if ( reader.name() == QLatin1String("view") )
                         {
-                            const QString viewName = viewElement.attribute( QStringLiteral("name") );
+                            const QStringRef viewName = reader.attributes().value( QStringLiteral("name") );
                             Q_FOREACH ( View * view, m_views )
                             {
                                 if ( view->name() == viewName )
                                 {
-                                    loadViewsInfo( view, viewElement );
+                                    wantedView = view;
                                     break;
                                 }
                             }
                         }
-                        viewNode = viewNode.nextSibling();
+                        if ( wantedView )
+                            loadViewsInfo( wantedView, reader );
+                        else
+                            reader.skipCurrentElement();
                     }
                 }
-                infoNode = infoNode.nextSibling();
+                else
+                {
+                    reader.skipCurrentElement();
+                }
             }
         }
 
-        topLevelNode = topLevelNode.nextSibling();
+        else
+        {
+            reader.skipCurrentElement();
+        }
     } // </documentInfo>
+
+    // whatever was read before an error is kept
+    if ( reader.hasError() )
+        qCDebug(OkularCoreDebug) << "Error reading the XML pair:" << reader.errorString() << "at line" << reader.lineNumber();
+    infoFile.close();
 }
 
-void DocumentPrivate::loadViewsInfo( View *view, const QDomElement &e )
+void DocumentPrivate::loadViewsInfo( View *view, QXmlStreamReader &reader )
 {
-    QDomNode viewNode = e.firstChild();
-    while ( viewNode.isElement() )
+    while ( reader.readNextStartElement() )
     {
-        QDomElement viewElement = viewNode.toElement();
-
-        if ( viewElement.tagName() == QLatin1String("zoom") )
+        if ( reader.name() == QLatin1String("zoom") )
         {
-            const QString valueString = viewElement.attribute( QStringLiteral("value") );
+            const QXmlStreamAttributes attributes = reader.attributes();
+            const QStringRef valueString = attributes.value( QStringLiteral("value") );
             bool newzoom_ok = true;
             const double newzoom = !valueString.isEmpty() ? valueString.toDouble( &newzoom_ok ) : 1.0;
             if ( newzoom_ok && newzoom != 0
@@ -668,7 +718,7 @@ void DocumentPrivate::loadViewsInfo( View *view, const QDomElement &e )
             {
                 view->setCapability( View::Zoom, newzoom );
             }
-            const QString modeString = viewElement.attribute( QStringLiteral("mode") );
+            const QStringRef modeString = attributes.value( QStringLiteral("mode") );
             bool newmode_ok = true;
             const int newmode = !modeString.isEmpty() ? modeString.toInt( &newmode_ok ) : 2;
             if ( newmode_ok
@@ -679,7 +729,7 @@ void DocumentPrivate::loadViewsInfo( View *view, const QDomElement &e )
             }
         }
 
-        viewNode = viewNode.nextSibling();
+        reader.skipCurrentElement();
     }
 }
 
@@ -843,6 +893,7 @@ Document::OpenResult DocumentPrivate::openDocumentInternal( const KPluginMetaDat
     QObject::connect( m_generator, &Generator::error, m_parent, &Document::error );
     QObject::connect( m_generator, &Generator::warning, m_parent, &Document::warning );
     QObject::connect( m_generator, &Generator::notice, m_parent, &Document::notice );
+    QObject::connect( m_generator, &Generator::exportProgress, m_parent, &Document::exportProgress );
 
     QApplication::setOverrideCursor( Qt::WaitCursor );
 
@@ -982,8 +1033,13 @@ void DocumentPrivate::performAddPageAnnotation( int page, Annotation * annotatio
     if ( annotation->d_ptr->m_page )
         return;
 
+    // the annotations of the file must be there before adding new ones
+    // (observers are notified below)
+    loadPageData( page, false );
+
     // add annotation to the page
     kp->addAnnotation( annotation );
+    m_dirtyDocDataPages.insert( page );
 
     // tell the annotation proxy
     if ( proxy && proxy->supports(AnnotationProxy::Addition) )
@@ -1025,6 +1081,7 @@ void DocumentPrivate::performRemovePageAnnotation( int page, Annotation * annota
             proxy->notifyRemoval( annotation, page );
 
         kp->removeAnnotation( annotation ); // Also destroys the object
+        m_dirtyDocDataPages.insert( page );
 
         // in case of success, notify observers about the change
         notifyAnnotationChanges( page );
@@ -1054,6 +1111,7 @@ void DocumentPrivate::performModifyPageAnnotation( int page, Annotation * annota
     {
         proxy->notifyModification( annotation, page, appearanceChanged );
     }
+    m_dirtyDocDataPages.insert( page );
 
     // notify observers about the change
     notifyAnnotationChanges( page );
@@ -1148,11 +1206,39 @@ void DocumentPrivate::recalculateForms()
     }
 }
 
-void DocumentPrivate::saveDocumentInfo() const
+void DocumentPrivate::saveDocumentInfo()
 {
     if ( m_xmlFileName.isEmpty() )
         return;
 
+    // 1. Save the contents of the pages changed since the last save to the
+    // binary store
+    if ( !m_docDataStore )
+        m_docDataStore = new DocDataStore( docDataStoreFileName( m_xmlFileName ) );
+    PageItems saveWhat = AllPageItems;
+    if ( m_annotationsNeedSaveAs )
+    {
+        /* In this case, if the user makes a modification, he's requested to
+            * save to a new document. Therefore, if there are existing local
+            * annotations, we save them back unmodified in the original
+            * document's metadata, so that it appears that it was not changed */
+        saveWhat |= OriginalAnnotationPageItems;
+    }
+    QMap< int, QByteArray > pageContents;
+    for ( int i = 0; i < m_pagesVector.count(); ++i )
+    {
+        // form values change in too many ways to be tracked, so the pages
+        // with forms are always checked (the store skips what did not change)
+        if ( !m_dirtyDocDataPages.contains( i ) && m_pagesVector[ i ]->formFields().isEmpty() )
+            continue;
+
+        // do not overwrite stored contents that were never restored
+        loadPageData( i, false );
+        pageContents.insert( i, m_pagesVector[ i ]->d->localContents( saveWhat ) );
+    }
+    if ( m_docDataStore->save( pageContents ) )
+        m_dirtyDocDataPages.clear();
+
     QFile infoFile( m_xmlFileName );
     qCDebug(OkularCoreDebug) << "About to save document info to" << m_xmlFileName;
     if (!infoFile.open( QIODevice::WriteOnly | QIODevice::Truncate))
@@ -1161,7 +1247,7 @@ void DocumentPrivate::saveDocumentInfo() const
         return;
 
     }
-    // 1. Create DOM
+    // 2. Create DOM
     QDomDocument doc( QStringLiteral("documentInfo") );
     QDomProcessingInstruction xmlPi = doc.createProcessingInstruction(
             QStringLiteral( "xml" ), QStringLiteral( "version=\"1.0\" encoding=\"utf-8\"" ) );
@@ -1170,24 +1256,7 @@ void DocumentPrivate::saveDocumentInfo() const
     root.setAttribute( QStringLiteral("url"), m_url.toDisplayString(QUrl::PreferLocalFile) );
     doc.appendChild( root );
 
-    // 2.1. Save page attributes (bookmark state, annotations, ... ) to DOM
-    QDomElement pageList = doc.createElement( QStringLiteral("pageList") );
-    root.appendChild( pageList );
-    PageItems saveWhat = AllPageItems;
-    if ( m_annotationsNeedSaveAs )
-    {
-        /* In this case, if the user makes a modification, he's requested to
-            * save to a new document. Therefore, if there are existing local
-            * annotations, we save them back unmodified in the original
-            * document's metadata, so that it appears that it was not changed */
-        saveWhat |= OriginalAnnotationPageItems;
-    }
-    // <page list><page number='x'>.... </page> save pages that hold data
-    QVector< Page * >::const_iterator pIt = m_pagesVector.constBegin(), pEnd = m_pagesVector.constEnd();
-    for ( ; pIt != pEnd; ++pIt )
-        (*pIt)->d->saveLocalContents( pageList, doc, saveWhat );
-
-    // 2.2. Save document info (current viewport, history, ... ) to DOM
+    // 3. Save document info (current viewport, history, ... ) to DOM
     QDomElement generalInfo = doc.createElement( QStringLiteral("generalInfo") );
     root.appendChild( generalInfo );
     // create rotation node
@@ -1233,7 +1302,7 @@ void DocumentPrivate::saveDocumentInfo() const
         saveViewsInfo( view, viewEntry );
     }
 
-    // 3. Save DOM to XML file
+    // 4. Save DOM to XML file
     QString xml = doc.toString();
     QTextStream os( &infoFile );
     os.setCodec( "UTF-8" );
@@ -1241,6 +1310,87 @@ void DocumentPrivate::saveDocumentInfo() const
     infoFile.close();
 }
 
+void DocumentPrivate::loadPageData( int page, bool notify, bool wait )
+{
+    Page *kp = m_pagesVector.value( page );
+    if ( !kp || kp->d->m_pageDataLoaded )
+        return;
+
+    if ( m_generator && m_generator->hasFeature( Generator::LazyPageData ) )
+    {
+        // the pixmap and text threads hold the mutex while they use the
+        // document; the views do not wait for them, the page is loaded later
+        QMutex *mutex = m_generator->userMutex();
+        if ( wait )
+        {
+            mutex->lock();
+        }
+        else if ( !mutex->tryLock() )
+        {
+            m_pendingPageData.insert( page );
+            if ( !m_pageDataTimer )
+            {
+                m_pageDataTimer = new QTimer( m_parent );
+                m_pageDataTimer->setSingleShot( true );
+                QObject::connect( m_pageDataTimer, SIGNAL(timeout()), m_parent, SLOT(loadPendingPageData()) );
+            }
+            if ( !m_pageDataTimer->isActive() )
+                m_pageDataTimer->start( OKULAR_PAGEDATA_RETRY_DELAY );
+            return;
+        }
+
+        kp->d->m_pageDataLoaded = true;
+        m_generator->loadPageData( kp );
+        mutex->unlock();
+
+        if ( !kp->annotations().isEmpty() )
+        {
+            // the file contains annotations, as if they were loaded at opening time
+            if ( canAddAnnotationsNatively() )
+                m_annotationsNeedSaveAs = true;
+
+            if ( notify )
+                notifyAnnotationChanges( page );
+        }
+    }
+    kp->d->m_pageDataLoaded = true;
+    m_pendingPageData.remove( page );
+
+    // then restore what was saved for the page in the docdata; this is not
+    // a change of the page, so it does not need to be saved again
+    if ( m_docDataStore && m_docDataStore->contains( page ) )
+    {
+        const bool wasDirty = m_dirtyDocDataPages.contains( page );
+        const bool wasBoundingBoxKnown = kp->isBoundingBoxKnown();
+        // be quiet while restoring the local annotations, as at opening time
+        const bool showWarningLimitedAnnotSupport = m_showWarningLimitedAnnotSupport;
+        m_showWarningLimitedAnnotSupport = false;
+        kp->d->restoreLocalContents( m_docDataStore->pageContents( page ) );
+        m_showWarningLimitedAnnotSupport = showWarningLimitedAnnotSupport;
+        if ( !wasDirty )
+            m_dirtyDocDataPages.remove( page );
+
+        if ( notify && !wasBoundingBoxKnown && kp->isBoundingBoxKnown() )
+            foreachObserverD( notifyPageChanged( page, DocumentObserver::BoundingBox ) );
+        // the page may be shown already, if it was loaded later
+        if ( notify && !kp->annotations().isEmpty() )
+            notifyAnnotationChanges( page );
+    }
+}
+
+void DocumentPrivate::loadAllPageData()
+{
+    for ( int i = 0; i < m_pagesVector.count(); ++i )
+        loadPageData( i );
+}
+
+void DocumentPrivate::loadPendingPageData()
+{
+    const QList< int > pages = m_pendingPageData.toList();
+    foreach ( int page, pages )
+        loadPageData( page, true, false );
+}
+
 void DocumentPrivate::slotTimedMemoryCheck()
 {
     // [MEM] clean memory (for 'free mem dependant' profiles only)
@@ -1267,6 +1417,9 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
 
     // find a request
     PixmapRequest * request = 0;
+    // the requests whose pixmaps are scaled from others, once unlocked
+    QLinkedList< QPair< PixmapRequest *, DerivationSource > > derivedRequests;
+    DerivationSource derivationSource;
     m_pixmapRequestsMutex.lock();
     while ( !m_pixmapRequestsStack.isEmpty() && !request )
     {
@@ -1385,6 +1538,12 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
             }
             delete r;
         }
+        // If another observer has a larger pixmap of the page, scale it down
+        else if ( !r->d->mForce && !tilesManager && (long)r->width() * (long)r->height() <= OKULAR_DERIVED_PIXMAP_MAX_AREA && findDerivationSource( r, &derivationSource ) )
+        {
+            m_pixmapRequestsStack.pop_back();
+            derivedRequests.append( qMakePair( r, derivationSource ) );
+        }
         else
         {
             request = r;
@@ -1395,6 +1554,13 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
     if ( !request )
     {
         m_pixmapRequestsMutex.unlock();
+        while ( !derivedRequests.isEmpty() )
+        {
+            const QPair< PixmapRequest *, DerivationSource > derived = derivedRequests.takeFirst();
+            derivePixmap( derived.first, derived.second );
+            pixmapRequestFinished( derived.first );
+            delete derived.first;
+        }
         return;
     }
 
@@ -1429,6 +1595,13 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
         // we always have to unlock _before_ the generatePixmap() because
         // a sync generation would end with requestDone() -> deadlock, and
         // we can not really know if the generator can do async requests
+        request->d->mGenerationStart = request->d->mTimer.elapsed();
+        if ( Tracer::isEnabled() )
+        {
+            QVariantMap args;
+            args.insert( QStringLiteral( "pending" ), m_pixmapRequestsStack.count() );
+            Tracer::asyncStep( "pixmap", "dequeued", (quintptr)request, args );
+        }
         m_executingPixmapRequests.push_back( request );
         m_pixmapRequestsMutex.unlock();
         m_generator->generatePixmap( request );
@@ -1439,6 +1612,106 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
         // pino (7/4/2006): set the polling interval from 10 to 30
         QTimer::singleShot( 30, m_parent, SLOT(sendGeneratorPixmapRequest()) );
     }
+
+    // the pixmaps are scaled while the generator renders, and the observers
+    // are notified once it has its request, as they may ask for more pixmaps
+    while ( !derivedRequests.isEmpty() )
+    {
+        const QPair< PixmapRequest *, DerivationSource > derived = derivedRequests.takeFirst();
+        derivePixmap( derived.first, derived.second );
+        pixmapRequestFinished( derived.first );
+        delete derived.first;
+    }
+}
+
+bool DocumentPrivate::findDerivationSource( PixmapRequest * request, DerivationSource * source ) const
+{
+    Page *page = request->page();
+    const int width = request->width();
+    const int height = request->height();
+    request->d->mGenerationStart = request->d->mTimer.elapsed();
+
+    // the smallest pixmap of another observer that is at least as large
+    const QPixmap *sourcePixmap = 0;
+    QMap< DocumentObserver*, PagePrivate::PixmapObject >::const_iterator pIt = page->d->m_pixmaps.constBegin(), pEnd = page->d->m_pixmaps.constEnd();
+    for ( ; pIt != pEnd; ++pIt )
+    {
+        const QPixmap *pixmap = pIt.value().m_pixmap;
+        // skip the pixmaps that are still to be rotated, or of another ratio
+        if ( pIt.key() == request->observer() || pIt.value().m_rotation != page->rotation() )
+            continue;
+        if ( pixmap->width() < width || pixmap->height() < height || qAbs( (qint64)pixmap->height() * width / pixmap->width() - height ) > 1 )
+            continue;
+        if ( !sourcePixmap || pixmap->width() < sourcePixmap->width() )
+            sourcePixmap = pixmap;
+    }
+
+    source->tiles.clear();
+    if ( sourcePixmap )
+    {
+        source->pixmap = *sourcePixmap;
+        return true;
+    }
+    source->pixmap = QPixmap();
+
+    // or the tiles of another observer, when they cover the whole page
+    const NormalizedRect wholePage( 0, 0, 1, 1 );
+    QMap< const DocumentObserver*, TilesManager * >::const_iterator tIt = page->d->m_tilesManagers.constBegin(), tEnd = page->d->m_tilesManagers.constEnd();
+    for ( ; tIt != tEnd; ++tIt )
+    {
+        TilesManager *tm = tIt.value();
+        if ( tIt.key() == request->observer() || tm->width() < width || tm->height() < height || !tm->hasPixmap( wholePage ) )
+            continue;
+
+        const QList<Tile> tiles = page->tilesAt( tIt.key(), wholePage );
+        foreach ( const Tile &tile, tiles )
+        {
+            if ( tile.pixmap() )
+                source->tiles.append( qMakePair( tile.rect(), *tile.pixmap() ) );
+        }
+        return true;
+    }
+    return false;
+}
+
+void DocumentPrivate::derivePixmap( PixmapRequest * request, const DerivationSource & source )
+{
+    Page *page = request->page();
+    const int width = request->width();
+    const int height = request->height();
+
+    QPixmap *pixmap = 0;
+    if ( !source.pixmap.isNull() )
+    {
+        pixmap = new QPixmap( source.pixmap.scaled( width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ) );
+    }
+    else
+    {
+        QImage image( width, height, QImage::Format_ARGB32_Premultiplied );
+        image.fill( Qt::white );
+        QPainter p( &image );
+        QList< QPair< NormalizedRect, QPixmap > >::const_iterator tIt = source.tiles.constBegin(), tEnd = source.tiles.constEnd();
+        for ( ; tIt != tEnd; ++tIt )
+        {
+            const QRect rect = (*tIt).first.geometry( width, height );
+            if ( !rect.isEmpty() )
+                p.drawPixmap( rect.topLeft(), (*tIt).second.scaled( rect.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation ) );
+        }
+        p.end();
+        pixmap = new QPixmap( QPixmap::fromImage( image ) );
+    }
+
+    // the pixmap is already rotated as the page is
+    QMap< DocumentObserver*, PagePrivate::PixmapObject >::iterator it = page->d->m_pixmaps.find( request->observer() );
+    if ( it != page->d->m_pixmaps.end() )
+        delete it.value().m_pixmap;
+    else
+        it = page->d->m_pixmaps.insert( request->observer(), PagePrivate::PixmapObject() );
+    it.value().m_pixmap = pixmap;
+    it.value().m_rotation = page->rotation();
+
+    if ( Tracer::isEnabled() )
+        Tracer::asyncStep( "pixmap", "derived", (quintptr)request );
 }
 
 void DocumentPrivate::rotationFinished( int page, Okular::Page *okularPage )
@@ -1580,6 +1853,9 @@ void DocumentPrivate::_o_configChanged()
         int pageToKick = m_allocatedTextPagesFifo.takeFirst();
         m_pagesVector.at(pageToKick)->setTextPage( 0 ); // deletes the textpage
     }
+
+    // drop the oldest undo steps if needed
+    calculateUndoMemoryBudget();
 }
 
 void DocumentPrivate::doContinueDirectionMatchSearch(void *doContinueDirectionMatchSearchStruct)
@@ -1624,9 +1900,18 @@ void DocumentPrivate::doContinueDirectionMatchSearch(void *doContinueDirectionMa
     {
         // get page
         Page * page = m_pagesVector[ searchStruct->currentPage ];
-        // request search page if needed
+        // request search page if needed, together with the next ones in
+        // the search direction
         if ( !page->hasTextPage() )
-            m_parent->requestTextPage( page->number() );
+        {
+            // the batch must hold the current page even when only a few
+            // text pages can be kept
+            const int batch = textPagesBatchSize();
+            if ( forward )
+                m_parent->requestTextPages( page->number(), page->number() + batch - 1 );
+            else
+                m_parent->requestTextPages( qMax( page->number() - batch + 1, 0 ), page->number() );
+        }
 
         // if found a match on the current page, end the loop
         searchStruct->match = page->findText( searchStruct->searchID, search->cachedString, forward ? FromTop : FromBottom, search->cachedCaseSensitivity );
@@ -1732,9 +2017,9 @@ void DocumentPrivate::doContinueAllDocumentSearch(void *pagesToNotifySet, void *
         Page *page = m_pagesVector.at(currentPage);
         int pageNumber = page->number(); // redundant? is it == currentPage ?
 
-        // request search page if needed
+        // request search page if needed, together with the next ones
         if ( !page->hasTextPage() )
-            m_parent->requestTextPage( pageNumber );
+            m_parent->requestTextPages( pageNumber, pageNumber + textPagesBatchSize() - 1 );
 
         // loop on a page adding highlights for all found items
         RegularAreaRect * lastMatch = 0;
@@ -1829,9 +2114,9 @@ void DocumentPrivate::doContinueGooglesDocumentSearch(void *pagesToNotifySet, vo
         Page *page = m_pagesVector.at(currentPage);
         int pageNumber = page->number(); // redundant? is it == currentPage ?
 
-        // request search page if needed
+        // request search page if needed, together with the next ones
         if ( !page->hasTextPage() )
-            m_parent->requestTextPage( pageNumber );
+            m_parent->requestTextPages( pageNumber, pageNumber + textPagesBatchSize() - 1 );
 
         // loop on a page adding highlights for all found items
         bool allMatched = wordCount > 0,
@@ -1998,130 +2283,68 @@ bool DocumentPrivate::isNormalizedRectangleFullyVisible( const Okular::Normalize
     return rectFullyVisible;
 }
 
-struct pdfsyncpoint
+void DocumentPrivate::startSyncLoading( const QString & filePath )
 {
-    QString file;
-    qlonglong x;
-    qlonglong y;
-    int row;
-    int column;
-    int page;
-};
+    m_syncLoader = new SyncLoaderThread( filePath );
+    QObject::connect( m_syncLoader.data(), SIGNAL(finished()), m_parent, SLOT(syncLoadingFinished()) );
+    m_syncLoader->startLoading();
+}
 
-void DocumentPrivate::loadSyncFile( const QString & filePath )
+void DocumentPrivate::waitForSyncData()
 {
-    QFile f( filePath + QLatin1String( "sync" ) );
-    if ( !f.open( QIODevice::ReadOnly ) )
+    if ( !m_syncLoader )
         return;
 
-    QTextStream ts( &f );
-    // first row: core name of the pdf output
-    const QString coreName = ts.readLine();
-    // second row: version string, in the form 'Version %u'
-    QString versionstr = ts.readLine();
-    QRegExp versionre( QStringLiteral("Version (\\d+)") );
-    versionre.setCaseSensitivity( Qt::CaseInsensitive );
-    if ( !versionre.exactMatch( versionstr ) )
-        return;
-
-    QHash<int, pdfsyncpoint> points;
-    QStack<QString> fileStack;
-    int currentpage = -1;
-    const QLatin1String texStr( ".tex" );
-    const QChar spaceChar = QChar::fromLatin1( ' ' );
+    QObject::disconnect( m_syncLoader.data(), SIGNAL(finished()), m_parent, SLOT(syncLoadingFinished()) );
+    m_syncLoader->wait();
+    syncLoadingFinished();
+}
 
-    fileStack.push( coreName + texStr );
+void DocumentPrivate::syncLoadingFinished()
+{
+    if ( !m_syncLoader )
+        return;
 
-    const QSizeF dpi = m_generator->dpi();
+    m_synctex_scanner = m_syncLoader->takeSynctexScanner();
+    m_pdfSyncPoints = m_syncLoader->takePdfSyncPoints();
+    m_syncLoader = 0;
 
-    QString line;
-    while ( !ts.atEnd() )
+    // the source references of the pages already shown are needed now, the
+    // other ones when the pages are shown
+    QHash< int, QVector< PdfSyncPoint > >::const_iterator it = m_pdfSyncPoints.constBegin();
+    QList< int > shownPages;
+    for ( ; it != m_pdfSyncPoints.constEnd(); ++it )
     {
-        line = ts.readLine();
-        const QStringList tokens = line.split( spaceChar, QString::SkipEmptyParts );
-        const int tokenSize = tokens.count();
-        if ( tokenSize < 1 )
-            continue;
-        if ( tokens.first() == QLatin1String( "l" ) && tokenSize >= 3 )
-        {
-            int id = tokens.at( 1 ).toInt();
-            QHash<int, pdfsyncpoint>::const_iterator it = points.constFind( id );
-            if ( it == points.constEnd() )
-            {
-                pdfsyncpoint pt;
-                pt.x = 0;
-                pt.y = 0;
-                pt.row = tokens.at( 2 ).toInt();
-                pt.column = 0; // TODO
-                pt.page = -1;
-                pt.file = fileStack.top();
-                points[ id ] = pt;
-            }
-        }
-        else if ( tokens.first() == QLatin1String( "s" ) && tokenSize >= 2 )
-        {
-            currentpage = tokens.at( 1 ).toInt() - 1;
-        }
-        else if ( tokens.first() == QLatin1String( "p*" ) && tokenSize >= 4 )
-        {
-            // TODO
-            qCDebug(OkularCoreDebug) << "PdfSync: 'p*' line ignored";
-        }
-        else if ( tokens.first() == QLatin1String( "p" ) && tokenSize >= 4 )
-        {
-            int id = tokens.at( 1 ).toInt();
-            QHash<int, pdfsyncpoint>::iterator it = points.find( id );
-            if ( it != points.end() )
-            {
-                it->x = tokens.at( 2 ).toInt();
-                it->y = tokens.at( 3 ).toInt();
-                it->page = currentpage;
-            }
-        }
-        else if ( line.startsWith( QLatin1Char( '(' ) ) && tokenSize == 1 )
-        {
-            QString newfile = line;
-            // chop the leading '('
-            newfile.remove( 0, 1 );
-            if ( !newfile.endsWith( texStr ) )
-            {
-                newfile += texStr;
-            }
-            fileStack.push( newfile );
-        }
-        else if ( line == QLatin1String( ")" ) )
-        {
-            if ( !fileStack.isEmpty() )
-            {
-                fileStack.pop();
-            }
-            else
-               qCDebug(OkularCoreDebug) << "PdfSync: going one level down too much";
-        }
-        else
-            qCDebug(OkularCoreDebug).nospace() << "PdfSync: unknown line format: '" << line << "'";
-
+        const Page *kp = m_pagesVector.value( it.key() );
+        if ( kp && ( !kp->d->m_pixmaps.isEmpty() || !kp->d->m_tilesManagers.isEmpty() ) )
+            shownPages << it.key();
     }
+    foreach ( int page, shownPages )
+        loadSourceReferences( page );
+}
 
-    QVector< QLinkedList< Okular::SourceRefObjectRect * > > refRects( m_pagesVector.size() );
-    foreach ( const pdfsyncpoint& pt, points )
-    {
-        // drop pdfsync points not completely valid
-        if ( pt.page < 0 || pt.page >= m_pagesVector.size() )
-            continue;
+void DocumentPrivate::loadSourceReferences( int page )
+{
+    if ( page < 0 || page >= m_pagesVector.size() || !m_pdfSyncPoints.contains( page ) )
+        return;
+
+    const QVector< PdfSyncPoint > points = m_pdfSyncPoints.take( page );
+    const QSizeF dpi = m_generator->dpi();
+    Page *kp = m_pagesVector[ page ];
 
+    QLinkedList< Okular::SourceRefObjectRect * > refRects;
+    foreach ( const PdfSyncPoint& pt, points )
+    {
         // magic numbers for TeX's RSU's (Ridiculously Small Units) conversion to pixels
         Okular::NormalizedPoint p(
-            ( pt.x * dpi.width() ) / ( 72.27 * 65536.0 * m_pagesVector[pt.page]->width() ),
-            ( pt.y * dpi.height() ) / ( 72.27 * 65536.0 * m_pagesVector[pt.page]->height() )
+            ( pt.x * dpi.width() ) / ( 72.27 * 65536.0 * kp->width() ),
+            ( pt.y * dpi.height() ) / ( 72.27 * 65536.0 * kp->height() )
             );
-        QString file = pt.file;
-        Okular::SourceReference * sourceRef = new Okular::SourceReference( file, pt.row, pt.column );
-        refRects[ pt.page ].append( new Okular::SourceRefObjectRect( p, sourceRef ) );
+        Okular::SourceReference * sourceRef = new Okular::SourceReference( pt.file, pt.row, pt.column );
+        refRects.append( new Okular::SourceRefObjectRect( p, sourceRef ) );
     }
-    for ( int i = 0; i < refRects.size(); ++i )
-        if ( !refRects.at(i).isEmpty() )
-            m_pagesVector[i]->setSourceReferences( refRects.at(i) );
+    if ( !refRects.isEmpty() )
+        kp->setSourceReferences( refRects );
 }
 
 Document::Document( QWidget *widget )
@@ -2130,11 +2353,22 @@ Document::Document( QWidget *widget )
     d->m_widget = widget;
     d->m_bookmarkManager = new BookmarkManager( d );
     d->m_viewportIterator = d->m_viewportHistory.insert( d->m_viewportHistory.end(), DocumentViewport() );
-    d->m_undoStack = new QUndoStack(this);
+    d->m_undoStack = new UndoStack(this);
+    d->calculateUndoMemoryBudget();
 
     connect( SettingsCore::self(), SIGNAL(configChanged()), this, SLOT(_o_configChanged()) );
-    connect(d->m_undoStack, &QUndoStack::canUndoChanged, this, &Document::canUndoChanged);
-    connect(d->m_undoStack, &QUndoStack::canRedoChanged, this, &Document::canRedoChanged);
+    connect(d->m_undoStack, &UndoStack::canUndoChanged, this, &Document::canUndoChanged);
+    connect(d->m_undoStack, &UndoStack::canRedoChanged, this, &Document::canRedoChanged);
+
+    // the searches end in many places, but they all emit searchFinished()
+    if ( Tracer::isEnabled() )
+    {
+        connect( this, &Document::searchFinished, this, [] ( int searchID, Document::SearchStatus endStatus ) {
+            QVariantMap args;
+            args.insert( QStringLiteral( "status" ), (int)endStatus );
+            Tracer::asyncEnd( "search", "Search", searchID, args );
+        } );
+    }
 
     qRegisterMetaType<Okular::FontInfo>();
 }
@@ -2164,6 +2398,14 @@ Document::~Document()
     delete d;
 }
 
+QString DocumentPrivate::docDataStoreFileName(const QString &xmlFileName)
+{
+    QString fileName = xmlFileName;
+    if ( fileName.endsWith( QLatin1String( ".xml" ) ) )
+        fileName.chop( 4 );
+    return fileName + QStringLiteral( ".pages" );
+}
+
 QString DocumentPrivate::docDataFileName(const QUrl &url, qint64 document_size)
 {
 
@@ -2408,13 +2650,9 @@ Document::OpenResult Document::openDocument(const QString & docFile, const QUrl
         return openResult;
     }
 
-    // no need to check for the existence of a synctex file, no parser will be
-    // created if none exists
-    d->m_synctex_scanner = synctex_scanner_new_with_output_file( QFile::encodeName( docFile ).constData(), 0, 1);
-    if ( !d->m_synctex_scanner && QFile::exists(docFile + QLatin1String( "sync" ) ) )
-    {
-        d->loadSyncFile(docFile);
-    }
+    // the sync data can be big, and it is only needed for the pages that
+    // are shown: read it in the background
+    d->startSyncLoading( docFile );
 
     d->m_generatorName = offer.pluginId();
     d->m_pageController = new PageController();
@@ -2432,6 +2670,8 @@ Document::OpenResult Document::openDocument(const QString & docFile, const QUrl
     // Be quiet while restoring local annotations
     d->m_showWarningLimitedAnnotSupport = false;
     d->m_annotationsNeedSaveAs = false;
+    // (restoring local annotations loads the lazy data of their pages, that
+    // may set m_annotationsNeedSaveAs)
 
     // 2. load Additional Data (bookmarks, local annotations and metadata) about the document
     if ( d->m_archiveData )
@@ -2442,7 +2682,7 @@ Document::OpenResult Document::openDocument(const QString & docFile, const QUrl
     else
     {
         d->loadDocumentInfo();
-        d->m_annotationsNeedSaveAs = ( d->canAddAnnotationsNatively() && containsExternalAnnotations );
+        d->m_annotationsNeedSaveAs = d->m_annotationsNeedSaveAs || ( d->canAddAnnotationsNatively() && containsExternalAnnotations );
     }
 
     d->m_showWarningLimitedAnnotSupport = true;
@@ -2570,6 +2810,15 @@ void Document::closeDocument()
         d->m_generator->closeDocument();
     }
 
+    if ( d->m_syncLoader )
+    {
+        // the thread frees what it read when it finishes
+        disconnect( d->m_syncLoader.data(), 0, this, 0 );
+        d->m_syncLoader->stopLoading();
+        d->m_syncLoader = 0;
+    }
+    d->m_pdfSyncPoints.clear();
+
     if ( d->m_synctex_scanner )
     {
         synctex_scanner_free( d->m_synctex_scanner );
@@ -2581,6 +2830,13 @@ void Document::closeDocument()
         d->m_memCheckTimer->stop();
     if ( d->m_saveBookmarksTimer )
         d->m_saveBookmarksTimer->stop();
+    if ( d->m_pageDataTimer )
+        d->m_pageDataTimer->stop();
+    d->m_pendingPageData.clear();
+
+    delete d->m_docDataStore;
+    d->m_docDataStore = 0;
+    d->m_dirtyDocDataPages.clear();
 
     if ( d->m_generator )
     {
@@ -2646,6 +2902,9 @@ void Document::closeDocument()
     d->m_viewportIterator = d->m_viewportHistory.begin();
     d->m_allocatedPixmapsTotalMemory = 0;
     d->m_allocatedTextPagesFifo.clear();
+    d->m_completedPixmapRequests = 0;
+    d->m_pageRenderLatency.clear();
+    d->m_pageGenerationTime.clear();
     d->m_pageSize = PageSize();
     d->m_pageSizes.clear();
 
@@ -2957,6 +3216,7 @@ bool Document::exportToText( const QString& fileName ) const
     if ( d->m_exportToText.isNull() )
         return false;
 
+    d->m_generator->d_func()->m_exportCancelled.store( 0 );
     return d->m_generator->exportTo( fileName, d->m_exportToText );
 }
 
@@ -2971,7 +3231,11 @@ ExportFormat::List Document::exportFormats() const
 
 bool Document::exportTo( const QString& fileName, const ExportFormat& format ) const
 {
-    return d->m_generator ? d->m_generator->exportTo( fileName, format ) : false;
+    if ( !d->m_generator )
+        return false;
+
+    d->m_generator->d_func()->m_exportCancelled.store( 0 );
+    return d->m_generator->exportTo( fileName, format );
 }
 
 bool Document::historyAtBegin() const
@@ -2988,6 +3252,9 @@ QVariant Document::metaData( const QString & key, const QVariant & option ) cons
 {
     // if option starts with "src:" assume that we are handling a
     // source reference
+    if ( key == QLatin1String("NamedViewport") && option.toString().startsWith( QLatin1String("src:"), Qt::CaseInsensitive ) )
+        d->waitForSyncData();
+
     if ( key == QLatin1String("NamedViewport")
          && option.toString().startsWith( QLatin1String("src:"), Qt::CaseInsensitive )
          && d->m_synctex_scanner)
@@ -3116,6 +3383,13 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
         for ( ; rIt != rEnd; ++rIt )
             requestedPages.insert( (*rIt)->pageNumber() );
     }
+    // the pages are going to be shown, so their annotations and source
+    // references are needed now
+    foreach ( int page, requestedPages )
+    {
+        d->loadPageData( page, true, false );
+        d->loadSourceReferences( page );
+    }
     const bool removeAllPrevious = reqOptions & RemoveAllPrevious;
     d->m_pixmapRequestsMutex.lock();
     QLinkedList< PixmapRequest * >::iterator sIt = d->m_pixmapRequestsStack.begin(), sEnd = d->m_pixmapRequestsStack.end();
@@ -3175,6 +3449,14 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
         if ( !request->asynchronous() )
             request->d->mPriority = 0;
 
+        if ( Tracer::isEnabled() )
+        {
+            QVariantMap args;
+            args.insert( QStringLiteral( "tile" ), request->isTile() );
+            args.insert( QStringLiteral( "priority" ), request->priority() );
+            Tracer::asyncStep( "pixmap", "queued", (quintptr)request, args );
+        }
+
         // add request to the 'stack' at the right place
         if ( !request->priority() )
             // add priority zero requests to the top of the stack
@@ -3210,6 +3492,58 @@ void Document::requestTextPage( uint page )
     d->m_generator->generateTextPage( kp );
 }
 
+void Document::requestTextPages( uint first, uint last )
+{
+    if ( !d->m_generator || first >= (uint)d->m_pagesVector.count() )
+        return;
+
+    // never request more text pages than the ones that can be kept, or the
+    // first ones of the batch would be thrown away by the last ones
+    last = qMin( last, (uint)d->m_pagesVector.count() - 1 );
+    last = qMin( last, first + qMax( d->m_maxAllocatedTextPages, 1 ) - 1 );
+
+    QVector< Page * > pages;
+    for ( uint i = first; i <= last; ++i )
+    {
+        Page * kp = d->m_pagesVector[ i ];
+        if ( !kp->hasTextPage() )
+            pages.append( kp );
+    }
+
+    if ( pages.count() == 1 )
+        d->m_generator->generateTextPage( pages.first() );
+    else if ( !pages.isEmpty() )
+        d->m_generator->generateTextPages( pages );
+}
+
+RenderStatistics Document::renderStatistics() const
+{
+    RenderStatistics stats;
+
+    d->m_pixmapRequestsMutex.lock();
+    stats.pendingPixmapRequests = d->m_pixmapRequestsStack.count();
+    stats.executingPixmapRequests = d->m_executingPixmapRequests.count();
+    d->m_pixmapRequestsMutex.unlock();
+
+    stats.completedPixmapRequests = d->m_completedPixmapRequests;
+    stats.allocatedPixmaps = d->m_allocatedPixmaps.count();
+    stats.allocatedPixmapsMemory = d->m_allocatedPixmapsTotalMemory;
+
+    foreach ( int page, d->m_allocatedTextPagesFifo )
+    {
+        const Page *kp = d->m_pagesVector.value( page );
+        if ( !kp || !kp->hasTextPage() )
+            continue;
+
+        ++stats.allocatedTextPages;
+        stats.allocatedTextPagesMemory += kp->d->textPageMemoryCost();
+    }
+
+    stats.pageRenderLatency = d->m_pageRenderLatency;
+    stats.pageGenerationTime = d->m_pageGenerationTime;
+    return stats;
+}
+
 void DocumentPrivate::notifyAnnotationChanges( int page )
 {
     int flags = DocumentObserver::Annotations;
@@ -3226,7 +3560,7 @@ void Document::addPageAnnotation( int page, Annotation * annotation )
     Page *p = d->m_pagesVector[page];
     QTransform t = p->d->rotationMatrix();
     annotation->d_ptr->baseTransform(t.inverted());
-    QUndoCommand *uc = new AddAnnotationCommand(this->d, annotation, page);
+    UndoCommand *uc = new AddAnnotationCommand(this->d, annotation, page);
     d->m_undoStack->push(uc);
 }
 
@@ -3275,7 +3609,7 @@ void Document::modifyPageAnnotationProperties( int page, Annotation * annotation
         return;
     }
     QDomNode prevProps = d->m_prevPropsOfAnnotBeingModified;
-    QUndoCommand *uc = new Okular::ModifyAnnotationPropertiesCommand( d,
+    UndoCommand *uc = new Okular::ModifyAnnotationPropertiesCommand( d,
                                                                       annotation,
                                                                       page,
                                                                       prevProps,
@@ -3287,14 +3621,14 @@ void Document::modifyPageAnnotationProperties( int page, Annotation * annotation
 void Document::translatePageAnnotation(int page, Annotation* annotation, const NormalizedPoint & delta )
 {
     int complete = (annotation->flags() & Okular::Annotation::BeingMoved) == 0;
-    QUndoCommand *uc = new Okular::TranslateAnnotationCommand( d, annotation, page, delta, complete );
+    UndoCommand *uc = new Okular::TranslateAnnotationCommand( d, annotation, page, delta, complete );
     d->m_undoStack->push(uc);
 }
 
 void Document::adjustPageAnnotation( int page, Annotation *annotation, const Okular::NormalizedPoint & delta1, const Okular::NormalizedPoint & delta2 )
 {
     const bool complete = (annotation->flags() & Okular::Annotation::BeingResized) == 0;
-    QUndoCommand *uc = new Okular::AdjustAnnotationCommand( d, annotation, page, delta1, delta2, complete );
+    UndoCommand *uc = new Okular::AdjustAnnotationCommand( d, annotation, page, delta1, delta2, complete );
     d->m_undoStack->push(uc);
 }
 
@@ -3306,7 +3640,7 @@ void Document::editPageAnnotationContents( int page, Annotation* annotation,
                                          )
 {
     QString prevContents = annotation->contents();
-    QUndoCommand *uc = new EditAnnotationContentsCommand( d, annotation, page, newContents, newCursorPos,
+    UndoCommand *uc = new EditAnnotationContentsCommand( d, annotation, page, newContents, newCursorPos,
                                                             prevContents, prevCursorPos, prevAnchorPos );
     d->m_undoStack->push( uc );
 }
@@ -3336,7 +3670,7 @@ bool Document::canRemovePageAnnotation( const Annotation * annotation ) const
 
 void Document::removePageAnnotation( int page, Annotation * annotation )
 {
-    QUndoCommand *uc = new RemoveAnnotationCommand(this->d, annotation, page);
+    UndoCommand *uc = new RemoveAnnotationCommand(this->d, annotation, page);
     d->m_undoStack->push(uc);
 }
 
@@ -3345,7 +3679,7 @@ void Document::removePageAnnotations( int page, const QList<Annotation*> &annota
     d->m_undoStack->beginMacro(i18nc("remove a collection of annotations from the page", "remove annotations"));
     foreach(Annotation* annotation, annotations)
     {
-        QUndoCommand *uc = new RemoveAnnotationCommand(this->d, annotation, page);
+        UndoCommand *uc = new RemoveAnnotationCommand(this->d, annotation, page);
         d->m_undoStack->push(uc);
     }
     d->m_undoStack->endMacro();
@@ -3450,6 +3784,9 @@ void Document::setViewport( const DocumentViewport & viewport, DocumentObserver
         return;
     }
 
+    // observers may need the actions and the transition of the new page
+    d->loadPageData( viewport.pageNumber, true, false );
+
     // if already broadcasted, don't redo it
     DocumentViewport & oldViewport = *d->m_viewportIterator;
     // disabled by enrico on 2005-03-18 (less debug output)
@@ -3551,6 +3888,15 @@ void Document::searchText( int searchID, const QString & text, bool fromStart, Q
 {
     d->m_searchCancelled = false;
 
+    if ( Tracer::isEnabled() )
+    {
+        QVariantMap args;
+        args.insert( QStringLiteral( "text" ), text );
+        args.insert( QStringLiteral( "type" ), (int)type );
+        args.insert( QStringLiteral( "fromStart" ), fromStart );
+        Tracer::asyncBegin( "search", "Search", searchID, args );
+    }
+
     // safety checks: don't perform searches on empty or unsearchable docs
     if ( !d->m_generator || !d->m_generator->hasFeature( Generator::TextExtraction ) || d->m_pagesVector.isEmpty() )
     {
@@ -3714,6 +4060,12 @@ void Document::cancelSearch()
     d->m_searchCancelled = true;
 }
 
+void Document::cancelExport()
+{
+    if ( d->m_generator )
+        d->m_generator->cancelExport();
+}
+
 void Document::undo()
 {
     d->m_undoStack->undo();
@@ -3731,7 +4083,7 @@ void Document::editFormText( int pageNumber,
                              int prevCursorPos,
                              int prevAnchorPos )
 {
-    QUndoCommand *uc = new EditFormTextCommand( this->d, form, pageNumber, newContents, newCursorPos, form->text(), prevCursorPos, prevAnchorPos );
+    UndoCommand *uc = new EditFormTextCommand( this->d, form, pageNumber, newContents, newCursorPos, form->text(), prevCursorPos, prevAnchorPos );
     d->m_undoStack->push( uc );
 
     d->recalculateForms();
@@ -3742,7 +4094,7 @@ void Document::editFormList( int pageNumber,
                              const QList< int > & newChoices )
 {
     const QList< int > prevChoices = form->currentChoices();
-    QUndoCommand *uc = new EditFormListCommand( this->d, form, pageNumber, newChoices, prevChoices );
+    UndoCommand *uc = new EditFormListCommand( this->d, form, pageNumber, newChoices, prevChoices );
     d->m_undoStack->push( uc );
 
     d->recalculateForms();
@@ -3766,7 +4118,7 @@ void Document::editFormCombo( int pageNumber,
         prevText = form->choices()[form->currentChoices().constFirst()];
     }
 
-    QUndoCommand *uc = new EditFormComboCommand( this->d, form, pageNumber, newText, newCursorPos, prevText, prevCursorPos, prevAnchorPos );
+    UndoCommand *uc = new EditFormComboCommand( this->d, form, pageNumber, newText, newCursorPos, prevText, prevCursorPos, prevAnchorPos );
     d->m_undoStack->push( uc );
 
     d->recalculateForms();
@@ -3774,7 +4126,7 @@ void Document::editFormCombo( int pageNumber,
 
 void Document::editFormButtons( int pageNumber, const QList< FormFieldButton* >& formButtons, const QList< bool >& newButtonStates )
 {
-    QUndoCommand *uc = new EditFormButtonsCommand( this->d, pageNumber, formButtons, newButtonStates );
+    UndoCommand *uc = new EditFormButtonsCommand( this->d, pageNumber, formButtons, newButtonStates );
     d->m_undoStack->push( uc );
 }
 
@@ -4121,6 +4473,7 @@ void Document::processSourceReference( const SourceReference * ref )
 
 const SourceReference * Document::dynamicSourceReference( int pageNr, double absX, double absY )
 {
+    d->waitForSyncData();
     if  ( !d->m_synctex_scanner )
         return 0;
 
@@ -4176,7 +4529,13 @@ bool Document::supportsPrintToFile() const
 
 bool Document::print( QPrinter &printer )
 {
-    return d->m_generator ? d->m_generator->print( printer ) : false;
+    if ( !d->m_generator )
+        return false;
+
+    // the annotations are printed too
+    d->loadAllPageData();
+
+    return d->m_generator->print( printer );
 }
 
 QString Document::printError() const
@@ -4369,6 +4728,9 @@ bool Document::saveChanges( const QString &fileName, QString *errorText )
     if ( !saveIface || !saveIface->supportsOption( SaveInterface::SaveChanges ) )
         return false;
 
+    // all the annotations must be in the saved file
+    d->loadAllPageData();
+
     return saveIface->save( fileName, SaveInterface::SaveChanges, errorText );
 }
 
@@ -4520,6 +4882,9 @@ bool Document::saveDocumentArchive( const QString &fileName )
     if ( docFileName == QLatin1String( "-" ) )
         return false;
 
+    // all the annotations must be in the archive
+    d->loadAllPageData();
+
     QString docPath = d->m_docFileName;
     const QFileInfo fi( docPath );
     if ( fi.isSymLink() )
@@ -4660,6 +5025,24 @@ void DocumentPrivate::requestDone( PixmapRequest * req )
         qCDebug(OkularCoreDebug) << "requestDone with generator not in READY state.";
 #endif
 
+    pixmapRequestFinished( req );
+
+    // 3. delete request
+    m_pixmapRequestsMutex.lock();
+    m_executingPixmapRequests.removeAll( req );
+    m_pixmapRequestsMutex.unlock();
+    delete req;
+
+    // 4. start a new generation if some is pending
+    m_pixmapRequestsMutex.lock();
+    bool hasPixmaps = !m_pixmapRequestsStack.isEmpty();
+    m_pixmapRequestsMutex.unlock();
+    if ( hasPixmaps )
+        sendGeneratorPixmapRequest();
+}
+
+void DocumentPrivate::pixmapRequestFinished( PixmapRequest * req )
+{
     // [MEM] 1.1 find and remove a previous entry for the same page and id
     QLinkedList< AllocatedPixmap * >::iterator aIt = m_allocatedPixmaps.begin();
     QLinkedList< AllocatedPixmap * >::iterator aEnd = m_allocatedPixmaps.end();
@@ -4688,6 +5071,19 @@ void DocumentPrivate::requestDone( PixmapRequest * req )
         m_allocatedPixmaps.append( memoryPage );
         m_allocatedPixmapsTotalMemory += memoryBytes;
 
+        if ( Tracer::isEnabled() )
+            Tracer::asyncStep( "pixmap", "finished", (quintptr)req );
+
+        // [STATS] remember how long the page took
+        const qint64 latency = req->d->mTimer.elapsed();
+        ++m_completedPixmapRequests;
+        m_pageRenderLatency.insert( req->pageNumber(), (int)latency );
+        m_pageGenerationTime.insert( req->pageNumber(), (int)( latency - req->d->mGenerationStart ) );
+
+        // the pdfsync data may have been read while the page was rendered,
+        // and the page would not be requested again
+        loadSourceReferences( req->pageNumber() );
+
         // 2. notify an observer that its pixmap changed
         observer->notifyPageChanged( req->pageNumber(), DocumentObserver::Pixmap );
     }
@@ -4695,19 +5091,6 @@ void DocumentPrivate::requestDone( PixmapRequest * req )
     else
         qCWarning(OkularCoreDebug) << "Receiving a done request for the defunct observer" << observer;
 #endif
-
-    // 3. delete request
-    m_pixmapRequestsMutex.lock();
-    m_executingPixmapRequests.removeAll( req );
-    m_pixmapRequestsMutex.unlock();
-    delete req;
-
-    // 4. start a new generation if some is pending
-    m_pixmapRequestsMutex.lock();
-    bool hasPixmaps = !m_pixmapRequestsStack.isEmpty();
-    m_pixmapRequestsMutex.unlock();
-    if ( hasPixmaps )
-        sendGeneratorPixmapRequest();
 }
 
 void DocumentPrivate::setPageBoundingBox( int page, const NormalizedRect& boundingBox )
@@ -4719,6 +5102,7 @@ void DocumentPrivate::setPageBoundingBox( int page, const NormalizedRect& boundi
     if ( kp->boundingBox() == boundingBox )
         return;
     kp->setBoundingBox( boundingBox );
+    m_dirtyDocDataPages.insert( page );
 
     // notify observers about the change
     foreachObserverD( notifyPageChanged( page, DocumentObserver::BoundingBox ) );
@@ -4753,6 +5137,37 @@ void DocumentPrivate::calculateMaxTextPages()
     }
 }
 
+int DocumentPrivate::textPagesBatchSize() const
+{
+    return qBound( 1, m_maxAllocatedTextPages, OKULAR_TEXTPAGES_BATCH );
+}
+
+void DocumentPrivate::calculateUndoMemoryBudget()
+{
+    // [MEM] the undo history can keep removed annotations, their previous
+    // properties and text edits alive: bound it like the other caches
+    qint64 budget = 0;
+    switch (SettingsCore::memoryLevel())
+    {
+        case SettingsCore::EnumMemoryLevel::Low:
+            budget = 4 * 1024 * 1024;
+        break;
+
+        case SettingsCore::EnumMemoryLevel::Normal:
+            budget = 16 * 1024 * 1024;
+        break;
+
+        case SettingsCore::EnumMemoryLevel::Aggressive:
+            budget = 64 * 1024 * 1024;
+        break;
+
+        case SettingsCore::EnumMemoryLevel::Greedy:
+            budget = 256 * 1024 * 1024;
+        break;
+    }
+    m_undoStack->setMemoryBudget( budget );
+}
+
 void DocumentPrivate::textGenerationDone( Page *page )
 {
     if ( !m_pageController ) return;
@@ -5187,6 +5602,13 @@ VisiblePageRect::VisiblePageRect( int page, const NormalizedRect &rectangle )
 {
 }
 
+RenderStatistics::RenderStatistics()
+    : pendingPixmapRequests( 0 ), executingPixmapRequests( 0 ), completedPixmapRequests( 0 ),
+      allocatedPixmaps( 0 ), allocatedPixmapsMemory( 0 ),
+      allocatedTextPages( 0 ), allocatedTextPagesMemory( 0 )
+{
+}
+
 #undef foreachObserver
 #undef foreachObserverD
 
@@ -16,6 +16,7 @@
 #include "global.h"
 #include "pagesize.h"
 
+#include <QtCore/QMap>
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
 #include <QtCore/QVector>
@@ -53,6 +54,7 @@ class Action;
 class MovieAction;
 class Page;
 class PixmapRequest;
+class RenderStatistics;
 class RenditionAction;
 class SourceReference;
 class View;
@@ -489,6 +491,24 @@ class OKULARCORE_EXPORT Document : public QObject
          */
         void requestTextPage( uint number );
 
+        /**
+         * Sends a single request for text page generation for the pages
+         * from @p first to @p last (included) that do not have one yet.
+         * If the range holds more pages than the memory level allows to
+         * keep, the pages at its end are left out.
+         *
+         * @since 1.2
+         */
+        void requestTextPages( uint first, uint last );
+
+        /**
+         * Returns the current state of the pixmap generation and of the
+         * memory taken by the pixmaps and the text pages, for diagnostics.
+         *
+         * @since 1.2
+         */
+        RenderStatistics renderStatistics() const;
+
         /**
          * Adds a new @p annotation to the given @p page.
          */
@@ -881,6 +901,13 @@ class OKULARCORE_EXPORT Document : public QObject
          */
         void cancelSearch();
 
+        /**
+         * Cancels the export in progress, if any.
+         *
+         * @since 1.2
+         */
+        void cancelExport();
+
         /**
          * Undo last edit command
          * @since 0.17 (KDE 4.11)
@@ -1031,6 +1058,14 @@ class OKULARCORE_EXPORT Document : public QObject
          */
         void fontReadingEnded();
 
+        /**
+         * Reports the progress of an export: @p done pages out of @p total
+         * have been exported so far.
+         *
+         * @since 1.2
+         */
+        void exportProgress( int done, int total );
+
         /**
          * Reports that the current search finished
          */
@@ -1126,8 +1161,10 @@ class OKULARCORE_EXPORT Document : public QObject
 
         Q_DISABLE_COPY( Document )
 
-        Q_PRIVATE_SLOT( d, void saveDocumentInfo() const )
+        Q_PRIVATE_SLOT( d, void saveDocumentInfo() )
         Q_PRIVATE_SLOT( d, void slotTimedMemoryCheck() )
+        Q_PRIVATE_SLOT( d, void loadPendingPageData() )
+        Q_PRIVATE_SLOT( d, void syncLoadingFinished() )
         Q_PRIVATE_SLOT( d, void sendGeneratorPixmapRequest() )
         Q_PRIVATE_SLOT( d, void rotationFinished( int page, Okular::Page *okularPage ) )
         Q_PRIVATE_SLOT( d, void slotFontReadingProgress( int page ) )
@@ -1332,6 +1369,61 @@ class OKULARCORE_EXPORT VisiblePageRect
         NormalizedRect rect;
 };
 
+/**
+ * @short The state of the pixmap generation of a Document
+ *
+ * @see Document::renderStatistics()
+ * @since 1.2
+ */
+class OKULARCORE_EXPORT RenderStatistics
+{
+    public:
+        /**
+         * Creates empty render statistics.
+         */
+        RenderStatistics();
+
+        /**
+         * The number of pixmap requests waiting to be generated.
+         */
+        int pendingPixmapRequests;
+
+        /**
+         * The number of pixmap requests being generated.
+         */
+        int executingPixmapRequests;
+
+        /**
+         * The number of pixmap requests generated since the document was opened.
+         */
+        int completedPixmapRequests;
+
+        /**
+         * The number of pixmaps allocated for the observers, and the bytes they take.
+         */
+        int allocatedPixmaps;
+        qulonglong allocatedPixmapsMemory;
+
+        /**
+         * The number of text pages kept in memory, and the bytes they take.
+         */
+        int allocatedTextPages;
+        qulonglong allocatedTextPagesMemory;
+
+        /**
+         * For each page number, the time in milliseconds between the
+         * request of the last pixmap generated for the page and the end of
+         * its generation.
+         */
+        QMap< int, int > pageRenderLatency;
+
+        /**
+         * For each page number, the time in milliseconds the generator took
+         * to generate the last pixmap of the page.
+         */
+        QMap< int, int > pageGenerationTime;
+};
+
 }
 
 Q_DECLARE_METATYPE( Okular::DocumentInfo::Key )
@@ -21,18 +21,20 @@
 #include <QtCore/QMap>
 #include <QtCore/QMutex>
 #include <QtCore/QPointer>
+#include <QtGui/QPixmap>
 #include <QUrl>
 #include <KPluginMetaData>
 
 // local includes
 #include "fontinfo.h"
 #include "generator.h"
+#include "syncloader_p.h"
 
-class QUndoStack;
 class QEventLoop;
 class QFile;
 class QTimer;
 class QTemporaryFile;
+class QXmlStreamReader;
 class KPluginMetaData;
 
 struct AllocatedPixmap;
@@ -41,9 +43,11 @@ struct RunningSearch;
 
 namespace Okular {
 class ConfigInterface;
+class DocDataStore;
 class PageController;
 class SaveInterface;
 class Scripter;
+class UndoStack;
 class View;
 }
 
@@ -66,6 +70,14 @@ namespace Okular {
 
 class FontExtractionThread;
 
+// what the pixmap of a request can be scaled from: the larger pixmap another
+// observer has of the page, or the tiles covering the whole page
+struct DerivationSource
+{
+    QPixmap pixmap;
+    QList< QPair< NormalizedRect, QPixmap > > tiles;
+};
+
 struct DoContinueDirectionMatchSearchStruct
 {
     QSet< int > *pagesToNotify;
@@ -84,11 +96,14 @@ class DocumentPrivate
             m_allocatedPixmapsTotalMemory( 0 ),
             m_maxAllocatedTextPages( 0 ),
             m_warnedOutOfMemory( false ),
+            m_completedPixmapRequests( 0 ),
             m_rotation( Rotation0 ),
             m_exportCached( false ),
             m_bookmarkManager( 0 ),
             m_memCheckTimer( 0 ),
             m_saveBookmarksTimer( 0 ),
+            m_pageDataTimer( 0 ),
+            m_docDataStore( 0 ),
             m_generator( 0 ),
             m_walletGenerator( 0 ),
             m_generatorsLoaded( false ),
@@ -113,11 +128,13 @@ class DocumentPrivate
         void cleanupPixmapMemory( qulonglong memoryToFree );
         AllocatedPixmap * searchLowestPriorityPixmap( bool unloadableOnly = false, bool thenRemoveIt = false, DocumentObserver *observer = 0 /* any */ );
         void calculateMaxTextPages();
+        int textPagesBatchSize() const;
+        void calculateUndoMemoryBudget();
         qulonglong getTotalMemory();
         qulonglong getFreeMemory( qulonglong *freeSwap = 0 );
         void loadDocumentInfo();
         void loadDocumentInfo( QFile &infoFile );
-        void loadViewsInfo( View *view, const QDomElement &e );
+        void loadViewsInfo( View *view, QXmlStreamReader &reader );
         void saveViewsInfo( View *view, QDomElement &e ) const;
         QUrl giveAbsoluteUrl( const QString & fileName ) const;
         bool openRelativeFile( const QString & fileName );
@@ -138,6 +155,11 @@ class DocumentPrivate
         bool canRemoveExternalAnnotations() const;
         void warnLimitedAnnotSupport();
         OKULARCORE_EXPORT static QString docDataFileName(const QUrl &url, qint64 document_size);
+        OKULARCORE_EXPORT static QString docDataStoreFileName(const QString &xmlFileName);
+        // makes getTotalMemory() and getFreeMemory() return the given values
+        // instead of the ones of the system, for the tests; a 0 totalMemory
+        // restores the values of the system
+        OKULARCORE_EXPORT static void setSystemMemoryOverride(qulonglong totalMemory, qulonglong freeMemory, qulonglong freeSwap);
 
         // Methods that implement functionality needed by undo commands
         void performAddPageAnnotation( int page, Annotation *annotation );
@@ -147,9 +169,47 @@ class DocumentPrivate
 
         void recalculateForms();
 
+        /**
+         * Makes sure the generator filled the lazily loaded data (annotations,
+         * transition, actions) of the given @p page, optionally notifying the
+         * observers about the new annotations.
+         *
+         * Unless @p wait is true, it does not wait for the generator while it
+         * renders: the page is then loaded a bit later, and the observers are
+         * notified.
+         */
+        void loadPageData( int page, bool notify = true, bool wait = true );
+
+        /**
+         * Loads the lazily loaded data of all the pages, to be called before
+         * operations that need all of it (e.g. saving the annotations).
+         */
+        void loadAllPageData();
+
+        /**
+         * Finds the larger pixmap (or complete set of tiles) another observer
+         * has of the page of the @p request, so the generator does not have
+         * to render the page again. Returns whether there is one, copied in
+         * @p source; copying is cheap, unlike scaling.
+         */
+        bool findDerivationSource( PixmapRequest * request, DerivationSource * source ) const;
+
+        /**
+         * Gives the pixmap of the @p request by scaling down the @p source.
+         */
+        void derivePixmap( PixmapRequest * request, const DerivationSource & source );
+
+        /**
+         * Accounts the memory of the pixmap of the done @p request, and
+         * notifies its observer.
+         */
+        void pixmapRequestFinished( PixmapRequest * request );
+
         // private slots
-        void saveDocumentInfo() const;
+        void saveDocumentInfo();
         void slotTimedMemoryCheck();
+        void loadPendingPageData();
+        void syncLoadingFinished();
         void sendGeneratorPixmapRequest();
         void rotationFinished( int page, Okular::Page *okularPage );
         void slotFontReadingProgress( int page );
@@ -188,7 +248,21 @@ class DocumentPrivate
         bool isNormalizedRectangleFullyVisible( const Okular::NormalizedRect & rectOfInterest, int rectPage );
 
         // For sync files
-        void loadSyncFile( const QString & filePath );
+        /**
+         * Starts reading the SyncTeX or pdfsync data of the document in
+         * @p filePath, in a thread.
+         */
+        void startSyncLoading( const QString & filePath );
+        /**
+         * Waits for the sync data being read, for the features that need it
+         * right away.
+         */
+        void waitForSyncData();
+        /**
+         * Creates the source references of the given @p page from the
+         * pdfsync data, when it has some that were not created yet.
+         */
+        void loadSourceReferences( int page );
 
         // member variables
         Document *m_parent;
@@ -225,6 +299,11 @@ class DocumentPrivate
         int m_maxAllocatedTextPages;
         bool m_warnedOutOfMemory;
 
+        // pixmap generation statistics, see Document::renderStatistics()
+        int m_completedPixmapRequests;
+        QMap< int, int > m_pageRenderLatency;
+        QMap< int, int > m_pageGenerationTime;
+
         // the rotation applied to the document
         Rotation m_rotation;
 
@@ -245,6 +324,16 @@ class DocumentPrivate
         QTimer *m_memCheckTimer;
         QTimer *m_saveBookmarksTimer;
 
+        // loader of the page data that could not be loaded when first
+        // needed, as the generator was busy
+        QTimer *m_pageDataTimer;
+        QSet< int > m_pendingPageData;
+
+        // the contents of the pages saved in the docdata, and the pages
+        // changed since they were last saved there
+        DocDataStore *m_docDataStore;
+        QSet< int > m_dirtyDocDataPages;
+
         QHash<QString, GeneratorInfo> m_loadedGenerators;
         Generator * m_generator;
         QString m_generatorName;
@@ -277,10 +366,14 @@ class DocumentPrivate
         bool m_annotationBeingModified; // is an annotation currently being moved or resized?
         bool m_showWarningLimitedAnnotSupport;
 
-        QUndoStack *m_undoStack;
+        UndoStack *m_undoStack;
         QDomNode m_prevPropsOfAnnotBeingModified;
 
         synctex_scanner_t m_synctex_scanner;
+        QPointer< SyncLoaderThread > m_syncLoader;
+        // the pdfsync points of the pages whose source references were not
+        // created yet
+        QHash< int, QVector< PdfSyncPoint > > m_pdfSyncPoints;
 
         // generator selection
         static QVector<KPluginMetaData> availableGenerators();
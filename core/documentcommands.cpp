@@ -18,6 +18,8 @@
 
 #include <KLocalizedString>
 
+#include <QtCore/QTextStream>
+
 namespace Okular {
 
 void moveViewportIfBoundingRectNotFullyVisible( Okular::NormalizedRect boundingRect,
@@ -56,6 +58,42 @@ Okular::NormalizedRect buildBoundingRectangleForButtons( const QList<Okular::For
     return boundingRect;
 }
 
+// A rough estimate of the memory taken by an annotation: the object, its
+// texts and the points of its geometry, that are kept both as they are and
+// transformed to the page rotation
+static qint64 annotationMemoryCost( const Annotation *annotation )
+{
+    static const qint64 pointCost = 2 * ( sizeof( NormalizedPoint ) + 2 * sizeof( void * ) );
+
+    qint64 cost = 512 + ( annotation->contents().size() + annotation->author().size() ) * sizeof( QChar );
+    switch ( annotation->subType() )
+    {
+        case Annotation::AInk:
+            foreach ( const QLinkedList<NormalizedPoint> &path, static_cast< const InkAnnotation * >( annotation )->inkPaths() )
+                cost += path.count() * pointCost;
+            break;
+        case Annotation::ALine:
+            cost += static_cast< const LineAnnotation * >( annotation )->linePoints().count() * pointCost;
+            break;
+        case Annotation::AHighlight:
+            cost += static_cast< const HighlightAnnotation * >( annotation )->highlightQuads().count() * 8 * pointCost;
+            break;
+        default:
+            break;
+    }
+    return cost;
+}
+
+// The memory taken by a DOM node, approximated by the size of its XML
+static qint64 domNodeMemoryCost( const QDomNode &node )
+{
+    QString xml;
+    QTextStream stream( &xml );
+    node.save( stream, -1 );
+    stream.flush();
+    return xml.size() * sizeof( QChar );
+}
+
 AddAnnotationCommand::AddAnnotationCommand( Okular::DocumentPrivate * docPriv,  Okular::Annotation* annotation, int pageNumber )
  : m_docPriv( docPriv ),
    m_annotation( annotation ),
@@ -87,6 +125,15 @@ void AddAnnotationCommand::redo()
     m_done = true;
 }
 
+qint64 AddAnnotationCommand::memoryCost() const
+{
+    // the annotation belongs to the command while the addition is undone
+    qint64 cost = sizeof( *this ) + text().size() * sizeof( QChar );
+    if ( !m_done )
+        cost += annotationMemoryCost( m_annotation );
+    return cost;
+}
+
 
 RemoveAnnotationCommand::RemoveAnnotationCommand(Okular::DocumentPrivate * doc,  Okular::Annotation* annotation, int pageNumber)
  : m_docPriv( doc ),
@@ -118,6 +165,15 @@ void RemoveAnnotationCommand::redo(){
     m_done = true;
 }
 
+qint64 RemoveAnnotationCommand::memoryCost() const
+{
+    // the annotation belongs to the command while it is removed
+    qint64 cost = sizeof( *this ) + text().size() * sizeof( QChar );
+    if ( m_done )
+        cost += annotationMemoryCost( m_annotation );
+    return cost;
+}
+
 
 ModifyAnnotationPropertiesCommand::ModifyAnnotationPropertiesCommand( DocumentPrivate* docPriv,
                                                                       Annotation* annotation,
@@ -128,7 +184,8 @@ ModifyAnnotationPropertiesCommand::ModifyAnnotationPropertiesCommand( DocumentPr
    m_annotation( annotation ),
    m_pageNumber( pageNumber ),
    m_prevProperties( oldProperties ),
-   m_newProperties( newProperties )
+   m_newProperties( newProperties ),
+   m_propertiesCost( domNodeMemoryCost( oldProperties ) + domNodeMemoryCost( newProperties ) )
 {
     setText(i18nc("Modify an annotation's internal properties (Color, line-width, etc.)", "modify annotation properties"));
 }
@@ -147,6 +204,11 @@ void ModifyAnnotationPropertiesCommand::redo()
     m_docPriv->performModifyPageAnnotation( m_pageNumber,  m_annotation, true );
 }
 
+qint64 ModifyAnnotationPropertiesCommand::memoryCost() const
+{
+    return sizeof( *this ) + text().size() * sizeof( QChar ) + m_propertiesCost;
+}
+
 TranslateAnnotationCommand::TranslateAnnotationCommand( DocumentPrivate* docPriv,
                                                         Annotation* annotation,
                                                         int pageNumber,
@@ -282,14 +344,19 @@ EditTextCommand::EditTextCommand( const QString & newContents,
                                   const QString & prevContents,
                                   int prevCursorPos,
                                   int prevAnchorPos )
- : m_newContents( newContents ),
-   m_newCursorPos( newCursorPos ),
-   m_prevContents( prevContents ),
+ : m_newCursorPos( newCursorPos ),
    m_prevCursorPos( prevCursorPos ),
-   m_prevAnchorPos( prevAnchorPos )
+   m_prevAnchorPos( prevAnchorPos ),
+   m_prevContentsHash( qHash( prevContents ) ),
+   m_newContentsHash( qHash( newContents ) )
 {
     setText( i18nc( "Generic text edit command", "edit text" ) );
 
+    const QString oldContentsLeftOfCursor = prevContents.left( m_prevCursorPos );
+    const QString oldContentsRightOfCursor = prevContents.mid( m_prevCursorPos );
+    const QString newContentsLeftOfCursor = newContents.left( m_newCursorPos );
+    const QString newContentsRightOfCursor = newContents.mid( m_newCursorPos );
+
     //// Determine edit type
     // If There was a selection then edit was not a simple single character backspace, delete, or insert
     if (m_prevCursorPos != m_prevAnchorPos)
@@ -297,23 +364,23 @@ EditTextCommand::EditTextCommand( const QString & newContents,
         qCDebug(OkularCoreDebug) << "OtherEdit, selection";
         m_editType = OtherEdit;
     }
-    else if ( newContentsRightOfCursor() == oldContentsRightOfCursor() &&
-              newContentsLeftOfCursor() == oldContentsLeftOfCursor().left(oldContentsLeftOfCursor().length() - 1) &&
-              oldContentsLeftOfCursor().right(1) != QLatin1String("\n") )
+    else if ( newContentsRightOfCursor == oldContentsRightOfCursor &&
+              newContentsLeftOfCursor == oldContentsLeftOfCursor.left(oldContentsLeftOfCursor.length() - 1) &&
+              oldContentsLeftOfCursor.right(1) != QLatin1String("\n") )
     {
         qCDebug(OkularCoreDebug) << "CharBackspace";
         m_editType = CharBackspace;
     }
-    else if ( newContentsLeftOfCursor() == oldContentsLeftOfCursor() &&
-              newContentsRightOfCursor() == oldContentsRightOfCursor().right(oldContentsRightOfCursor().length() - 1) &&
-              oldContentsRightOfCursor().left(1) != QLatin1String("\n") )
+    else if ( newContentsLeftOfCursor == oldContentsLeftOfCursor &&
+              newContentsRightOfCursor == oldContentsRightOfCursor.right(oldContentsRightOfCursor.length() - 1) &&
+              oldContentsRightOfCursor.left(1) != QLatin1String("\n") )
     {
         qCDebug(OkularCoreDebug) << "CharDelete";
         m_editType = CharDelete;
     }
-    else if ( newContentsRightOfCursor() == oldContentsRightOfCursor() &&
-              newContentsLeftOfCursor().left( newContentsLeftOfCursor().length() - 1) == oldContentsLeftOfCursor() &&
-              newContentsLeftOfCursor().right(1) != QLatin1String("\n") )
+    else if ( newContentsRightOfCursor == oldContentsRightOfCursor &&
+              newContentsLeftOfCursor.left( newContentsLeftOfCursor.length() - 1) == oldContentsLeftOfCursor &&
+              newContentsLeftOfCursor.right(1) != QLatin1String("\n") )
     {
         qCDebug(OkularCoreDebug) << "CharInsert";
         m_editType = CharInsert;
@@ -323,44 +390,112 @@ EditTextCommand::EditTextCommand( const QString & newContents,
         qCDebug(OkularCoreDebug) << "OtherEdit";
         m_editType = OtherEdit;
     }
+
+    //// Determine the changed part of the contents
+    switch ( m_editType )
+    {
+        // single character edits happen at the cursor, so that a sequence of
+        // them is contiguous even when the text repeats the same character
+        case CharBackspace:
+            m_editPos = m_prevCursorPos - 1;
+            m_removedText = prevContents.mid( m_editPos, 1 );
+            break;
+        case CharDelete:
+            m_editPos = m_prevCursorPos;
+            m_removedText = prevContents.mid( m_editPos, 1 );
+            break;
+        case CharInsert:
+            m_editPos = m_prevCursorPos;
+            m_insertedText = newContents.mid( m_editPos, 1 );
+            break;
+        case OtherEdit:
+        {
+            const int minLength = qMin( prevContents.length(), newContents.length() );
+            int prefix = 0;
+            while ( prefix < minLength && prevContents.at( prefix ) == newContents.at( prefix ) )
+                ++prefix;
+            int suffix = 0;
+            while ( suffix < minLength - prefix &&
+                    prevContents.at( prevContents.length() - suffix - 1 ) == newContents.at( newContents.length() - suffix - 1 ) )
+                ++suffix;
+            m_editPos = prefix;
+            m_removedText = prevContents.mid( prefix, prevContents.length() - prefix - suffix );
+            m_insertedText = newContents.mid( prefix, newContents.length() - prefix - suffix );
+            break;
+        }
+    }
 }
 
 bool EditTextCommand::mergeWith(const QUndoCommand* uc)
 {
     EditTextCommand *euc = (EditTextCommand*)uc;
 
-    // Only attempt merge of euc into this if our new state matches euc's old state and
+    // Only attempt merge of euc into this if it continues from where we left the cursor and
     // the editTypes match and are not type OtherEdit
-    if ( m_newContents == euc->m_prevContents
-        && m_newCursorPos == euc->m_prevCursorPos
-        && m_editType == euc->m_editType
-        && m_editType != OtherEdit )
+    if ( m_newCursorPos != euc->m_prevCursorPos
+        || m_newContentsHash != euc->m_prevContentsHash
+        || m_editType != euc->m_editType
+        || m_editType == OtherEdit )
     {
-        m_newContents = euc->m_newContents;
-        m_newCursorPos = euc->m_newCursorPos;
-        return true;
+        return false;
     }
-    return false;
-}
 
-QString EditTextCommand::oldContentsLeftOfCursor()
-{
-    return m_prevContents.left(m_prevCursorPos);
+    switch ( m_editType )
+    {
+        case CharBackspace:
+            if ( euc->m_editPos + euc->m_removedText.length() != m_editPos )
+                return false;
+            m_editPos = euc->m_editPos;
+            m_removedText.prepend( euc->m_removedText );
+            break;
+        case CharDelete:
+            if ( euc->m_editPos != m_editPos )
+                return false;
+            m_removedText.append( euc->m_removedText );
+            break;
+        case CharInsert:
+            if ( euc->m_editPos != m_editPos + m_insertedText.length() )
+                return false;
+            m_insertedText.append( euc->m_insertedText );
+            break;
+        case OtherEdit:
+            return false;
+    }
+
+    m_newCursorPos = euc->m_newCursorPos;
+    m_newContentsHash = euc->m_newContentsHash;
+    return true;
 }
 
-QString EditTextCommand::oldContentsRightOfCursor()
+qint64 EditTextCommand::memoryCost() const
 {
-    return m_prevContents.right(m_prevContents.length() - m_prevCursorPos);
+    return sizeof( *this ) + ( text().size() + m_removedText.size() + m_insertedText.size() ) * sizeof( QChar );
 }
 
-QString EditTextCommand::newContentsLeftOfCursor()
+bool EditTextCommand::prevContents( QString *contents )
 {
-    return m_newContents.left(m_newCursorPos);
+    const QString current = currentContents();
+    if ( qHash( current ) != m_newContentsHash )
+    {
+        qCWarning(OkularCoreDebug) << "The contents changed since the edit, it can not be undone";
+        setObsolete( true );
+        return false;
+    }
+    *contents = current.left( m_editPos ) + m_removedText + current.mid( m_editPos + m_insertedText.length() );
+    return true;
 }
 
-QString EditTextCommand::newContentsRightOfCursor()
+bool EditTextCommand::newContents( QString *contents )
 {
-    return m_newContents.right(m_newContents.length() - m_newCursorPos);
+    const QString current = currentContents();
+    if ( qHash( current ) != m_prevContentsHash )
+    {
+        qCWarning(OkularCoreDebug) << "The contents changed since the edit was undone, it can not be redone";
+        setObsolete( true );
+        return false;
+    }
+    *contents = current.left( m_editPos ) + m_insertedText + current.mid( m_editPos + m_removedText.length() );
+    return true;
 }
 
 EditAnnotationContentsCommand::EditAnnotationContentsCommand( DocumentPrivate* docPriv,
@@ -381,16 +516,22 @@ EditAnnotationContentsCommand::EditAnnotationContentsCommand( DocumentPrivate* d
 
 void EditAnnotationContentsCommand::undo()
 {
+    QString contents;
+    if ( !prevContents( &contents ) )
+        return;
     moveViewportIfBoundingRectNotFullyVisible( m_annotation->boundingRectangle(), m_docPriv, m_pageNumber );
-    m_docPriv->performSetAnnotationContents( m_prevContents, m_annotation, m_pageNumber );
-    emit m_docPriv->m_parent->annotationContentsChangedByUndoRedo( m_annotation, m_prevContents, m_prevCursorPos, m_prevAnchorPos );
+    m_docPriv->performSetAnnotationContents( contents, m_annotation, m_pageNumber );
+    emit m_docPriv->m_parent->annotationContentsChangedByUndoRedo( m_annotation, contents, m_prevCursorPos, m_prevAnchorPos );
 }
 
 void EditAnnotationContentsCommand::redo()
 {
+    QString contents;
+    if ( !newContents( &contents ) )
+        return;
     moveViewportIfBoundingRectNotFullyVisible( m_annotation->boundingRectangle(), m_docPriv, m_pageNumber );
-    m_docPriv->performSetAnnotationContents( m_newContents, m_annotation, m_pageNumber );
-    emit m_docPriv->m_parent->annotationContentsChangedByUndoRedo( m_annotation, m_newContents, m_newCursorPos, m_newCursorPos );
+    m_docPriv->performSetAnnotationContents( contents, m_annotation, m_pageNumber );
+    emit m_docPriv->m_parent->annotationContentsChangedByUndoRedo( m_annotation, contents, m_newCursorPos, m_newCursorPos );
 }
 
 int EditAnnotationContentsCommand::id() const
@@ -412,6 +553,11 @@ bool EditAnnotationContentsCommand::mergeWith(const QUndoCommand* uc)
     }
 }
 
+QString EditAnnotationContentsCommand::currentContents() const
+{
+    return m_annotation->contents();
+}
+
 EditFormTextCommand::EditFormTextCommand( Okular::DocumentPrivate* docPriv,
                                           Okular::FormFieldText* form,
                                           int pageNumber,
@@ -430,16 +576,22 @@ EditFormTextCommand::EditFormTextCommand( Okular::DocumentPrivate* docPriv,
 
 void EditFormTextCommand::undo()
 {
+    QString contents;
+    if ( !prevContents( &contents ) )
+        return;
     moveViewportIfBoundingRectNotFullyVisible( m_form->rect(), m_docPriv, m_pageNumber );
-    m_form->setText( m_prevContents );
-    emit m_docPriv->m_parent->formTextChangedByUndoRedo( m_pageNumber, m_form, m_prevContents, m_prevCursorPos, m_prevAnchorPos );
+    m_form->setText( contents );
+    emit m_docPriv->m_parent->formTextChangedByUndoRedo( m_pageNumber, m_form, contents, m_prevCursorPos, m_prevAnchorPos );
 }
 
 void EditFormTextCommand::redo()
 {
+    QString contents;
+    if ( !newContents( &contents ) )
+        return;
     moveViewportIfBoundingRectNotFullyVisible( m_form->rect(), m_docPriv, m_pageNumber );
-    m_form->setText( m_newContents  );
-    emit m_docPriv->m_parent->formTextChangedByUndoRedo( m_pageNumber, m_form, m_newContents, m_newCursorPos, m_newCursorPos );
+    m_form->setText( contents );
+    emit m_docPriv->m_parent->formTextChangedByUndoRedo( m_pageNumber, m_form, contents, m_newCursorPos, m_newCursorPos );
 }
 
 int EditFormTextCommand::id() const
@@ -461,6 +613,11 @@ bool EditFormTextCommand::mergeWith(const QUndoCommand* uc)
     }
 }
 
+QString EditFormTextCommand::currentContents() const
+{
+    return m_form->text();
+}
+
 EditFormListCommand::EditFormListCommand( Okular::DocumentPrivate* docPriv,
                                           FormFieldChoice* form,
                                           int pageNumber,
@@ -489,6 +646,11 @@ void EditFormListCommand::redo()
     emit m_docPriv->m_parent->formListChangedByUndoRedo( m_pageNumber, m_form, m_newChoices );
 }
 
+qint64 EditFormListCommand::memoryCost() const
+{
+    return sizeof( *this ) + text().size() * sizeof( QChar ) + ( m_newChoices.count() + m_prevChoices.count() ) * sizeof( int );
+}
+
 EditFormComboCommand::EditFormComboCommand( Okular::DocumentPrivate* docPriv,
                                             FormFieldChoice* form,
                                             int pageNumber,
@@ -509,12 +671,12 @@ EditFormComboCommand::EditFormComboCommand( Okular::DocumentPrivate* docPriv,
     // Determine new and previous choice indices (if any)
     for ( int i = 0; i < m_form->choices().size(); i++ )
     {
-        if ( m_form->choices()[i] == m_prevContents )
+        if ( m_form->choices()[i] == prevContents )
         {
             m_prevIndex = i;
         }
 
-        if ( m_form->choices()[i] == m_newContents )
+        if ( m_form->choices()[i] == newContents )
         {
             m_newIndex = i;
         }
@@ -523,30 +685,36 @@ EditFormComboCommand::EditFormComboCommand( Okular::DocumentPrivate* docPriv,
 
 void EditFormComboCommand::undo()
 {
+    QString contents;
+    if ( !prevContents( &contents ) )
+        return;
     if ( m_prevIndex != -1 )
     {
         m_form->setCurrentChoices( QList<int>() << m_prevIndex );
     }
     else
     {
-        m_form->setEditChoice( m_prevContents );
+        m_form->setEditChoice( contents );
     }
     moveViewportIfBoundingRectNotFullyVisible( m_form->rect(), m_docPriv, m_pageNumber );
-    emit m_docPriv->m_parent->formComboChangedByUndoRedo( m_pageNumber, m_form, m_prevContents, m_prevCursorPos, m_prevAnchorPos );
+    emit m_docPriv->m_parent->formComboChangedByUndoRedo( m_pageNumber, m_form, contents, m_prevCursorPos, m_prevAnchorPos );
 }
 
 void EditFormComboCommand::redo()
 {
+    QString contents;
+    if ( !newContents( &contents ) )
+        return;
     if ( m_newIndex != -1 )
     {
         m_form->setCurrentChoices( QList<int>() << m_newIndex );
     }
     else
     {
-        m_form->setEditChoice( m_newContents );
+        m_form->setEditChoice( contents );
     }
     moveViewportIfBoundingRectNotFullyVisible( m_form->rect(), m_docPriv, m_pageNumber );
-    emit m_docPriv->m_parent->formComboChangedByUndoRedo( m_pageNumber, m_form, m_newContents, m_newCursorPos, m_newCursorPos );
+    emit m_docPriv->m_parent->formComboChangedByUndoRedo( m_pageNumber, m_form, contents, m_newCursorPos, m_newCursorPos );
 }
 
 int EditFormComboCommand::id() const
@@ -573,6 +741,13 @@ bool EditFormComboCommand::mergeWith( const QUndoCommand *uc )
     }
 }
 
+QString EditFormComboCommand::currentContents() const
+{
+    if ( m_form->currentChoices().isEmpty() )
+        return m_form->editChoice();
+    return m_form->choices().at( m_form->currentChoices().constFirst() );
+}
+
 EditFormButtonsCommand::EditFormButtonsCommand( Okular::DocumentPrivate* docPriv,
                                                 int pageNumber,
                                                 const QList< FormFieldButton* > & formButtons,
@@ -620,6 +795,12 @@ void EditFormButtonsCommand::redo()
     emit m_docPriv->m_parent->formButtonsChangedByUndoRedo( m_pageNumber, m_formButtons );
 }
 
+qint64 EditFormButtonsCommand::memoryCost() const
+{
+    return sizeof( *this ) + text().size() * sizeof( QChar )
+           + m_formButtons.count() * ( sizeof( FormFieldButton * ) + 2 * sizeof( bool ) );
+}
+
 void EditFormButtonsCommand::clearFormButtonStates()
 {
     foreach( FormFieldButton* formButton, m_formButtons )
@@ -10,10 +10,10 @@
 #ifndef _OKULAR_DOCUMENT_COMMANDS_P_H_
 #define _OKULAR_DOCUMENT_COMMANDS_P_H_
 
-#include <QtWidgets/QUndoCommand>
 #include <QDomNode>
 
 #include "area.h"
+#include "undostack_p.h"
 
 namespace Okular {
 
@@ -24,7 +24,7 @@ class FormFieldText;
 class FormFieldButton;
 class FormFieldChoice;
 
-class AddAnnotationCommand : public QUndoCommand
+class AddAnnotationCommand : public UndoCommand
 {
     public:
         AddAnnotationCommand(Okular::DocumentPrivate * docPriv,  Okular::Annotation* annotation, int pageNumber);
@@ -35,6 +35,8 @@ class AddAnnotationCommand : public QUndoCommand
 
         void redo() override;
 
+        qint64 memoryCost() const override;
+
     private:
         Okular::DocumentPrivate * m_docPriv;
         Okular::Annotation* m_annotation;
@@ -42,13 +44,14 @@ class AddAnnotationCommand : public QUndoCommand
         bool m_done;
 };
 
-class RemoveAnnotationCommand : public QUndoCommand
+class RemoveAnnotationCommand : public UndoCommand
 {
     public:
         RemoveAnnotationCommand(Okular::DocumentPrivate * doc,  Okular::Annotation* annotation, int pageNumber);
         virtual ~RemoveAnnotationCommand();
         void undo() override;
         void redo() override;
+        qint64 memoryCost() const override;
 
     private:
         Okular::DocumentPrivate * m_docPriv;
@@ -57,7 +60,7 @@ class RemoveAnnotationCommand : public QUndoCommand
         bool m_done;
 };
 
-class ModifyAnnotationPropertiesCommand : public QUndoCommand
+class ModifyAnnotationPropertiesCommand : public UndoCommand
 {
     public:
         ModifyAnnotationPropertiesCommand( Okular::DocumentPrivate* docPriv,  Okular::Annotation*  annotation,
@@ -67,6 +70,7 @@ class ModifyAnnotationPropertiesCommand : public QUndoCommand
 
         void undo() override;
         void redo() override;
+        qint64 memoryCost() const override;
 
     private:
         Okular::DocumentPrivate * m_docPriv;
@@ -74,9 +78,10 @@ class ModifyAnnotationPropertiesCommand : public QUndoCommand
         int m_pageNumber;
         QDomNode m_prevProperties;
         QDomNode m_newProperties;
+        qint64 m_propertiesCost;
 };
 
-class TranslateAnnotationCommand : public QUndoCommand
+class TranslateAnnotationCommand : public UndoCommand
 {
     public:
         TranslateAnnotationCommand(Okular::DocumentPrivate* docPriv,
@@ -100,7 +105,7 @@ class TranslateAnnotationCommand : public QUndoCommand
         bool m_completeDrag;
 };
 
-class AdjustAnnotationCommand : public QUndoCommand
+class AdjustAnnotationCommand : public UndoCommand
 {
     public:
         AdjustAnnotationCommand(Okular::DocumentPrivate * docPriv,
@@ -126,7 +131,7 @@ class AdjustAnnotationCommand : public QUndoCommand
         bool m_completeDrag;
 };
 
-class EditTextCommand : public QUndoCommand
+class EditTextCommand : public UndoCommand
 {
     public:
         EditTextCommand( const QString & newContents,
@@ -140,6 +145,7 @@ class EditTextCommand : public QUndoCommand
         void redo() override = 0;
         int id() const override = 0;
         bool mergeWith(const QUndoCommand *uc) override;
+        qint64 memoryCost() const override;
 
     private:
         enum EditType {
@@ -149,18 +155,33 @@ class EditTextCommand : public QUndoCommand
             OtherEdit           ///< All other edit operations (these will not be merged together)
         };
 
-        QString oldContentsLeftOfCursor();
-        QString newContentsLeftOfCursor();
-        QString oldContentsRightOfCursor();
-        QString newContentsRightOfCursor();
+        // the contents the command applies to, i.e. the new contents
+        // after redo() and the previous ones after undo()
+        virtual QString currentContents() const = 0;
 
     protected:
-        QString m_newContents;
+        // the contents before and after the edit, rebuilt from the current
+        // contents; prevContents() is only valid before undoing the edit and
+        // newContents() before redoing it. If the current contents are not
+        // the expected ones, e.g. when a script changed them outside of the
+        // undo stack, they return false and make the command obsolete
+        bool prevContents( QString *contents );
+        bool newContents( QString *contents );
+
         int m_newCursorPos;
-        QString m_prevContents;
         int m_prevCursorPos;
         int m_prevAnchorPos;
         EditType m_editType;
+
+    private:
+        // the edit replaced m_removedText with m_insertedText at m_editPos;
+        // only that is kept instead of copies of the whole contents
+        int m_editPos;
+        QString m_removedText;
+        QString m_insertedText;
+        // the hashes of the whole contents before and after the edit
+        uint m_prevContentsHash;
+        uint m_newContentsHash;
 };
 
 
@@ -183,6 +204,8 @@ class EditAnnotationContentsCommand : public EditTextCommand
         bool mergeWith(const QUndoCommand *uc) override;
 
     private:
+        QString currentContents() const override;
+
         Okular::DocumentPrivate * m_docPriv;
         Okular::Annotation* m_annotation;
         int m_pageNumber;
@@ -204,12 +227,14 @@ class EditFormTextCommand : public EditTextCommand
         int id() const override;
         bool mergeWith( const QUndoCommand *uc ) override;
     private:
+        QString currentContents() const override;
+
         Okular::DocumentPrivate* m_docPriv;
         Okular::FormFieldText* m_form;
         int m_pageNumber;
 };
 
-class EditFormListCommand : public QUndoCommand
+class EditFormListCommand : public UndoCommand
 {
     public:
         EditFormListCommand( Okular::DocumentPrivate* docPriv,
@@ -221,6 +246,7 @@ class EditFormListCommand : public QUndoCommand
 
         void undo() override;
         void redo() override;
+        qint64 memoryCost() const override;
 
     private:
         Okular::DocumentPrivate* m_docPriv;
@@ -249,6 +275,8 @@ class EditFormComboCommand : public EditTextCommand
         bool mergeWith( const QUndoCommand *uc ) override;
 
     private:
+        QString currentContents() const override;
+
         Okular::DocumentPrivate* m_docPriv;
         FormFieldChoice* m_form;
         int m_pageNumber;
@@ -256,7 +284,7 @@ class EditFormComboCommand : public EditTextCommand
         int m_prevIndex;
 };
 
-class EditFormButtonsCommand : public QUndoCommand
+class EditFormButtonsCommand : public UndoCommand
 {
     public:
         EditFormButtonsCommand( Okular::DocumentPrivate* docPriv,
@@ -267,6 +295,7 @@ class EditFormButtonsCommand : public QUndoCommand
 
         void undo() override;
         void redo() override;
+        qint64 memoryCost() const override;
 
     private:
         void clearFormButtonStates();
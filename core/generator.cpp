@@ -26,6 +26,7 @@
 #include "page.h"
 #include "page_p.h"
 #include "textpage.h"
+#include "tracer_p.h"
 #include "utils.h"
 
 using namespace Okular;
@@ -101,8 +102,10 @@ void GeneratorPrivate::pixmapGenerationFinished()
         return;
     }
 
-    const QImage& img = mPixmapGenerationThread->image();
-    request->page()->setPixmap( request->observer(), new QPixmap( QPixmap::fromImage( img ) ), request->normalizedRect() );
+    // the thread does not keep a reference to the image, so the pixmap can
+    // adopt (or convert in place) its buffer instead of copying it
+    QImage img = mPixmapGenerationThread->takeImage();
+    request->page()->setPixmap( request->observer(), new QPixmap( QPixmap::fromImage( std::move( img ) ) ), request->normalizedRect() );
     const int pageNumber = request->page()->number();
 
     if ( mPixmapGenerationThread->calcBoundingBox() )
@@ -257,15 +260,20 @@ void Generator::generatePixmap( PixmapRequest *request )
         return;
     }
 
-    const QImage& img = image( request );
-    request->page()->setPixmap( request->observer(), new QPixmap( QPixmap::fromImage( img ) ), request->normalizedRect() );
+    if ( Tracer::isEnabled() )
+        Tracer::asyncStep( "pixmap", "started", (quintptr)request );
+    TraceScope trace( "pixmap", "Generator::image" );
+    trace.setArg( QStringLiteral( "page" ), request->pageNumber() );
+    QImage img = image( request );
+    const NormalizedRect boundingBox = calcBoundingBox ? Utils::imageBoundingBox( &img ) : NormalizedRect();
+    request->page()->setPixmap( request->observer(), new QPixmap( QPixmap::fromImage( std::move( img ) ) ), request->normalizedRect() );
     const int pageNumber = request->page()->number();
 
     d->mPixmapReady = true;
 
     signalPixmapRequestDone( request );
     if ( calcBoundingBox )
-        updatePageBoundingBox( pageNumber, Utils::imageBoundingBox( &img ) );
+        updatePageBoundingBox( pageNumber, boundingBox );
 }
 
 bool Generator::canGenerateTextPage() const
@@ -276,11 +284,26 @@ bool Generator::canGenerateTextPage() const
 
 void Generator::generateTextPage( Page *page )
 {
+    TraceScope trace( "text", "Generator::textPage" );
+    trace.setArg( QStringLiteral( "page" ), page->number() );
     TextPage *tp = textPage( page );
     page->setTextPage( tp );
     signalTextGenerationDone( page, tp );
 }
 
+void Generator::generateTextPages( const QVector<Page*> &pages )
+{
+    TraceScope trace( "text", "Generator::textPages" );
+    trace.setArg( QStringLiteral( "pages" ), pages.count() );
+    const QVector<TextPage*> tps = textPages( pages );
+    for ( int i = 0; i < pages.count(); ++i )
+    {
+        TextPage *tp = tps.value( i );
+        pages.at( i )->setTextPage( tp );
+        signalTextGenerationDone( pages.at( i ), tp );
+    }
+}
+
 QImage Generator::image( PixmapRequest *request )
 {
     Q_D( Generator );
@@ -292,6 +315,19 @@ TextPage* Generator::textPage( Page* )
     return 0;
 }
 
+QVector<TextPage*> Generator::textPages( const QVector<Page*> &pages )
+{
+    QVector<TextPage*> tps;
+    tps.reserve( pages.count() );
+    foreach ( Page *page, pages )
+        tps.append( textPage( page ) );
+    return tps;
+}
+
+void Generator::loadPageData( Page* )
+{
+}
+
 DocumentInfo Generator::generateDocumentInfo(const QSet<DocumentInfo::Key> &keys) const
 {
     Q_UNUSED(keys);
@@ -337,6 +373,18 @@ void Generator::pageSizeChanged( const PageSize &, const PageSize & )
 {
 }
 
+void Generator::cancelExport()
+{
+    Q_D( Generator );
+    d->m_exportCancelled.store( 1 );
+}
+
+bool Generator::exportCancelled() const
+{
+    Q_D( const Generator );
+    return d->m_exportCancelled.load();
+}
+
 bool Generator::print( QPrinter& )
 {
     return false;
@@ -497,10 +545,25 @@ PixmapRequest::PixmapRequest( DocumentObserver *observer, int pageNumber, int wi
     d->mForce = false;
     d->mTile = false;
     d->mNormalizedRect = NormalizedRect();
+    d->mTimer.start();
+    d->mGenerationStart = 0;
+
+    if ( Tracer::isEnabled() )
+    {
+        QVariantMap args;
+        args.insert( QStringLiteral( "page" ), pageNumber );
+        args.insert( QStringLiteral( "width" ), width );
+        args.insert( QStringLiteral( "height" ), height );
+        args.insert( QStringLiteral( "priority" ), priority );
+        args.insert( QStringLiteral( "asynchronous" ), (bool)( features & Asynchronous ) );
+        Tracer::asyncBegin( "pixmap", "PixmapRequest", (quintptr)this, args );
+    }
 }
 
 PixmapRequest::~PixmapRequest()
 {
+    if ( Tracer::isEnabled() )
+        Tracer::asyncEnd( "pixmap", "PixmapRequest", (quintptr)this );
     delete d;
 }
 
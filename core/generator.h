@@ -208,7 +208,8 @@ class OKULARCORE_EXPORT Generator : public QObject
             PrintNative,       ///< Whether the Generator supports native cross-platform printing (QPainter-based).
             PrintPostscript,   ///< Whether the Generator supports postscript-based file printing.
             PrintToFile,       ///< Whether the Generator supports export to PDF & PS through the Print Dialog
-            TiledRendering     ///< Whether the Generator can render tiles @since 0.16 (KDE 4.10)
+            TiledRendering,    ///< Whether the Generator can render tiles @since 0.16 (KDE 4.10)
+            LazyPageData       ///< Whether the Generator fills the annotations, transition and actions of the pages only in loadPageData() @since 1.2
         };
 
         /**
@@ -308,6 +309,16 @@ class OKULARCORE_EXPORT Generator : public QObject
          */
         virtual void generateTextPage( Page * page );
 
+        /**
+         * This method can be called to trigger the synchronous generation
+         * of the text pages for all the given @p pages with a single call
+         * to textPages().
+         *
+         * @see TextPage
+         * @since 1.2
+         */
+        virtual void generateTextPages( const QVector<Page*> &pages );
+
         /**
          * Returns the general information object of the document.
          *
@@ -414,6 +425,16 @@ class OKULARCORE_EXPORT Generator : public QObject
          */
         virtual bool exportTo( const QString &fileName, const ExportFormat &format );
 
+        /**
+         * Asks the export in progress, if any, to stop as soon as possible.
+         *
+         * It is meant to be called from a slot connected to exportProgress();
+         * exportTo() may run in a thread other than the GUI one.
+         *
+         * @since 1.2
+         */
+        void cancelExport();
+
         /**
          * This method is called to know which wallet data should be used for the given file name.
          * Unless you have very special requirements to where wallet data should be stored you
@@ -471,6 +492,17 @@ class OKULARCORE_EXPORT Generator : public QObject
          */
         void notice( const QString &message, int duration );
 
+        /**
+         * This signal should be emitted by exportTo() whenever a page of the
+         * document has been exported.
+         *
+         * @param done The number of pages exported so far.
+         * @param total The number of pages to export.
+         *
+         * @since 1.2
+         */
+        void exportProgress( int done, int total );
+
     protected:
         /**
          * This method must be called when the pixmap request triggered by generatePixmap()
@@ -483,6 +515,15 @@ class OKULARCORE_EXPORT Generator : public QObject
          */
         void signalTextGenerationDone( Page *page, TextPage *textPage );
 
+        /**
+         * Returns whether cancelExport() was called during the current
+         * export; exportTo() implementations should check it between pages
+         * and give up the export if so.
+         *
+         * @since 1.2
+         */
+        bool exportCancelled() const;
+
         /**
          * This method is called when the document is closed and not used
          * any longer.
@@ -508,6 +549,33 @@ class OKULARCORE_EXPORT Generator : public QObject
          */
         virtual TextPage* textPage( Page *page );
 
+        /**
+         * Returns the text pages for the given @p pages, in the same order.
+         *
+         * The default implementation calls textPage() for each of them;
+         * reimplement it if the generator can share the setup of the text
+         * extraction between the pages.
+         *
+         * @warning this method may be executed in its own separated thread if the
+         * @ref Threaded is enabled!
+         * @since 1.2
+         */
+        virtual QVector<TextPage*> textPages( const QVector<Page*> &pages );
+
+        /**
+         * Fills the annotations, the transition and the page actions of the
+         * given @p page.
+         *
+         * It is called only for generators with the @ref LazyPageData feature,
+         * which create the pages with just their size in loadDocument(). The
+         * document calls it in the GUI thread, once per page, the first time
+         * those data are needed (e.g. before the page is shown, or before the
+         * annotations are saved), with userMutex() locked.
+         *
+         * @since 1.2
+         */
+        virtual void loadPageData( Page *page );
+
         /**
          * Returns a pointer to the document.
          */
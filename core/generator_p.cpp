@@ -13,6 +13,8 @@
 
 #include "fontinfo.h"
 #include "generator.h"
+#include "page.h"
+#include "tracer_p.h"
 #include "utils.h"
 
 using namespace Okular;
@@ -45,6 +47,13 @@ QImage PixmapGenerationThread::image() const
     return mImage;
 }
 
+QImage PixmapGenerationThread::takeImage()
+{
+    QImage image;
+    image.swap( mImage );
+    return image;
+}
+
 bool PixmapGenerationThread::calcBoundingBox() const
 {
     return mCalcBoundingBox;
@@ -61,6 +70,10 @@ void PixmapGenerationThread::run()
 
     if ( mRequest )
     {
+        if ( Tracer::isEnabled() )
+            Tracer::asyncStep( "pixmap", "started", (quintptr)mRequest );
+        TraceScope trace( "pixmap", "Generator::image" );
+        trace.setArg( QStringLiteral( "page" ), mRequest->pageNumber() );
         mImage = mGenerator->image( mRequest );
         if ( mCalcBoundingBox )
             mBoundingBox = Utils::imageBoundingBox( &mImage );
@@ -100,7 +113,11 @@ void TextPageGenerationThread::run()
     mTextPage = 0;
 
     if ( mPage )
+    {
+        TraceScope trace( "text", "Generator::textPage" );
+        trace.setArg( QStringLiteral( "page" ), mPage->number() );
         mTextPage = mGenerator->textPage( mPage );
+    }
 }
 
 
@@ -12,6 +12,8 @@
 
 #include "area.h"
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QSet>
 #include <QtCore/QThread>
 #include <QtGui/QImage>
@@ -64,6 +66,7 @@ class GeneratorPrivate
         bool mPixmapReady : 1;
         bool mTextPageReady : 1;
         bool m_closing : 1;
+        QAtomicInt m_exportCancelled;
         QEventLoop *m_closingLoop;
         QSizeF m_dpi;
 };
@@ -85,6 +88,10 @@ class PixmapRequestPrivate
         bool mTile : 1;
         Page *mPage;
         NormalizedRect mNormalizedRect;
+        // started when the request is created
+        QElapsedTimer mTimer;
+        // when the generation of the request started, in mTimer time
+        qint64 mGenerationStart;
 };
 
 
@@ -102,6 +109,9 @@ class PixmapGenerationThread : public QThread
         PixmapRequest *request() const;
 
         QImage image() const;
+        // hands the generated image over to the caller, so that its buffer
+        // can be adopted without a copy
+        QImage takeImage();
         bool calcBoundingBox() const;
         NormalizedRect boundingBox() const;
 
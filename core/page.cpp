@@ -14,7 +14,9 @@
 #include <QtCore/QSet>
 #include <QtCore/QString>
 #include <QtCore/QVariant>
+#include <QtCore/QTextStream>
 #include <QtCore/QUuid>
+#include <QtCore/QXmlStreamReader>
 #include <QtGui/QPixmap>
 #include <QtXml/QDomDocument>
 #include <QtXml/QDomElement>
@@ -71,7 +73,7 @@ PagePrivate::PagePrivate( Page *page, uint n, double w, double h, Rotation o )
       m_rotation( Rotation0 ),
       m_text( 0 ), m_transition( 0 ), m_textSelections( 0 ),
       m_openingAction( 0 ), m_closingAction( 0 ), m_duration( -1 ),
-      m_isBoundingBoxKnown( false )
+      m_isBoundingBoxKnown( false ), m_pageDataLoaded( false )
 {
     // avoid Division-By-Zero problems in the program
     if ( m_width <= 0 )
@@ -121,6 +123,11 @@ void PagePrivate::imageRotationDone( RotationJob * job )
     }
 }
 
+qulonglong PagePrivate::textPageMemoryCost() const
+{
+    return m_text ? m_text->d->memoryCost() : 0;
+}
+
 QTransform PagePrivate::rotationMatrix() const
 {
     return Okular::buildRotationMatrix( m_rotation );
@@ -789,33 +796,29 @@ void Page::deleteAnnotations()
     m_annotations.clear();
 }
 
-void PagePrivate::restoreLocalContents( const QDomNode & pageNode )
+void PagePrivate::restoreLocalContents( QXmlStreamReader & reader )
 {
     // iterate over all chilren (annotationList, ...)
-    QDomNode childNode = pageNode.firstChild();
-    while ( childNode.isElement() )
+    while ( reader.readNextStartElement() )
     {
-        QDomElement childElement = childNode.toElement();
-        childNode = childNode.nextSibling();
-
         // parse annotationList child element
-        if ( childElement.tagName() == QLatin1String("annotationList") )
+        if ( reader.name() == QLatin1String("annotationList") )
         {
 #ifdef PAGE_PROFILE
             QTime time;
             time.start();
 #endif
-            // Clone annotationList as root node in restoredLocalAnnotationList
-            const QDomNode clonedNode = restoredLocalAnnotationList.importNode( childElement, true );
-            restoredLocalAnnotationList.appendChild( clonedNode );
+            // keep a copy of the annotationList in restoredLocalAnnotationList
+            QTextStream restoredStream( &restoredLocalAnnotationList );
+            restoredStream << "<annotationList>";
 
-            // iterate over all annotations
-            QDomNode annotationNode = childElement.firstChild();
-            while( annotationNode.isElement() )
+            // iterate over all annotations; only one of them at a time is
+            // turned into a DOM element
+            while ( reader.readNextStartElement() )
             {
-                // get annotation element and advance to next annot
-                QDomElement annotElement = annotationNode.toElement();
-                annotationNode = annotationNode.nextSibling();
+                QDomDocument doc;
+                const QDomElement annotElement = readDomElement( reader, doc );
+                annotElement.save( restoredStream, -1 );
 
                 // get annotation from the dom element
                 Annotation * annotation = AnnotationUtils::createAnnotation( annotElement );
@@ -829,15 +832,36 @@ void PagePrivate::restoreLocalContents( const QDomNode & pageNode )
                 else
                     qCWarning(OkularCoreDebug).nospace() << "page (" << m_number << "): can't restore an annotation from XML.";
             }
+
+            restoredStream << "</annotationList>";
 #ifdef PAGE_PROFILE
             qCDebug(OkularCoreDebug).nospace() << "annots: XML Load time: " << time.elapsed() << "ms";
 #endif
         }
+        // parse the bounding box computed in a previous session
+        else if ( reader.name() == QLatin1String("boundingBox") )
+        {
+            const QXmlStreamAttributes attributes = reader.attributes();
+            bool okLeft, okTop, okRight, okBottom;
+            const NormalizedRect bbox( attributes.value( QStringLiteral("l") ).toDouble( &okLeft ),
+                                       attributes.value( QStringLiteral("t") ).toDouble( &okTop ),
+                                       attributes.value( QStringLiteral("r") ).toDouble( &okRight ),
+                                       attributes.value( QStringLiteral("b") ).toDouble( &okBottom ) );
+            if ( okLeft && okTop && okRight && okBottom )
+            {
+                m_boundingBox = bbox & NormalizedRect( 0., 0., 1., 1. );
+                m_isBoundingBoxKnown = true;
+            }
+            reader.skipCurrentElement();
+        }
         // parse formList child element
-        else if ( childElement.tagName() == QLatin1String("forms") )
+        else if ( reader.name() == QLatin1String("forms") )
         {
             if ( formfields.isEmpty() )
+            {
+                reader.skipCurrentElement();
                 continue;
+            }
 
             QHash<int, FormField*> hashedforms;
             QLinkedList< FormField * >::const_iterator fIt = formfields.begin(), fItEnd = formfields.end();
@@ -847,18 +871,16 @@ void PagePrivate::restoreLocalContents( const QDomNode & pageNode )
             }
 
             // iterate over all forms
-            QDomNode formsNode = childElement.firstChild();
-            while( formsNode.isElement() )
+            while ( reader.readNextStartElement() )
             {
-                // get annotation element and advance to next annot
-                QDomElement formElement = formsNode.toElement();
-                formsNode = formsNode.nextSibling();
-
-                if ( formElement.tagName() != QLatin1String("form") )
+                const QXmlStreamAttributes attributes = reader.attributes();
+                const bool isForm = reader.name() == QLatin1String("form");
+                reader.skipCurrentElement();
+                if ( !isForm )
                     continue;
 
                 bool ok = true;
-                int index = formElement.attribute( QStringLiteral("id") ).toInt( &ok );
+                int index = attributes.value( QStringLiteral("id") ).toInt( &ok );
                 if ( !ok )
                     continue;
 
@@ -866,13 +888,36 @@ void PagePrivate::restoreLocalContents( const QDomNode & pageNode )
                 if ( wantedIt == hashedforms.constEnd() )
                     continue;
 
-                QString value = formElement.attribute( QStringLiteral("value") );
+                QString value = attributes.value( QStringLiteral("value") ).toString();
                 (*wantedIt)->d_ptr->setValue( value );
             }
         }
+        else
+        {
+            reader.skipCurrentElement();
+        }
     }
 }
 
+void PagePrivate::restoreLocalContents( const QByteArray & contents )
+{
+    QXmlStreamReader reader( contents );
+    if ( reader.readNextStartElement() && reader.name() == QLatin1String("page") )
+        restoreLocalContents( reader );
+
+    if ( reader.hasError() )
+        qCWarning(OkularCoreDebug).nospace() << "page (" << m_number << "): can't parse the stored contents: " << reader.errorString();
+}
+
+QByteArray PagePrivate::localContents( PageItems what ) const
+{
+    QDomDocument doc;
+    saveLocalContents( doc, doc, what );
+    if ( !doc.hasChildNodes() )
+        return QByteArray();
+    return doc.toByteArray( -1 );
+}
+
 void PagePrivate::saveLocalContents( QDomNode & parentNode, QDomDocument & document, PageItems what ) const
 {
     // create the page node and set the 'number' attribute
@@ -895,11 +940,11 @@ void PagePrivate::saveLocalContents( QDomNode & parentNode, QDomDocument & docum
     // add annotations info if has got any
     if ( ( what & AnnotationPageItems ) && ( what & OriginalAnnotationPageItems ) )
     {
-        const QDomElement savedDocRoot = restoredLocalAnnotationList.documentElement();
-        if ( !savedDocRoot.isNull() )
+        QDomDocument savedDoc;
+        if ( !restoredLocalAnnotationList.isEmpty() && savedDoc.setContent( restoredLocalAnnotationList ) )
         {
             // Import and append node in target document
-            const QDomNode importedNode = document.importNode( savedDocRoot, true );
+            const QDomNode importedNode = document.importNode( savedDoc.documentElement(), true );
             pageElement.appendChild( importedNode );
         }
     }
@@ -959,6 +1004,18 @@ void PagePrivate::saveLocalContents( QDomNode & parentNode, QDomDocument & docum
             pageElement.appendChild( formListElement );
     }
 
+    // add the bounding box, so that it does not need to be computed again
+    // (rendering the page) when the document is opened the next time
+    if ( ( what & BoundingBoxPageItems ) && m_isBoundingBoxKnown )
+    {
+        QDomElement bboxElement = document.createElement( QStringLiteral("boundingBox") );
+        bboxElement.setAttribute( QStringLiteral("l"), m_boundingBox.left );
+        bboxElement.setAttribute( QStringLiteral("t"), m_boundingBox.top );
+        bboxElement.setAttribute( QStringLiteral("r"), m_boundingBox.right );
+        bboxElement.setAttribute( QStringLiteral("b"), m_boundingBox.bottom );
+        pageElement.appendChild( bboxElement );
+    }
+
     // append the page element only if has children
     if ( pageElement.hasChildNodes() )
         parentNode.appendChild( pageElement );
@@ -23,6 +23,7 @@
 #include "area.h"
 
 class QColor;
+class QXmlStreamReader;
 
 namespace Okular {
 
@@ -44,6 +45,7 @@ enum PageItem
     None = 0,
     AnnotationPageItems = 0x01,
     FormFieldPageItems = 0x02,
+    BoundingBoxPageItems = 0x04,
     AllPageItems = 0xff,
 
     /* If set along with AnnotationPageItems, tells saveLocalContents to save
@@ -64,15 +66,33 @@ class PagePrivate
         QTransform rotationMatrix() const;
 
         /**
-         * Loads the local contents (e.g. annotations) of the page.
+         * The estimated number of bytes taken by the text page, if any.
          */
-        void restoreLocalContents( const QDomNode & pageNode );
+        qulonglong textPageMemoryCost() const;
+
+        /**
+         * Loads the local contents (e.g. annotations) of the page from the
+         * page element the @p reader is at, leaving the reader at its end.
+         */
+        void restoreLocalContents( QXmlStreamReader & reader );
 
         /**
          * Saves the local contents (e.g. annotations) of the page.
          */
         void saveLocalContents( QDomNode & parentNode, QDomDocument & document, PageItems what = AllPageItems ) const;
 
+        /**
+         * Loads the local contents of the page from their serialized
+         * page element, as returned by localContents().
+         */
+        void restoreLocalContents( const QByteArray & contents );
+
+        /**
+         * Returns the local contents of the page as a serialized page
+         * element, or an empty array if there is nothing to save.
+         */
+        QByteArray localContents( PageItems what = AllPageItems ) const;
+
         /**
          * Rotates the image and object rects of the page to the given @p orientation.
          */
@@ -143,7 +163,8 @@ class PagePrivate
         QString m_label;
 
         bool m_isBoundingBoxKnown : 1;
-        QDomDocument restoredLocalAnnotationList; // <annotationList>...</annotationList>
+        bool m_pageDataLoaded : 1; // see Generator::loadPageData()
+        QString restoredLocalAnnotationList; // <annotationList>...</annotationList>
 };
 
 }
@@ -0,0 +1,171 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "syncloader_p.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QRegExp>
+#include <QtCore/QStack>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include "debug_p.h"
+#include "tracer_p.h"
+
+using namespace Okular;
+
+SyncLoaderThread::SyncLoaderThread( const QString &docFile )
+    : mDocFile( docFile ), mSynctexScanner( 0 ), mGoOn( 1 )
+{
+}
+
+SyncLoaderThread::~SyncLoaderThread()
+{
+    if ( mSynctexScanner )
+        synctex_scanner_free( mSynctexScanner );
+}
+
+void SyncLoaderThread::startLoading()
+{
+    connect(this, &SyncLoaderThread::finished, this, &SyncLoaderThread::deleteLater);
+    start( QThread::LowPriority );
+}
+
+void SyncLoaderThread::stopLoading()
+{
+    mGoOn.store( 0 );
+}
+
+synctex_scanner_t SyncLoaderThread::takeSynctexScanner()
+{
+    synctex_scanner_t scanner = mSynctexScanner;
+    mSynctexScanner = 0;
+    return scanner;
+}
+
+QHash< int, QVector< PdfSyncPoint > > SyncLoaderThread::takePdfSyncPoints()
+{
+    QHash< int, QVector< PdfSyncPoint > > points;
+    points.swap( mPdfSyncPoints );
+    return points;
+}
+
+void SyncLoaderThread::run()
+{
+    TraceScope trace( "sync", "SyncLoaderThread::run" );
+
+    // no need to check for the existence of a synctex file, no parser will be
+    // created if none exists
+    mSynctexScanner = synctex_scanner_new_with_output_file( QFile::encodeName( mDocFile ).constData(), 0, 1 );
+    if ( !mSynctexScanner && mGoOn.load() && QFile::exists( mDocFile + QLatin1String( "sync" ) ) )
+        loadPdfSync();
+}
+
+void SyncLoaderThread::loadPdfSync()
+{
+    QFile f( mDocFile + QLatin1String( "sync" ) );
+    if ( !f.open( QIODevice::ReadOnly ) )
+        return;
+
+    QTextStream ts( &f );
+    // first row: core name of the pdf output
+    const QString coreName = ts.readLine();
+    // second row: version string, in the form 'Version %u'
+    QString versionstr = ts.readLine();
+    QRegExp versionre( QStringLiteral("Version (\\d+)") );
+    versionre.setCaseSensitivity( Qt::CaseInsensitive );
+    if ( !versionre.exactMatch( versionstr ) )
+        return;
+
+    // the points by id, and the page each one is on
+    QHash<int, PdfSyncPoint> points;
+    QHash<int, int> pointPages;
+    QStack<QString> fileStack;
+    int currentpage = -1;
+    const QLatin1String texStr( ".tex" );
+    const QChar spaceChar = QChar::fromLatin1( ' ' );
+
+    fileStack.push( coreName + texStr );
+
+    QString line;
+    while ( !ts.atEnd() && mGoOn.load() )
+    {
+        line = ts.readLine();
+        const QStringList tokens = line.split( spaceChar, QString::SkipEmptyParts );
+        const int tokenSize = tokens.count();
+        if ( tokenSize < 1 )
+            continue;
+        if ( tokens.first() == QLatin1String( "l" ) && tokenSize >= 3 )
+        {
+            int id = tokens.at( 1 ).toInt();
+            if ( !points.contains( id ) )
+            {
+                PdfSyncPoint pt;
+                pt.x = 0;
+                pt.y = 0;
+                pt.row = tokens.at( 2 ).toInt();
+                pt.column = 0; // TODO
+                pt.file = fileStack.top();
+                points.insert( id, pt );
+            }
+        }
+        else if ( tokens.first() == QLatin1String( "s" ) && tokenSize >= 2 )
+        {
+            currentpage = tokens.at( 1 ).toInt() - 1;
+        }
+        else if ( tokens.first() == QLatin1String( "p*" ) && tokenSize >= 4 )
+        {
+            // TODO
+            qCDebug(OkularCoreDebug) << "PdfSync: 'p*' line ignored";
+        }
+        else if ( tokens.first() == QLatin1String( "p" ) && tokenSize >= 4 )
+        {
+            int id = tokens.at( 1 ).toInt();
+            QHash<int, PdfSyncPoint>::iterator it = points.find( id );
+            if ( it != points.end() )
+            {
+                it->x = tokens.at( 2 ).toInt();
+                it->y = tokens.at( 3 ).toInt();
+                pointPages.insert( id, currentpage );
+            }
+        }
+        else if ( line.startsWith( QLatin1Char( '(' ) ) && tokenSize == 1 )
+        {
+            QString newfile = line;
+            // chop the leading '('
+            newfile.remove( 0, 1 );
+            if ( !newfile.endsWith( texStr ) )
+            {
+                newfile += texStr;
+            }
+            fileStack.push( newfile );
+        }
+        else if ( line == QLatin1String( ")" ) )
+        {
+            if ( !fileStack.isEmpty() )
+            {
+                fileStack.pop();
+            }
+            else
+               qCDebug(OkularCoreDebug) << "PdfSync: going one level down too much";
+        }
+        else
+            qCDebug(OkularCoreDebug).nospace() << "PdfSync: unknown line format: '" << line << "'";
+    }
+
+    // index the points by page, dropping the ones not completely valid
+    QHash<int, int>::const_iterator pIt = pointPages.constBegin(), pEnd = pointPages.constEnd();
+    for ( ; pIt != pEnd; ++pIt )
+    {
+        if ( pIt.value() >= 0 )
+            mPdfSyncPoints[ pIt.value() ].append( points.value( pIt.key() ) );
+    }
+}
+
+#include "moc_syncloader_p.cpp"
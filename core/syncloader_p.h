@@ -0,0 +1,72 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_SYNCLOADER_P_H_
+#define _OKULAR_SYNCLOADER_P_H_
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+#include "synctex/synctex_parser.h"
+
+namespace Okular {
+
+/**
+ * A point of a pdfsync file: a position on a page, in TeX scaled points,
+ * and the place of the source it comes from.
+ */
+struct PdfSyncPoint
+{
+    QString file;
+    qlonglong x;
+    qlonglong y;
+    int row;
+    int column;
+};
+
+/**
+ * Reads the SyncTeX or pdfsync data of a document in a thread, so opening
+ * (and reloading) the document does not wait for it.
+ *
+ * Once finished, the document takes the SyncTeX scanner, or the pdfsync
+ * points indexed by page. The thread deletes itself when finished; the
+ * results that were not taken are freed with it.
+ */
+class SyncLoaderThread : public QThread
+{
+    Q_OBJECT
+
+    public:
+        explicit SyncLoaderThread( const QString &docFile );
+        ~SyncLoaderThread();
+
+        void startLoading();
+        void stopLoading();
+
+        synctex_scanner_t takeSynctexScanner();
+        QHash< int, QVector< PdfSyncPoint > > takePdfSyncPoints();
+
+    protected:
+        void run() override;
+
+    private:
+        void loadPdfSync();
+
+        QString mDocFile;
+        synctex_scanner_t mSynctexScanner;
+        QHash< int, QVector< PdfSyncPoint > > mPdfSyncPoints;
+        QAtomicInt mGoOn;
+};
+
+}
+
+#endif
@@ -171,6 +171,12 @@ class TinyTextEntity
             return transformed_area;
         }
 
+        // the bytes taken by the entity, including its text
+        inline int memoryCost() const
+        {
+            return sizeof( TinyTextEntity ) + ( length > MaxStaticChars ? length * sizeof( QChar ) : 0 );
+        }
+
         NormalizedRect area;
 
     private:
@@ -224,6 +230,14 @@ TextPagePrivate::~TextPagePrivate()
     qDeleteAll( m_words );
 }
 
+qulonglong TextPagePrivate::memoryCost() const
+{
+    qulonglong cost = sizeof( TextPage ) + sizeof( TextPagePrivate );
+    foreach ( const TinyTextEntity *word, m_words )
+        cost += sizeof( TinyTextEntity * ) + word->memoryCost();
+    return cost;
+}
+
 
 TextPage::TextPage()
     : d( new TextPagePrivate() )
@@ -248,13 +262,38 @@ TextPage::~TextPage()
     delete d;
 }
 
+// ASCII text is already in normalization form KC, and most of the text
+// coming from the generators is, so skip the normalization for it
+static inline QString normalizedText( const QString &text )
+{
+    const QChar *c = text.constData();
+    const QChar *end = c + text.length();
+    for ( ; c != end; ++c )
+    {
+        if ( c->unicode() >= 0x80 )
+            return text.normalized( QString::NormalizationForm_KC );
+    }
+    return text;
+}
+
 void TextPage::append( const QString &text, NormalizedRect *area )
 {
     if ( !text.isEmpty() )
-        d->m_words.append( new TinyTextEntity( text.normalized(QString::NormalizationForm_KC), *area ) );
+        d->m_words.append( new TinyTextEntity( normalizedText( text ), *area ) );
     delete area;
 }
 
+void TextPage::append( const QString &text, const NormalizedRect &area )
+{
+    if ( !text.isEmpty() )
+        d->m_words.append( new TinyTextEntity( normalizedText( text ), area ) );
+}
+
+void TextPage::reserve( int count )
+{
+    d->m_words.reserve( count );
+}
+
 struct WordWithCharacters
 {
     WordWithCharacters(TinyTextEntity *w, const TextList &c)
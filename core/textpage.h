@@ -126,6 +126,25 @@ class OKULARCORE_EXPORT TextPage
          */
         void append( const QString &text, NormalizedRect *area );
 
+        /**
+         * Appends the given @p text with the given @p area as new
+         * @ref TextEntity to the page.
+         *
+         * Unlike the other overload it does not need a heap allocated
+         * area, so it is the one to use when adding many characters.
+         *
+         * @since 1.2
+         */
+        void append( const QString &text, const NormalizedRect &area );
+
+        /**
+         * Allocates room for @p count text entities in advance, to be
+         * called before appending a known number of them.
+         *
+         * @since 1.2
+         */
+        void reserve( int count );
+
         /**
          * Returns the bounding rect of the text which matches the following criteria
          * or 0 if the search is not successful.
@@ -65,6 +65,11 @@ class TextPagePrivate
          */
         void correctTextOrder();
 
+        /**
+         * The estimated number of bytes taken by the text page
+         */
+        qulonglong memoryCost() const;
+
         // variables those can be accessed directly from TextPage
         TextList m_words;
         QMap< int, SearchPoint* > m_searchPoints;
@@ -0,0 +1,179 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "tracer_p.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+
+#include "debug_p.h"
+
+// the size of the buffered events that makes them be written (bytes)
+#define TRACE_BUFFER_SIZE 262144
+
+using namespace Okular;
+
+class TraceWriter
+{
+    public:
+        TraceWriter()
+            : m_file( QFile::decodeName( qgetenv( "OKULAR_TRACE_FILE" ) ) ), m_eventCount( 0 )
+        {
+            m_clock.start();
+            if ( !m_file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+                qCWarning(OkularCoreDebug) << "Could not open the trace file" << m_file.fileName();
+            else
+                m_file.write( "[\n" );
+        }
+
+        ~TraceWriter()
+        {
+            if ( !m_file.isOpen() )
+                return;
+
+            flush();
+            m_file.write( "\n]\n" );
+            m_file.close();
+        }
+
+        qint64 timestamp() const
+        {
+            return m_clock.nsecsElapsed() / 1000;
+        }
+
+        void add( QJsonObject event )
+        {
+            event.insert( QStringLiteral( "pid" ), (double)QCoreApplication::applicationPid() );
+
+            QMutexLocker locker( &m_mutex );
+            if ( !m_file.isOpen() )
+                return;
+
+            // use small numbers for the threads, and name them
+            Qt::HANDLE thread = QThread::currentThreadId();
+            QHash< Qt::HANDLE, int >::const_iterator it = m_threads.constFind( thread );
+            if ( it == m_threads.constEnd() )
+            {
+                it = m_threads.insert( thread, m_threads.count() + 1 );
+
+                QThread *qthread = QThread::currentThread();
+                QString threadName = qthread->objectName();
+                if ( threadName.isEmpty() && QCoreApplication::instance() && qthread == QCoreApplication::instance()->thread() )
+                    threadName = QStringLiteral( "main" );
+                else if ( threadName.isEmpty() )
+                    threadName = QString::fromLatin1( qthread->metaObject()->className() );
+
+                QJsonObject args;
+                args.insert( QStringLiteral( "name" ), threadName );
+                QJsonObject metadata;
+                metadata.insert( QStringLiteral( "name" ), QStringLiteral( "thread_name" ) );
+                metadata.insert( QStringLiteral( "ph" ), QStringLiteral( "M" ) );
+                metadata.insert( QStringLiteral( "pid" ), (double)QCoreApplication::applicationPid() );
+                metadata.insert( QStringLiteral( "tid" ), *it );
+                metadata.insert( QStringLiteral( "args" ), args );
+                append( metadata );
+            }
+            event.insert( QStringLiteral( "tid" ), *it );
+            append( event );
+
+            if ( m_buffer.size() >= TRACE_BUFFER_SIZE )
+                flush();
+        }
+
+    private:
+        void append( const QJsonObject &event )
+        {
+            if ( m_eventCount++ > 0 )
+                m_buffer += ",\n";
+            m_buffer += QJsonDocument( event ).toJson( QJsonDocument::Compact );
+        }
+
+        void flush()
+        {
+            m_file.write( m_buffer );
+            m_file.flush();
+            m_buffer.clear();
+        }
+
+        QElapsedTimer m_clock;
+        QMutex m_mutex;
+        QFile m_file;
+        QByteArray m_buffer;
+        QHash< Qt::HANDLE, int > m_threads;
+        int m_eventCount;
+};
+
+Q_GLOBAL_STATIC( TraceWriter, traceWriter )
+
+static QJsonObject traceEvent( const char *category, const char *name, const char *phase, qint64 timestamp, const QVariantMap &args )
+{
+    QJsonObject event;
+    event.insert( QStringLiteral( "cat" ), QLatin1String( category ) );
+    event.insert( QStringLiteral( "name" ), QLatin1String( name ) );
+    event.insert( QStringLiteral( "ph" ), QLatin1String( phase ) );
+    event.insert( QStringLiteral( "ts" ), (double)timestamp );
+    if ( !args.isEmpty() )
+        event.insert( QStringLiteral( "args" ), QJsonObject::fromVariantMap( args ) );
+    return event;
+}
+
+static void addAsyncEvent( const char *category, const char *name, const char *phase, quint64 id, const QVariantMap &args )
+{
+    if ( !Tracer::isEnabled() )
+        return;
+
+    TraceWriter *writer = traceWriter();
+    QJsonObject event = traceEvent( category, name, phase, writer->timestamp(), args );
+    // as a string, the ids are not rounded to doubles
+    event.insert( QStringLiteral( "id" ), QStringLiteral( "0x%1" ).arg( id, 0, 16 ) );
+    writer->add( event );
+}
+
+bool Tracer::isEnabled()
+{
+    static const bool enabled = !qEnvironmentVariableIsEmpty( "OKULAR_TRACE_FILE" );
+    return enabled;
+}
+
+qint64 Tracer::timestamp()
+{
+    return isEnabled() ? traceWriter()->timestamp() : 0;
+}
+
+void Tracer::asyncBegin( const char *category, const char *name, quint64 id, const QVariantMap &args )
+{
+    addAsyncEvent( category, name, "b", id, args );
+}
+
+void Tracer::asyncStep( const char *category, const char *name, quint64 id, const QVariantMap &args )
+{
+    addAsyncEvent( category, name, "n", id, args );
+}
+
+void Tracer::asyncEnd( const char *category, const char *name, quint64 id, const QVariantMap &args )
+{
+    addAsyncEvent( category, name, "e", id, args );
+}
+
+void Tracer::complete( const char *category, const char *name, qint64 start, const QVariantMap &args )
+{
+    if ( !isEnabled() )
+        return;
+
+    TraceWriter *writer = traceWriter();
+    QJsonObject event = traceEvent( category, name, "X", start, args );
+    event.insert( QStringLiteral( "dur" ), (double)( writer->timestamp() - start ) );
+    writer->add( event );
+}
@@ -0,0 +1,80 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_TRACER_P_H_
+#define _OKULAR_TRACER_P_H_
+
+#include "okularcore_export.h"
+
+#include <QtCore/QVariantMap>
+
+namespace Okular {
+
+/* Records trace events in the Chrome trace event format (a JSON array),
+ * that can be opened by chrome://tracing, Perfetto and the like.
+ *
+ * Tracing is enabled by setting the OKULAR_TRACE_FILE environment variable
+ * to the file to write; otherwise isEnabled() is false and the events are
+ * dropped. As the arguments of the events are built by the callers, they
+ * should check isEnabled() first. The events are buffered and written to
+ * the file from time to time and when the application exits. */
+class OKULARCORE_EXPORT Tracer
+{
+    public:
+        static bool isEnabled();
+
+        // microseconds since the start of the trace
+        static qint64 timestamp();
+
+        // the events of an operation that can begin and end in different
+        // functions or threads, like a pixmap request; all the events of an
+        // operation must have the same category and id, and the begin and
+        // end events the same name
+        static void asyncBegin( const char *category, const char *name, quint64 id, const QVariantMap &args = QVariantMap() );
+        static void asyncStep( const char *category, const char *name, quint64 id, const QVariantMap &args = QVariantMap() );
+        static void asyncEnd( const char *category, const char *name, quint64 id, const QVariantMap &args = QVariantMap() );
+
+        // an operation of the current thread that began at 'start' (as
+        // returned by timestamp()) and ends now
+        static void complete( const char *category, const char *name, qint64 start, const QVariantMap &args = QVariantMap() );
+};
+
+/* Records the scope it lives in as a complete event of the current thread. */
+class TraceScope
+{
+    public:
+        TraceScope( const char *category, const char *name )
+            : m_category( category ), m_name( name ), m_start( Tracer::isEnabled() ? Tracer::timestamp() : -1 )
+        {
+        }
+
+        ~TraceScope()
+        {
+            if ( m_start >= 0 )
+                Tracer::complete( m_category, m_name, m_start, m_args );
+        }
+
+        void setArg( const QString &key, const QVariant &value )
+        {
+            if ( m_start >= 0 )
+                m_args.insert( key, value );
+        }
+
+    private:
+        Q_DISABLE_COPY( TraceScope )
+
+        const char *m_category;
+        const char *m_name;
+        qint64 m_start;
+        QVariantMap m_args;
+};
+
+}
+
+#endif
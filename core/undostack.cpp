@@ -0,0 +1,318 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "undostack_p.h"
+
+// local includes
+#include "debug_p.h"
+
+using namespace Okular;
+
+UndoCommand::UndoCommand()
+    : m_obsolete( false )
+{
+}
+
+qint64 UndoCommand::memoryCost() const
+{
+    return sizeof( UndoCommand ) + text().size() * sizeof( QChar );
+}
+
+void UndoCommand::setObsolete( bool obsolete )
+{
+    m_obsolete = obsolete;
+}
+
+bool UndoCommand::isObsolete() const
+{
+    return m_obsolete;
+}
+
+class UndoStack::MacroCommand : public UndoCommand
+{
+    public:
+        explicit MacroCommand( const QString &text )
+            : m_depth( 1 )
+        {
+            setText( text );
+        }
+
+        ~MacroCommand()
+        {
+            qDeleteAll( m_children );
+        }
+
+        void undo() override
+        {
+            for ( int i = m_children.count() - 1; i >= 0; --i )
+                m_children.at( i )->undo();
+            removeObsoleteChildren();
+        }
+
+        void redo() override
+        {
+            foreach ( UndoCommand *child, m_children )
+                child->redo();
+            removeObsoleteChildren();
+        }
+
+        qint64 memoryCost() const override
+        {
+            qint64 cost = UndoCommand::memoryCost();
+            foreach ( UndoCommand *child, m_children )
+                cost += child->memoryCost();
+            return cost;
+        }
+
+        // the obsolete children did not change anything, so the macro keeps
+        // the others and is obsolete once it has none left
+        void removeObsoleteChildren()
+        {
+            for ( int i = m_children.count() - 1; i >= 0; --i )
+            {
+                if ( m_children.at( i )->isObsolete() )
+                    delete m_children.takeAt( i );
+            }
+            setObsolete( m_children.isEmpty() );
+        }
+
+        QList< UndoCommand * > m_children;
+        // nested beginMacro() calls all add to the outermost macro
+        int m_depth;
+};
+
+UndoStack::UndoStack( QObject *parent )
+    : QObject( parent ), m_index( 0 ), m_macro( 0 ), m_memoryBudget( 0 ), m_memoryCost( 0 )
+{
+}
+
+UndoStack::~UndoStack()
+{
+    delete m_macro;
+    qDeleteAll( m_commands );
+}
+
+void UndoStack::push( UndoCommand *cmd )
+{
+    cmd->redo();
+    if ( cmd->isObsolete() )
+    {
+        delete cmd;
+        return;
+    }
+
+    if ( m_macro )
+    {
+        m_macro->m_children.append( cmd );
+        return;
+    }
+
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+
+    // the undone commands can not be redone any more
+    while ( m_commands.count() > m_index )
+        removeCommand( m_commands.count() - 1 );
+
+    UndoCommand *last = m_index > 0 ? m_commands.at( m_index - 1 ) : 0;
+    if ( last && cmd->id() != -1 && cmd->id() == last->id() && last->mergeWith( cmd ) )
+    {
+        delete cmd;
+        updateCost( m_index - 1 );
+    }
+    else
+    {
+        appendCommand( cmd );
+        ++m_index;
+    }
+
+    trimToBudget();
+    emitChanges( couldUndo, couldRedo );
+}
+
+void UndoStack::beginMacro( const QString &text )
+{
+    if ( m_macro )
+    {
+        ++m_macro->m_depth;
+        return;
+    }
+
+    m_macro = new MacroCommand( text );
+}
+
+void UndoStack::endMacro()
+{
+    if ( !m_macro )
+    {
+        qCWarning(OkularCoreDebug) << "endMacro() without beginMacro()";
+        return;
+    }
+
+    if ( --m_macro->m_depth > 0 )
+        return;
+
+    MacroCommand *macro = m_macro;
+    m_macro = 0;
+
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+
+    // the commands of the macro were already executed when pushed
+    while ( m_commands.count() > m_index )
+        removeCommand( m_commands.count() - 1 );
+    appendCommand( macro );
+    ++m_index;
+
+    trimToBudget();
+    emitChanges( couldUndo, couldRedo );
+}
+
+bool UndoStack::canUndo() const
+{
+    return !m_macro && m_index > 0;
+}
+
+bool UndoStack::canRedo() const
+{
+    return !m_macro && m_index < m_commands.count();
+}
+
+void UndoStack::undo()
+{
+    if ( !canUndo() )
+        return;
+
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+
+    --m_index;
+    m_commands.at( m_index )->undo();
+    updateCost( m_index );
+
+    emitChanges( couldUndo, couldRedo );
+}
+
+void UndoStack::redo()
+{
+    if ( !canRedo() )
+        return;
+
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+
+    m_commands.at( m_index )->redo();
+    // an obsolete command is dropped, so the index moves only over the
+    // commands that are still there
+    const int count = m_commands.count();
+    updateCost( m_index );
+    if ( m_commands.count() == count )
+        ++m_index;
+
+    emitChanges( couldUndo, couldRedo );
+}
+
+void UndoStack::clear()
+{
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+
+    delete m_macro;
+    m_macro = 0;
+    qDeleteAll( m_commands );
+    m_commands.clear();
+    m_costs.clear();
+    m_memoryCost = 0;
+    m_index = 0;
+
+    emitChanges( couldUndo, couldRedo );
+}
+
+int UndoStack::count() const
+{
+    return m_commands.count();
+}
+
+int UndoStack::index() const
+{
+    return m_index;
+}
+
+void UndoStack::setMemoryBudget( qint64 bytes )
+{
+    m_memoryBudget = bytes;
+
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+    trimToBudget();
+    emitChanges( couldUndo, couldRedo );
+}
+
+qint64 UndoStack::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+qint64 UndoStack::memoryCost() const
+{
+    return m_memoryCost;
+}
+
+void UndoStack::appendCommand( UndoCommand *cmd )
+{
+    const qint64 cost = cmd->memoryCost();
+    m_commands.append( cmd );
+    m_costs.append( cost );
+    m_memoryCost += cost;
+}
+
+void UndoStack::removeCommand( int i )
+{
+    m_memoryCost -= m_costs.takeAt( i );
+    delete m_commands.takeAt( i );
+}
+
+void UndoStack::updateCost( int i )
+{
+    if ( m_commands.at( i )->isObsolete() )
+    {
+        removeCommand( i );
+        return;
+    }
+
+    // the cost of a command depends on its state (e.g. a removed annotation
+    // belongs to its command), so only the command that changed is measured
+    const qint64 cost = m_commands.at( i )->memoryCost();
+    m_memoryCost += cost - m_costs.at( i );
+    m_costs[ i ] = cost;
+}
+
+void UndoStack::trimToBudget()
+{
+    if ( m_memoryBudget <= 0 )
+        return;
+
+    // drop the oldest executed commands, but always keep the last one so
+    // that the latest change can be undone
+    while ( m_memoryCost > m_memoryBudget && m_index > 1 )
+    {
+        removeCommand( 0 );
+        --m_index;
+    }
+}
+
+void UndoStack::emitChanges( bool couldUndo, bool couldRedo )
+{
+    if ( canUndo() != couldUndo )
+        emit canUndoChanged( canUndo() );
+    if ( canRedo() != couldRedo )
+        emit canRedoChanged( canRedo() );
+}
+
+#include "moc_undostack_p.cpp"
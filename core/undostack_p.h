@@ -0,0 +1,106 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_UNDOSTACK_P_H_
+#define _OKULAR_UNDOSTACK_P_H_
+
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtWidgets/QUndoCommand>
+
+namespace Okular {
+
+/* An undo command that can tell how much memory it keeps alive. */
+class UndoCommand : public QUndoCommand
+{
+    public:
+        UndoCommand();
+
+        // estimated number of bytes held by the command; it can change
+        // after undo(), redo() and mergeWith()
+        virtual qint64 memoryCost() const;
+
+        // a command that could not be undone or redone, e.g. because what
+        // it applies to changed outside of the undo stack, marks itself
+        // obsolete and the stack drops it (QUndoCommand::setObsolete()
+        // needs Qt 5.9)
+        void setObsolete( bool obsolete );
+        bool isObsolete() const;
+
+    private:
+        bool m_obsolete;
+};
+
+/* The undo history of a document.
+ *
+ * It works like QUndoStack (commands are executed when pushed, consecutive
+ * commands with the same id() are merged, macros group commands in a single
+ * step) but the history is bounded by the memory taken by its commands
+ * instead of by their number: when a push takes the history over the
+ * budget the oldest commands are dropped. QUndoStack cannot drop commands
+ * once it has some, hence this class. */
+class UndoStack : public QObject
+{
+    Q_OBJECT
+
+    public:
+        explicit UndoStack( QObject *parent = 0 );
+        ~UndoStack();
+
+        // executes the command and takes its ownership
+        void push( UndoCommand *cmd );
+
+        void beginMacro( const QString &text );
+        void endMacro();
+
+        bool canUndo() const;
+        bool canRedo() const;
+        void undo();
+        void redo();
+
+        // deletes all the commands
+        void clear();
+
+        int count() const;
+        int index() const;
+
+        // the memory budget of the history in bytes, 0 means unbounded
+        void setMemoryBudget( qint64 bytes );
+        qint64 memoryBudget() const;
+        qint64 memoryCost() const;
+
+    signals:
+        void canUndoChanged( bool canUndo );
+        void canRedoChanged( bool canRedo );
+
+    private:
+        void appendCommand( UndoCommand *cmd );
+        void removeCommand( int i );
+        // measures again the command at i after it changed, or drops it
+        // if it became obsolete
+        void updateCost( int i );
+        void trimToBudget();
+        void emitChanges( bool couldUndo, bool couldRedo );
+
+        class MacroCommand;
+
+        QList< UndoCommand * > m_commands;
+        // number of executed commands, the next one to undo is m_index - 1
+        int m_index;
+        MacroCommand *m_macro;
+        qint64 m_memoryBudget;
+        // the costs of the commands, as measured when they last changed,
+        // and their sum
+        QList< qint64 > m_costs;
+        qint64 m_memoryCost;
+};
+
+}
+
+#endif
@@ -19,9 +19,16 @@
 #include <QDesktopWidget>
 #include <QImage>
 #include <QIODevice>
+#include <QXmlStreamReader>
+#include <QtXml/QDomDocument>
+#include <QtXml/QDomElement>
 #include <QWindow>
 #include <QScreen>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef Q_OS_MAC
 #include <ApplicationServices/ApplicationServices.h>
 #include <IOKit/graphics/IOGraphicsLib.h>
@@ -164,15 +171,62 @@ inline static bool isPaperColor( QRgb argb, QRgb paperColor ) {
     return ( argb & 0xFFFFFF ) == ( paperColor & 0xFFFFFF); // ignore alpha
 }
 
+// Return the index of the first non paper color pixel of 'line' in the
+// [from, to) range, or -1 if there is none
+static int firstNonPaperPixel( const QRgb *line, int from, int to, QRgb paperColor )
+{
+    int x = from;
+#ifdef __SSE2__
+    // skip four paper pixels at a time
+    const __m128i mask = _mm_set1_epi32( 0xFFFFFF );
+    const __m128i paper = _mm_set1_epi32( paperColor & 0xFFFFFF );
+    for ( ; x + 4 <= to; x += 4 )
+    {
+        const __m128i pixels = _mm_and_si128( _mm_loadu_si128( reinterpret_cast< const __m128i * >( line + x ) ), mask );
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi32( pixels, paper ) ) != 0xFFFF )
+            break;
+    }
+#endif
+    for ( ; x < to; ++x )
+        if ( !isPaperColor( line[ x ], paperColor ) )
+            return x;
+    return -1;
+}
+
+// Return the index of the last non paper color pixel of 'line' in the
+// [from, to) range, or -1 if there is none
+static int lastNonPaperPixel( const QRgb *line, int from, int to, QRgb paperColor )
+{
+    int x = to;
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32( 0xFFFFFF );
+    const __m128i paper = _mm_set1_epi32( paperColor & 0xFFFFFF );
+    for ( ; x - 4 >= from; x -= 4 )
+    {
+        const __m128i pixels = _mm_and_si128( _mm_loadu_si128( reinterpret_cast< const __m128i * >( line + x - 4 ) ), mask );
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi32( pixels, paper ) ) != 0xFFFF )
+            break;
+    }
+#endif
+    for ( --x; x >= from; --x )
+        if ( !isPaperColor( line[ x ], paperColor ) )
+            return x;
+    return -1;
+}
+
 NormalizedRect Utils::imageBoundingBox( const QImage * image )
 {
     if ( !image )
         return NormalizedRect();
 
-    const int width = image->width();
-    const int height = image->height();
+    // scan the raw pixels of the image, converting it once if its pixels are
+    // not plain 32 bit RGB values (rather than converting each pixel)
+    const QImage source = ( image->format() == QImage::Format_RGB32 || image->format() == QImage::Format_ARGB32 )
+                          ? *image : image->convertToFormat( QImage::Format_ARGB32 );
+    const int width = source.width();
+    const int height = source.height();
     const QRgb paperColor = SettingsCore::paperColor().rgb();
-    int left, top, bottom, right, x, y;
+    int left, top, bottom, right, x = -1, y;
 
 #ifdef BBOX_DEBUG
     QTime time;
@@ -181,34 +235,30 @@ NormalizedRect Utils::imageBoundingBox( const QImage * image )
 
     // Scan pixels for top non-white
     for ( top = 0; top < height; ++top )
-        for ( x = 0; x < width; ++x )
-            if ( !isPaperColor( image->pixel( x, top ), paperColor ) )
-                goto got_top;
-    return NormalizedRect( 0, 0, 0, 0 ); // the image is blank
-got_top:
+        if ( ( x = firstNonPaperPixel( reinterpret_cast< const QRgb * >( source.constScanLine( top ) ), 0, width, paperColor ) ) != -1 )
+            break;
+    if ( top == height )
+        return NormalizedRect( 0, 0, 0, 0 ); // the image is blank
     left = right = x;
 
-    // Scan pixels for bottom non-white
+    // Scan pixels for bottom non-white (the top line has some for sure)
     for ( bottom = height-1; bottom >= top; --bottom )
-        for ( x = width-1; x >= 0; --x )
-            if ( !isPaperColor( image->pixel( x, bottom ), paperColor ) )
-                goto got_bottom;
-    Q_ASSERT( 0 ); // image changed?!
-got_bottom:
+        if ( ( x = lastNonPaperPixel( reinterpret_cast< const QRgb * >( source.constScanLine( bottom ) ), 0, width, paperColor ) ) != -1 )
+            break;
     if ( x < left )
         left = x;
     if ( x > right )
         right = x;
 
     // Scan for leftmost and rightmost (we already found some bounds on these):
+    // only the pixels outside of the current bounds need to be checked
     for ( y = top; y <= bottom && ( left > 0 || right < width-1 ); ++y )
     {
-        for ( x = 0; x < left; ++x )
-            if ( !isPaperColor( image->pixel( x, y ), paperColor ) )
-                left = x;
-        for ( x = width-1; x > right+1; --x )
-            if ( !isPaperColor( image->pixel( x, y ), paperColor ) )
-                right = x;
+        const QRgb *line = reinterpret_cast< const QRgb * >( source.constScanLine( y ) );
+        if ( left > 0 && ( x = firstNonPaperPixel( line, 0, left, paperColor ) ) != -1 )
+            left = x;
+        if ( right < width-1 && ( x = lastNonPaperPixel( line, right+1, width, paperColor ) ) != -1 )
+            right = x;
     }
 
     NormalizedRect bbox( QRect( left, top, ( right - left + 1), ( bottom - top + 1 ) ),
@@ -234,6 +284,34 @@ void Okular::copyQIODevice( QIODevice *from, QIODevice *to )
     }
 }
 
+QDomElement Okular::readDomElement( QXmlStreamReader &reader, QDomDocument &document )
+{
+    QDomElement element = document.createElement( reader.name().toString() );
+    foreach ( const QXmlStreamAttribute &attribute, reader.attributes() )
+        element.setAttribute( attribute.name().toString(), attribute.value().toString() );
+
+    while ( !reader.atEnd() )
+    {
+        switch ( reader.readNext() )
+        {
+            case QXmlStreamReader::StartElement:
+                element.appendChild( readDomElement( reader, document ) );
+                break;
+            case QXmlStreamReader::Characters:
+                // like QDomDocument::setContent(), drop the whitespace-only text
+                if ( !reader.isWhitespace() )
+                    element.appendChild( document.createTextNode( reader.text().toString() ) );
+                break;
+            case QXmlStreamReader::EndElement:
+                return element;
+            default:
+                break;
+        }
+    }
+
+    return element;
+}
+
 QTransform Okular::buildRotationMatrix(Rotation rotation)
 {
     QTransform matrix;
@@ -10,7 +10,10 @@
 #ifndef _OKULAR_UTILS_P_H_
 #define _OKULAR_UTILS_P_H_
 
+class QDomDocument;
+class QDomElement;
 class QIODevice;
+class QXmlStreamReader;
 
 namespace Okular
 {
@@ -22,6 +25,15 @@ void copyQIODevice( QIODevice *from, QIODevice *to );
  */
 QTransform buildRotationMatrix( Rotation rotation );
 
+/**
+ * Returns a new element of @p document with the contents of the element the
+ * @p reader is at, leaving the reader at its end.
+ *
+ * To be used where a DOM is needed for single elements of big files that are
+ * otherwise read as a stream.
+ */
+QDomElement readDomElement( QXmlStreamReader &reader, QDomDocument &document );
+
 }
 
 #endif
@@ -223,7 +223,7 @@ void CHMGenerator::slotCompleted()
 
     if ( !req->page()->isBoundingBoxKnown() )
         updatePageBoundingBox( req->page()->number(), Okular::Utils::imageBoundingBox( &image ) );
-    req->page()->setPixmap( req->observer(), new QPixmap( QPixmap::fromImage( image ) ) );
+    req->page()->setPixmap( req->observer(), new QPixmap( QPixmap::fromImage( std::move( image ) ) ) );
     signalPixmapRequestDone( req );
 }
 
@@ -209,19 +209,47 @@ QVariant DjVuGenerator::metaData( const QString &key, const QVariant &option ) c
 Okular::TextPage* DjVuGenerator::textPage( Okular::Page *page )
 {
     userMutex()->lock();
+    const QList<KDjVu::TextEntity> te = textEntities( page->number() );
+    userMutex()->unlock();
+    return textPageFromEntities( page->number(), te );
+}
+
+QVector<Okular::TextPage*> DjVuGenerator::textPages( const QVector<Okular::Page*> &pages )
+{
+    // take the lock only once to get the text of all the pages
+    QVector< QList<KDjVu::TextEntity> > entities;
+    entities.reserve( pages.count() );
+    userMutex()->lock();
+    foreach ( Okular::Page *page, pages )
+        entities.append( textEntities( page->number() ) );
+    userMutex()->unlock();
+
+    QVector<Okular::TextPage*> tps;
+    tps.reserve( pages.count() );
+    for ( int i = 0; i < pages.count(); ++i )
+        tps.append( textPageFromEntities( pages.at( i )->number(), entities.at( i ) ) );
+    return tps;
+}
+
+QList<KDjVu::TextEntity> DjVuGenerator::textEntities( int page ) const
+{
     QList<KDjVu::TextEntity> te;
 #if 0
-    m_djvu->textEntities( page->number(), "char" );
+    m_djvu->textEntities( page, "char" );
 #endif
     if ( te.isEmpty() )
-        te = m_djvu->textEntities( page->number(), QStringLiteral("word") );
+        te = m_djvu->textEntities( page, QStringLiteral("word") );
     if ( te.isEmpty() )
-        te = m_djvu->textEntities( page->number(), QStringLiteral("line") );
-    userMutex()->unlock();
+        te = m_djvu->textEntities( page, QStringLiteral("line") );
+    return te;
+}
+
+Okular::TextPage* DjVuGenerator::textPageFromEntities( int page, const QList<KDjVu::TextEntity> &te ) const
+{
     QList<KDjVu::TextEntity>::ConstIterator it = te.constBegin();
     QList<KDjVu::TextEntity>::ConstIterator itEnd = te.constEnd();
     QList<Okular::TextEntity*> words;
-    const KDjVu::Page* djvupage = m_djvu->pages().at( page->number() );
+    const KDjVu::Page* djvupage = m_djvu->pages().at( page );
     for ( ; it != itEnd; ++it )
     {
         const KDjVu::TextEntity& cur = *it;
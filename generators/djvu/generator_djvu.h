@@ -44,9 +44,13 @@ class DjVuGenerator : public Okular::Generator
         // pixmap generation
         QImage image( Okular::PixmapRequest *request ) override;
         Okular::TextPage* textPage( Okular::Page *page ) override;
+        QVector<Okular::TextPage*> textPages( const QVector<Okular::Page*> &pages ) override;
 
     private:
         void loadPages( QVector<Okular::Page*> & pagesVector, int rotation );
+        // to be called with userMutex() locked
+        QList<KDjVu::TextEntity> textEntities( int page ) const;
+        Okular::TextPage* textPageFromEntities( int page, const QList<KDjVu::TextEntity> &te ) const;
         Okular::ObjectRect* convertKDjVuLink( int page, KDjVu::Link * link ) const;
         Okular::Annotation* convertKDjVuAnnotation( int w, int h, KDjVu::Annotation * ann ) const;
 
@@ -2,7 +2,62 @@
 #include <config.h>
 
 #include "TeXFont.h"
+#include "glyphcache.h"
 
 
 TeXFont::~TeXFont()
-{}
+{
+  GlyphCache::instance()->removeFont(this);
+}
+
+
+void TeXFont::clearShrunkenCharacters()
+{
+  releaseShrunkenCharacter();
+  GlyphCache::instance()->removeFont(this);
+}
+
+
+bool TeXFont::findShrunkenCharacter(quint16 character, const QColor& color)
+{
+  glyph *g = glyphtable+character;
+
+  if (heldGlyph == g) {
+    if (!g->shrunkenCharacter.isNull() && (color == g->color))
+      return true;
+  } else {
+    releaseShrunkenCharacter();
+    heldGlyph = g;
+  }
+
+  GlyphCache::Glyph cached;
+  if (!GlyphCache::instance()->find(this, character, parent->displayResolution_in_dpi, color, &cached))
+    return false;
+
+  g->color             = color;
+  g->shrunkenCharacter = cached.shrunkenCharacter;
+  g->x2                = cached.x2;
+  g->y2                = cached.y2;
+  return true;
+}
+
+
+void TeXFont::storeShrunkenCharacter(quint16 character)
+{
+  const glyph *g = glyphtable+character;
+
+  GlyphCache::Glyph cached;
+  cached.shrunkenCharacter = g->shrunkenCharacter;
+  cached.x2                = g->x2;
+  cached.y2                = g->y2;
+  GlyphCache::instance()->insert(this, character, parent->displayResolution_in_dpi, g->color, cached);
+}
+
+
+void TeXFont::releaseShrunkenCharacter()
+{
+  if (heldGlyph != 0) {
+    heldGlyph->shrunkenCharacter = QImage();
+    heldGlyph = 0;
+  }
+}
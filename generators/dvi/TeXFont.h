@@ -18,17 +18,23 @@ class TeXFont {
   TeXFont(TeXFontDefinition *_parent)
     {
       parent       = _parent;
+      heldGlyph    = 0;
       errorMessage.clear();
     }
 
   virtual ~TeXFont();
 
+  // The characters shrunken at the other resolutions stay in the glyph
+  // cache, in case the resolution changes back.
   void setDisplayResolution()
     {
-      for(unsigned int i=0; i<TeXFontDefinition::max_num_of_chars_in_font; i++)
-        glyphtable[i].shrunkenCharacter = QImage();
+      releaseShrunkenCharacter();
     }
 
+  // Drops all the shrunken characters of the font, for when they would
+  // be shrunken differently at the same resolution.
+  void clearShrunkenCharacters();
+
   virtual glyph* getGlyph(quint16 character, bool generateCharacterPixmap=false, const QColor& color=Qt::black) = 0;
 
   // Checksum of the font. Used e.g. by PK fonts. This field is filled
@@ -41,8 +47,24 @@ class TeXFont {
   QString            errorMessage;
 
  protected:
+  // Used by getGlyph(): looks the character shrunken at the current
+  // resolution and in the given color up in the glyph cache, and sets
+  // it in the glyphtable. Returns false if it must be shrunken.
+  bool findShrunkenCharacter(quint16 character, const QColor& color);
+
+  // Adds the character just shrunken to the glyph cache.
+  void storeShrunkenCharacter(quint16 character);
+
   glyph              glyphtable[TeXFontDefinition::max_num_of_chars_in_font];
   TeXFontDefinition *parent;
+
+ private:
+  void releaseShrunkenCharacter();
+
+  // The shrunken characters are kept by the glyph cache; the
+  // glyphtable only has the one of the last character returned by
+  // getGlyph(), for the renderer to draw.
+  glyph             *heldGlyph;
 };
 
 #endif
@@ -157,7 +157,7 @@ glyph* TeXFont_PFB::getGlyph(quint16 ch, bool generateCharacterPixmap, const QCo
   if (fatalErrorInFontLoading == true)
     return g;
 
-  if ((generateCharacterPixmap == true) && ((g->shrunkenCharacter.isNull()) || (color != g->color)) ) {
+  if ((generateCharacterPixmap == true) && !findShrunkenCharacter(ch, color)) {
     int error;
     unsigned int res =  (unsigned int)(parent->displayResolution_in_dpi/parent->enlargement +0.5);
     g->color = color;
@@ -174,6 +174,7 @@ glyph* TeXFont_PFB::getGlyph(quint16 ch, bool generateCharacterPixmap, const QCo
       qCCritical(OkularDviDebug) << msg << endl;
       g->shrunkenCharacter = QImage(1, 1, QImage::Format_RGB32);
       g->shrunkenCharacter.fill(qRgb(255, 255, 255));
+      storeShrunkenCharacter(ch);
       return g;
     }
 
@@ -190,6 +191,7 @@ glyph* TeXFont_PFB::getGlyph(quint16 ch, bool generateCharacterPixmap, const QCo
       qCCritical(OkularDviDebug) << msg << endl;
       g->shrunkenCharacter = QImage(1, 1, QImage::Format_RGB32);
       g->shrunkenCharacter.fill(qRgb(255, 255, 255));
+      storeShrunkenCharacter(ch);
       return g;
     }
 
@@ -202,6 +204,7 @@ glyph* TeXFont_PFB::getGlyph(quint16 ch, bool generateCharacterPixmap, const QCo
       qCCritical(OkularDviDebug) << msg << endl;
       g->shrunkenCharacter = QImage(1, 1, QImage::Format_RGB32);
       g->shrunkenCharacter.fill(qRgb(255, 255, 255));
+      storeShrunkenCharacter(ch);
       return g;
     }
 
@@ -272,6 +275,7 @@ glyph* TeXFont_PFB::getGlyph(quint16 ch, bool generateCharacterPixmap, const QCo
       g->x2 = -slot->bitmap_left;
       g->y2 = slot->bitmap_top;
     }
+    storeShrunkenCharacter(ch);
   }
 
   // Load glyph width, if that hasn't been done yet.
@@ -160,8 +160,8 @@ glyph* TeXFont_PK::getGlyph(quint16 ch, bool generateCharacterPixmap, const QCol
   // At this point, g points to a properly loaded character. Generate
   // a smoothly scaled QPixmap if the user asks for it.
   if ((generateCharacterPixmap == true) &&
-      ((g->shrunkenCharacter.isNull()) || (color != g->color)) &&
-      (characterBitmaps[ch]->w != 0)) {
+      (characterBitmaps[ch]->w != 0) &&
+      !findShrunkenCharacter(ch, color)) {
     g->color = color;
     double shrinkFactor = 1200 / parent->displayResolution_in_dpi;
 
@@ -312,6 +312,7 @@ glyph* TeXFont_PK::getGlyph(quint16 ch, bool generateCharacterPixmap, const QCol
     }
 
     g->shrunkenCharacter = im32;
+    storeShrunkenCharacter(ch);
   }
   return g;
 }
@@ -107,11 +107,11 @@ void fontPool::setParameters( bool _useFontHints )
 {
   // Check if glyphs need to be cleared
   if (_useFontHints != useFontHints) {
-    double displayResolution = displayResolution_in_dpi;
     QList<TeXFontDefinition*>::iterator it_fontp = fontList.begin();
     for (; it_fontp != fontList.end(); ++it_fontp) {
       TeXFontDefinition *fontp = *it_fontp;
-      fontp->setDisplayResolution(displayResolution * fontp->enlargement);
+      if (fontp->font != 0)
+        fontp->font->clearShrunkenCharacters();
     }
   }
 
@@ -357,10 +357,12 @@ void fontPool::setCMperDVIunit( double _CMperDVI )
 
   CMperDVIunit = _CMperDVI;
 
+  // The size of the PFB characters depends on it
   QList<TeXFontDefinition*>::iterator it_fontp = fontList.begin();
   for (; it_fontp != fontList.end(); ++it_fontp) {
     TeXFontDefinition *fontp = *it_fontp;
-    fontp->setDisplayResolution(displayResolution_in_dpi * fontp->enlargement);
+    if (fontp->font != 0)
+      fontp->font->clearShrunkenCharacters();
   }
 }
 
@@ -0,0 +1,79 @@
+// -*- Mode: C++; c-basic-offset: 2; indent-tabs-mode: nil; c-brace-offset: 0; -*-
+// glyphcache.cpp
+//
+// Part of the DVI generator of Okular
+//
+// (C) 2017 the Okular developers
+// Distributed under the GPL
+
+#include <config.h>
+
+#include "glyphcache.h"
+
+#include <QColor>
+#include <QHash>
+#include <QMutexLocker>
+
+// The memory the shrunken characters can take, in bytes. A character
+// of a 10pt font takes a few KiB at 100%, and some hundreds of KiB
+// when zoomed in a lot.
+#define GLYPHCACHE_SIZE (32 * 1024 * 1024)
+
+
+bool GlyphCache::Key::operator==(const Key &other) const
+{
+  return font == other.font && character == other.character && resolution == other.resolution && color == other.color;
+}
+
+uint qHash(const GlyphCache::Key &key, uint seed)
+{
+  return qHash(key.font, seed) ^ qHash(key.character) ^ qHash(key.resolution) ^ qHash(key.color);
+}
+
+
+GlyphCache::GlyphCache()
+  : glyphs(GLYPHCACHE_SIZE)
+{}
+
+
+GlyphCache* GlyphCache::instance()
+{
+  // shared by the documents, and thus by their rendering threads
+  static GlyphCache cache;
+  return &cache;
+}
+
+
+bool GlyphCache::find(const TeXFont *font, quint16 character, double resolution, const QColor &color, Glyph *glyph)
+{
+  const Key key = { font, character, resolution, color.rgba() };
+
+  QMutexLocker locker(&mutex);
+  // QCache::object() makes the character the most recently used one
+  const Glyph *cached = glyphs.object(key);
+  if (cached == 0)
+    return false;
+  *glyph = *cached;
+  return true;
+}
+
+
+void GlyphCache::insert(const TeXFont *font, quint16 character, double resolution, const QColor &color, const Glyph &glyph)
+{
+  const Key key = { font, character, resolution, color.rgba() };
+  const int cost = qMax(1, glyph.shrunkenCharacter.byteCount());
+
+  QMutexLocker locker(&mutex);
+  // a character larger than the whole cache is not kept
+  glyphs.insert(key, new Glyph(glyph), cost);
+}
+
+
+void GlyphCache::removeFont(const TeXFont *font)
+{
+  QMutexLocker locker(&mutex);
+  foreach (const Key &key, glyphs.keys()) {
+    if (key.font == font)
+      glyphs.remove(key);
+  }
+}
@@ -0,0 +1,70 @@
+// -*- Mode: C++; c-basic-offset: 2; indent-tabs-mode: nil; c-brace-offset: 0; -*-
+// glyphcache.h
+//
+// Part of the DVI generator of Okular
+//
+// (C) 2017 the Okular developers
+// Distributed under the GPL
+
+#ifndef _GLYPHCACHE_H
+#define _GLYPHCACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QRgb>
+
+class TeXFont;
+
+
+/**
+ * The shrunken characters of all the fonts of all the DVI documents
+ * that are open, within a fixed amount of memory
+ *
+ * The fonts used to keep the shrunken characters they had drawn until
+ * the resolution changed, so a document with many fonts (as the math
+ * ones) kept growing. Here the least recently used characters are
+ * dropped when the cache is full, and the characters of a font at
+ * several resolutions can be kept, so zooming back and forth does not
+ * shrink them again. The cache can be used by the renderers of several
+ * documents at the same time.
+ **/
+
+class GlyphCache {
+ public:
+  struct Glyph {
+    QImage shrunkenCharacter;
+    short  x2, y2;
+  };
+
+  static GlyphCache* instance();
+
+  /** Finds the character of the font shrunken at the given resolution
+      and color. Returns false if the cache does not have it. */
+  bool find(const TeXFont *font, quint16 character, double resolution, const QColor &color, Glyph *glyph);
+
+  void insert(const TeXFont *font, quint16 character, double resolution, const QColor &color, const Glyph &glyph);
+
+  /** Drops all the characters of the font, e.g. when it is deleted or
+      when its characters would be shrunken differently. */
+  void removeFont(const TeXFont *font);
+
+ private:
+  struct Key {
+    const TeXFont *font;
+    quint16 character;
+    double resolution;
+    QRgb color;
+
+    bool operator==(const Key &other) const;
+  };
+  friend uint qHash(const Key &key, uint seed);
+
+  GlyphCache();
+
+  QMutex mutex;
+  // costs are in bytes
+  QCache<Key, Glyph> glyphs;
+};
+
+#endif
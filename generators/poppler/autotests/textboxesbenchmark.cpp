@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <QtTest>
+
+#include "../textboxes.h"
+
+// Measures abstractTextPage() alone, on the words Poppler found in a real
+// document: the whole text extraction is measured by documentbenchmark.
+class TextBoxesBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void testText();
+        void benchmarkAbstractTextPage();
+
+    private:
+        QList< QList<Poppler::TextBox*> > m_textLists;
+        QList< QSizeF > m_pageSizes;
+};
+
+void TextBoxesBenchmark::initTestCase()
+{
+    Poppler::Document *doc = Poppler::Document::load( QStringLiteral(KDESRCDIR "data/file2.pdf") );
+    QVERIFY( doc );
+    for ( int i = 0; i < doc->numPages(); ++i )
+    {
+        Poppler::Page *page = doc->page( i );
+        QVERIFY( page );
+        m_textLists.append( page->textList() );
+        m_pageSizes.append( page->pageSizeF() );
+        delete page;
+    }
+    delete doc;
+}
+
+void TextBoxesBenchmark::cleanupTestCase()
+{
+    foreach ( const QList<Poppler::TextBox*> &textList, m_textLists )
+        qDeleteAll( textList );
+}
+
+void TextBoxesBenchmark::testText()
+{
+    // every character of the words is in the text page
+    for ( int i = 0; i < m_textLists.count(); ++i )
+    {
+        Okular::TextPage *tp = abstractTextPage( m_textLists.at( i ), m_pageSizes.at( i ).height(), m_pageSizes.at( i ).width(), 0 );
+        const QString text = tp->text();
+        foreach ( Poppler::TextBox *word, m_textLists.at( i ) )
+            QVERIFY( text.contains( word->text().normalized( QString::NormalizationForm_KC ) ) );
+        delete tp;
+    }
+}
+
+void TextBoxesBenchmark::benchmarkAbstractTextPage()
+{
+    QBENCHMARK
+    {
+        for ( int i = 0; i < m_textLists.count(); ++i )
+            delete abstractTextPage( m_textLists.at( i ), m_pageSizes.at( i ).height(), m_pageSizes.at( i ).width(), 0 );
+    }
+}
+
+QTEST_MAIN( TextBoxesBenchmark )
+#include "textboxesbenchmark.moc"
@@ -16,6 +16,7 @@
 #include <qcolor.h>
 #include <qdir.h>
 #include <qfile.h>
+#include <qfileinfo.h>
 #include <qimage.h>
 #include <qlayout.h>
 #include <qmutex.h>
@@ -23,6 +24,8 @@
 #include <qstack.h>
 #include <qtemporaryfile.h>
 #include <qtextstream.h>
+#include <qthread.h>
+#include <qwaitcondition.h>
 #include <QPrinter>
 #include <QPainter>
 #include <QtCore/QDebug>
@@ -54,6 +57,7 @@
 #include "annots.h"
 #include "formfields.h"
 #include "popplerembeddedfile.h"
+#include "textboxes.h"
 
 Q_DECLARE_METATYPE(Poppler::Annotation*)
 Q_DECLARE_METATYPE(Poppler::FontInfo)
@@ -496,6 +500,7 @@ static void PDFGeneratorPopplerDebugFunction(const QString &message, const QVari
 
 PDFGenerator::PDFGenerator( QObject *parent, const QVariantList &args )
     : Generator( parent, args ), pdfdoc( 0 ),
+    textDocument( 0 ), fontDocument( 0 ), documentSize( -1 ),
     docSynopsisDirty( true ),
     docEmbeddedFilesDirty( true ), nextFontPage( 0 ),
     annotProxy( 0 )
@@ -512,6 +517,7 @@ PDFGenerator::PDFGenerator( QObject *parent, const QVariantList &args )
         setFeature( PrintToFile );
     setFeature( ReadRawData );
     setFeature( TiledRendering );
+    setFeature( LazyPageData );
 
     // You only need to do it once not for each of the documents but it is cheap enough
     // so doing it all the time won't hurt either
@@ -535,6 +541,10 @@ Okular::Document::OpenResult PDFGenerator::loadDocumentWithPassword( const QStri
 #endif
     // create PDFDoc for the given file
     pdfdoc = Poppler::Document::load( filePath, 0, 0 );
+    documentFilePath = filePath;
+    const QFileInfo fileInfo( filePath );
+    documentModified = fileInfo.lastModified();
+    documentSize = fileInfo.size();
     return init(pagesVector, password);
 }
 
@@ -549,6 +559,7 @@ Okular::Document::OpenResult PDFGenerator::loadDocumentFromDataWithPassword( con
 #endif
     // create PDFDoc for the given file
     pdfdoc = Poppler::Document::loadFromData( fileData, 0, 0 );
+    documentData = fileData;
     return init(pagesVector, password);
 }
 
@@ -566,6 +577,7 @@ Okular::Document::OpenResult PDFGenerator::init(QVector<Okular::Page*> & pagesVe
             pdfdoc = 0;
             return Okular::Document::OpenNeedsPassword;
         }
+        documentPassword = password.toLatin1();
     }
 
     // build Pages (currentPage was set -1 by deletePages)
@@ -588,6 +600,11 @@ Okular::Document::OpenResult PDFGenerator::init(QVector<Okular::Page*> & pagesVe
     // create annotation proxy
     annotProxy = new PopplerAnnotationProxy( pdfdoc, userMutex() );
 
+    // the instances of the workers are loaded now, while the file is still
+    // the one pdfdoc was loaded from
+    textDocument = loadWorkerDocument();
+    fontDocument = loadWorkerDocument();
+
     // the file has been loaded correctly
     return Okular::Document::OpenSuccess;
 }
@@ -601,6 +618,19 @@ bool PDFGenerator::doCloseDocument()
     delete pdfdoc;
     pdfdoc = 0;
     userMutex()->unlock();
+    textDocumentMutex.lock();
+    fontDocumentMutex.lock();
+    delete textDocument;
+    textDocument = 0;
+    delete fontDocument;
+    fontDocument = 0;
+    fontDocumentMutex.unlock();
+    textDocumentMutex.unlock();
+    documentFilePath.clear();
+    documentModified = QDateTime();
+    documentSize = -1;
+    documentData.clear();
+    documentPassword.clear();
     docSynopsisDirty = true;
     docSyn.clear();
     docEmbeddedFilesDirty = true;
@@ -637,21 +667,10 @@ void PDFGenerator::loadPages(QVector<Okular::Page*> &pagesVector, int rotation,
             }
             if (rotation % 2 == 1)
             qSwap(w,h);
-            // init a Okular::page, add transition and annotation information
+            // init a Okular::page; transition, annotations and actions are
+            // added later in loadPageData(), only the form fields are needed
+            // right away (to restore their values)
             page = new Okular::Page( i, w, h, orientation );
-            addTransition( p, page );
-            if ( true ) //TODO real check
-            addAnnotations( p, page );
-            Poppler::Link * tmplink = p->action( Poppler::Page::Opening );
-            if ( tmplink )
-            {
-                page->setPageAction( Okular::Page::Opening, createLinkFromPopplerLink( tmplink ) );
-            }
-            tmplink = p->action( Poppler::Page::Closing );
-            if ( tmplink )
-            {
-                page->setPageAction( Okular::Page::Closing, createLinkFromPopplerLink( tmplink ) );
-            }
             page->setDuration( p->duration() );
             page->setLabel( p->label() );
 
@@ -675,6 +694,30 @@ void PDFGenerator::loadPages(QVector<Okular::Page*> &pagesVector, int rotation,
     }
 }
 
+void PDFGenerator::loadPageData( Okular::Page *page )
+{
+    // called with userMutex() locked, as the pixmap and text threads use
+    // the document too
+    Poppler::Page * p = pdfdoc->page( page->number() );
+    if ( !p )
+        return;
+
+    addTransition( p, page );
+    addAnnotations( p, page );
+    Poppler::Link * tmplink = p->action( Poppler::Page::Opening );
+    if ( tmplink )
+    {
+        page->setPageAction( Okular::Page::Opening, createLinkFromPopplerLink( tmplink ) );
+    }
+    tmplink = p->action( Poppler::Page::Closing );
+    if ( tmplink )
+    {
+        page->setPageAction( Okular::Page::Closing, createLinkFromPopplerLink( tmplink ) );
+    }
+
+    delete p;
+}
+
 Okular::DocumentInfo PDFGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
 {
     Okular::DocumentInfo docInfo;
@@ -807,13 +850,18 @@ Okular::FontInfo::List PDFGenerator::fontsForPage( int page )
         return list;
 
     QList<Poppler::FontInfo> fonts;
-    userMutex()->lock();
-
-    Poppler::FontIterator* it = pdfdoc->newFontIterator(page);
-    if (it->hasNext()) {
-        fonts = it->next();
+    {
+        // use the document instance reserved to the font extraction, or share
+        // the main one if it could not be loaded
+        QMutexLocker locker( &fontDocumentMutex );
+        QMutexLocker mainLocker( fontDocument ? 0 : userMutex() );
+
+        Poppler::FontIterator* it = ( fontDocument ? fontDocument : pdfdoc )->newFontIterator(page);
+        if (it->hasNext()) {
+            fonts = it->next();
+        }
+        delete it;
     }
-    userMutex()->unlock();
 
     foreach (const Poppler::FontInfo &font, fonts)
     {
@@ -1026,6 +1074,38 @@ void PDFGenerator::resolveMediaLinkReferences( Okular::Page *page )
 }
 
 Okular::TextPage* PDFGenerator::textPage( Okular::Page *page )
+{
+    // use the document instance reserved to the text extraction, so that
+    // rendering can go on in parallel, or share the main one (and its
+    // lock) if it could not be loaded
+    QMutexLocker locker( &textDocumentMutex );
+    Poppler::Document *doc = textExtractionDocument();
+    QMutexLocker mainLocker( doc == pdfdoc ? userMutex() : 0 );
+
+    return extractTextPage( doc, page );
+}
+
+QVector<Okular::TextPage*> PDFGenerator::textPages( const QVector<Okular::Page*> &pages )
+{
+    QVector<Okular::TextPage*> tps;
+    tps.reserve( pages.count() );
+
+    // take the locks only once for all the pages
+    QMutexLocker locker( &textDocumentMutex );
+    Poppler::Document *doc = textExtractionDocument();
+    QMutexLocker mainLocker( doc == pdfdoc ? userMutex() : 0 );
+
+    foreach ( Okular::Page *page, pages )
+        tps.append( extractTextPage( doc, page ) );
+    return tps;
+}
+
+Poppler::Document *PDFGenerator::textExtractionDocument()
+{
+    return textDocument ? textDocument : pdfdoc;
+}
+
+Okular::TextPage *PDFGenerator::extractTextPage( Poppler::Document *doc, Okular::Page *page )
 {
 #ifdef PDFGENERATOR_DEBUG
     qCDebug(OkularPdfDebug) << "page" << page->number();
@@ -1033,12 +1113,10 @@ Okular::TextPage* PDFGenerator::textPage( Okular::Page *page )
     // build a TextList...
     QList<Poppler::TextBox*> textList;
     double pageWidth, pageHeight;
-    Poppler::Page *pp = pdfdoc->page( page->number() );
+    Poppler::Page *pp = doc->page( page->number() );
     if (pp)
     {
-        userMutex()->lock();
         textList = pp->textList();
-        userMutex()->unlock();
 
         QSizeF s = pp->pageSizeF();
         pageWidth = s.width();
@@ -1057,6 +1135,33 @@ Okular::TextPage* PDFGenerator::textPage( Okular::Page *page )
     return tp;
 }
 
+Poppler::Document *PDFGenerator::loadWorkerDocument() const
+{
+    // another instance of a file that changed since it was loaded would
+    // not match pdfdoc
+    if ( documentData.isEmpty() )
+    {
+        const QFileInfo fileInfo( documentFilePath );
+        if ( fileInfo.lastModified() != documentModified || fileInfo.size() != documentSize )
+        {
+            qCWarning(OkularPdfDebug) << "The document changed on disk, sharing the main instance";
+            return 0;
+        }
+    }
+
+    Poppler::Document *doc = documentData.isEmpty()
+                             ? Poppler::Document::load( documentFilePath, documentPassword, documentPassword )
+                             : Poppler::Document::loadFromData( documentData, documentPassword, documentPassword );
+    if ( doc && doc->isLocked() )
+    {
+        delete doc;
+        doc = 0;
+    }
+    if ( !doc )
+        qCWarning(OkularPdfDebug) << "Could not load another instance of the document, sharing the main one";
+    return doc;
+}
+
 void PDFGenerator::requestFontData(const Okular::FontInfo &font, QByteArray *data)
 {
     Poppler::FontInfo fi = font.nativeId().value<Poppler::FontInfo>();
@@ -1331,6 +1436,60 @@ Okular::ExportFormat::List PDFGenerator::exportFormats() const
     return formats;
 }
 
+// state shared between the threads of a plain text export: every thread
+// takes the next page to extract, and the exported text is written in page
+// order as soon as it is available
+struct PDFTextExport
+{
+    QMutex mutex;
+    QWaitCondition pageDone;
+    QVector<QString> texts;
+    QBitArray done;
+    QAtomicInt nextPage;
+    QAtomicInt stop;
+};
+
+class PDFTextExportThread : public QThread
+{
+    public:
+        PDFTextExportThread( PDFTextExport *textExport, Poppler::Document *doc )
+            : m_export( textExport ), m_doc( doc )
+        {
+        }
+
+        ~PDFTextExportThread()
+        {
+            wait();
+            delete m_doc;
+        }
+
+    protected:
+        void run() override
+        {
+            const int num = m_export->texts.count();
+            int i;
+            while ( !m_export->stop.load() && ( i = m_export->nextPage.fetchAndAddRelaxed( 1 ) ) < num )
+            {
+                QString text;
+                Poppler::Page *pp = m_doc->page( i );
+                if ( pp )
+                {
+                    text = pp->text( QRect() ).normalized( QString::NormalizationForm_KC );
+                    delete pp;
+                }
+
+                QMutexLocker locker( &m_export->mutex );
+                m_export->texts[ i ] = text;
+                m_export->done.setBit( i );
+                m_export->pageDone.wakeAll();
+            }
+        }
+
+    private:
+        PDFTextExport *m_export;
+        Poppler::Document *m_doc;
+};
+
 bool PDFGenerator::exportTo( const QString &fileName, const Okular::ExportFormat &format )
 {
     if ( format.mimeType().inherits( QStringLiteral( "text/plain" ) ) ) {
@@ -1339,101 +1498,75 @@ bool PDFGenerator::exportTo( const QString &fileName, const Okular::ExportFormat
             return false;
 
         QTextStream ts( &f );
-        int num = document()->pages();
-        for ( int i = 0; i < num; ++i )
+        const int num = document()->pages();
+
+        // extract the pages in parallel, each thread with its own instance
+        // of the document; if none can be loaded, do it here with pdfdoc
+        PDFTextExport textExport;
+        textExport.texts.resize( num );
+        textExport.done.resize( num );
+        QList<PDFTextExportThread*> threads;
+        const int threadCount = qMin( qBound( 1, QThread::idealThreadCount(), 4 ), num );
+        for ( int t = 0; t < threadCount; ++t )
         {
-            QString text;
-            userMutex()->lock();
-            Poppler::Page *pp = pdfdoc->page(i);
-            if (pp)
-            {
-                text = pp->text(QRect()).normalized(QString::NormalizationForm_KC);
-            }
-            userMutex()->unlock();
-            ts << text;
-            delete pp;
+            Poppler::Document *doc = loadWorkerDocument();
+            if ( !doc )
+                break;
+            threads.append( new PDFTextExportThread( &textExport, doc ) );
+            threads.last()->start();
         }
-        f.close();
-
-        return true;
-    }
-
-    return false;
-}
-
-//END Generator inherited functions
 
-inline void append (Okular::TextPage* ktp,
-    const QString &s, double l, double b, double r, double t)
-{
-//    kWarning(PDFDebug).nospace() << "text: " << s << " at (" << l << "," << t << ")x(" << r <<","<<b<<")";
-    ktp->append(s, new Okular::NormalizedRect(l, t, r, b));
-}
-
-Okular::TextPage * PDFGenerator::abstractTextPage(const QList<Poppler::TextBox*> &text, double height, double width,int rot)
-{
-    Q_UNUSED(rot);
-    Okular::TextPage* ktp=new Okular::TextPage;
-    Poppler::TextBox *next;
-#ifdef PDFGENERATOR_DEBUG
-    qCDebug(OkularPdfDebug) << "getting text page in generator pdf - rotation:" << rot;
-#endif
-    QString s;
-    bool addChar;
-    foreach (Poppler::TextBox *word, text)
-    {
-        const int qstringCharCount = word->text().length();
-        next=word->nextWord();
-        int textBoxChar = 0;
-        for (int j = 0; j < qstringCharCount; j++)
+        bool cancelled = false;
+        for ( int i = 0; i < num; ++i )
         {
-            const QChar c = word->text().at(j);
-            if (c.isHighSurrogate())
-            {
-                s = c;
-                addChar = false;
-            }
-            else if (c.isLowSurrogate())
+            QString text;
+            if ( threads.isEmpty() )
             {
-                s += c;
-                addChar = true;
+                userMutex()->lock();
+                Poppler::Page *pp = pdfdoc->page(i);
+                if (pp)
+                {
+                    text = pp->text(QRect()).normalized(QString::NormalizationForm_KC);
+                }
+                userMutex()->unlock();
+                delete pp;
             }
             else
             {
-                s = c;
-                addChar = true;
+                // wait for the page, and free its text once written
+                QMutexLocker locker( &textExport.mutex );
+                while ( !textExport.done.testBit( i ) )
+                    textExport.pageDone.wait( &textExport.mutex );
+                text.swap( textExport.texts[ i ] );
             }
+            ts << text;
 
-            if (addChar)
+            emit exportProgress( i + 1, num );
+            if ( exportCancelled() )
             {
-                QRectF charBBox = word->charBoundingBox(textBoxChar);
-                append(ktp, (j==qstringCharCount-1 && !next) ? (s + QLatin1Char('\n')) : s,
-                    charBBox.left()/width,
-                    charBBox.bottom()/height,
-                    charBBox.right()/width,
-                    charBBox.top()/height);
-                textBoxChar++;
+                cancelled = true;
+                break;
             }
         }
 
-        if ( word->hasSpaceAfter() && next )
+        textExport.stop.store( 1 );
+        qDeleteAll( threads );
+        f.close();
+
+        if ( cancelled )
         {
-            // TODO Check with a document with vertical text
-            // probably won't work and we will need to do comparisons
-            // between wordBBox and nextWordBBox to see if they are
-            // vertically or horizontally aligned
-            QRectF wordBBox = word->boundingBox();
-            QRectF nextWordBBox = next->boundingBox();
-            append(ktp, QStringLiteral(" "),
-                     wordBBox.right()/width,
-                     wordBBox.bottom()/height,
-                     nextWordBBox.left()/width,
-                     wordBBox.top()/height);
+            f.remove();
+            return false;
         }
+
+        return true;
     }
-    return ktp;
+
+    return false;
 }
 
+//END Generator inherited functions
+
 void PDFGenerator::addSynopsisChildren( QDomNode * parent, QDomNode * parentDestination )
 {
     // keep track of the current listViewItem
@@ -17,6 +17,8 @@
 
 
 #include <qbitarray.h>
+#include <qdatetime.h>
+#include <qmutex.h>
 #include <qpointer.h>
 
 #include <core/document.h>
@@ -101,6 +103,8 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
     protected:
         bool doCloseDocument() override;
         Okular::TextPage* textPage( Okular::Page *page ) override;
+        QVector<Okular::TextPage*> textPages( const QVector<Okular::Page*> &pages ) override;
+        void loadPageData( Okular::Page *page ) override;
 
     protected Q_SLOTS:
         void requestFontData(const Okular::FontInfo &font, QByteArray *data);
@@ -118,16 +122,38 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
         // fetch the form fields and add them to the page
         void addFormFields( Poppler::Page * popplerPage, Okular::Page * page );
 
-        Okular::TextPage * abstractTextPage(const QList<Poppler::TextBox*> &text, double height, double width, int rot);
-
         void resolveMediaLinkReferences( Okular::Page *page );
         void resolveMediaLinkReference( Okular::Action *action );
 
         bool setDocumentRenderHints();
 
+        // load another instance of the current document, to be used by a
+        // single kind of worker; it fails if the file changed since pdfdoc
+        // was loaded from it
+        Poppler::Document *loadWorkerDocument() const;
+        // the document to extract the text from, to be called with
+        // textDocumentMutex locked
+        Poppler::Document *textExtractionDocument();
+        // extract the text of the given page, with the locks of doc held
+        Okular::TextPage *extractTextPage( Poppler::Document *doc, Okular::Page *page );
+
         // poppler dependant stuff
         Poppler::Document *pdfdoc;
 
+        // independent instances of the document for the text and the font
+        // extraction, so that they do not wait for the rendering (that holds
+        // userMutex() on pdfdoc) and the other way round
+        Poppler::Document *textDocument;
+        Poppler::Document *fontDocument;
+        QMutex textDocumentMutex;
+        QMutex fontDocumentMutex;
+        QString documentFilePath;
+        // to tell whether the file is still the one pdfdoc was loaded from
+        QDateTime documentModified;
+        qint64 documentSize;
+        QByteArray documentData;
+        QByteArray documentPassword;
+
 
         // misc variables for document info and synopsis caching
         bool docSynopsisDirty;
@@ -0,0 +1,84 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "textboxes.h"
+
+#include <core/area.h>
+
+static inline void append (Okular::TextPage* ktp,
+    const QString &s, double l, double b, double r, double t)
+{
+//    kWarning(PDFDebug).nospace() << "text: " << s << " at (" << l << "," << t << ")x(" << r <<","<<b<<")";
+    ktp->append(s, Okular::NormalizedRect(l, t, r, b));
+}
+
+Okular::TextPage * abstractTextPage(const QList<Poppler::TextBox*> &text, double height, double width,int rot)
+{
+    Q_UNUSED(rot);
+    Okular::TextPage* ktp=new Okular::TextPage;
+    Poppler::TextBox *next;
+    // at most one entity per character plus one space per word, so the
+    // text page storage is allocated only once
+    int entityCount = 0;
+    foreach (Poppler::TextBox *word, text)
+        entityCount += word->text().length() + 1;
+    ktp->reserve(entityCount);
+
+    foreach (Poppler::TextBox *word, text)
+    {
+        const QString wordText = word->text();
+        const int qstringCharCount = wordText.length();
+        next=word->nextWord();
+        int textBoxChar = 0;
+        for (int j = 0; j < qstringCharCount; j++)
+        {
+            // a character out of the BMP takes two QChars, but has one box
+            int length = 1;
+            if (wordText.at(j).isHighSurrogate())
+            {
+                if (j + 1 == qstringCharCount || !wordText.at(j + 1).isLowSurrogate())
+                    continue;
+                length = 2;
+            }
+
+            // each entity keeps its string, so it is built at its final size
+            const bool lastChar = j + length == qstringCharCount && !next;
+            QString s;
+            s.reserve(length + (lastChar ? 1 : 0));
+            s.append(wordText.constData() + j, length);
+            if (lastChar)
+                s += QLatin1Char('\n');
+
+            QRectF charBBox = word->charBoundingBox(textBoxChar);
+            append(ktp, s,
+                charBBox.left()/width,
+                charBBox.bottom()/height,
+                charBBox.right()/width,
+                charBBox.top()/height);
+            textBoxChar++;
+            j += length - 1;
+        }
+
+        if ( word->hasSpaceAfter() && next )
+        {
+            // TODO Check with a document with vertical text
+            // probably won't work and we will need to do comparisons
+            // between wordBBox and nextWordBBox to see if they are
+            // vertically or horizontally aligned
+            QRectF wordBBox = word->boundingBox();
+            QRectF nextWordBBox = next->boundingBox();
+            append(ktp, QStringLiteral(" "),
+                     wordBBox.right()/width,
+                     wordBBox.bottom()/height,
+                     nextWordBBox.left()/width,
+                     wordBBox.top()/height);
+        }
+    }
+    return ktp;
+}
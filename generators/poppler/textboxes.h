@@ -0,0 +1,21 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_GENERATOR_PDF_TEXTBOXES_H_
+#define _OKULAR_GENERATOR_PDF_TEXTBOXES_H_
+
+#include <poppler-qt5.h>
+
+#include "core/textpage.h"
+
+// converts the words of a page, of the given size in points, into a text
+// page with an entity per character
+extern Okular::TextPage* abstractTextPage( const QList<Poppler::TextBox*> &text, double height, double width, int rot );
+
+#endif
@@ -179,7 +179,7 @@ void GSGenerator::slotImageGenerated(QImage *img, Okular::PixmapRequest *request
         updatePageBoundingBox( request->page()->number(), Okular::Utils::imageBoundingBox( img ) );
 
     m_request = 0;
-    QPixmap *pix = new QPixmap(QPixmap::fromImage(*img));
+    QPixmap *pix = new QPixmap(QPixmap::fromImage(std::move(*img)));
     delete img;
     request->page()->setPixmap( request->observer(), pix );
     signalPixmapRequestDone( request );
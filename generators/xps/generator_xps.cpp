@@ -2124,6 +2124,17 @@ Okular::TextPage* XpsGenerator::textPage( Okular::Page * page )
     return xpsPage->textPage();
 }
 
+QVector<Okular::TextPage*> XpsGenerator::textPages( const QVector<Okular::Page*> &pages )
+{
+    QVector<Okular::TextPage*> tps;
+    tps.reserve( pages.count() );
+
+    QMutexLocker lock( userMutex() );
+    foreach ( Okular::Page *page, pages )
+        tps.append( m_xpsFile->page( page->number() )->textPage() );
+    return tps;
+}
+
 Okular::DocumentInfo XpsGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
 {
     Q_UNUSED(keys);
@@ -2165,13 +2176,22 @@ bool XpsGenerator::exportTo( const QString &fileName, const Okular::ExportFormat
             return false;
 
         QTextStream ts( &f );
-        for ( int i = 0; i < m_xpsFile->numPages(); ++i )
+        const int num = m_xpsFile->numPages();
+        for ( int i = 0; i < num; ++i )
         {
             Okular::TextPage* textPage = m_xpsFile->page(i)->textPage();
             QString text = textPage->text();
             ts << text;
             ts << QLatin1Char('\n');
             delete textPage;
+
+            emit exportProgress( i + 1, num );
+            if ( exportCancelled() )
+            {
+                f.close();
+                f.remove();
+                return false;
+            }
         }
         f.close();
 
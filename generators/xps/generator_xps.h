@@ -320,6 +320,7 @@ class XpsGenerator : public Okular::Generator
         bool doCloseDocument() override;
         QImage image( Okular::PixmapRequest *page ) override;
         Okular::TextPage* textPage( Okular::Page * page ) override;
+        QVector<Okular::TextPage*> textPages( const QVector<Okular::Page*> &pages ) override;
 
     private:
         XpsFile *m_xpsFile;
@@ -27,6 +27,7 @@
 #include <QApplication>
 #include <QDialog>
 #include <QDialogButtonBox>
+#include <QEventLoop>
 #include <QFile>
 #include <QFileDialog>
 #include <QIcon>
@@ -34,11 +35,13 @@
 #include <QLayout>
 #include <QLabel>
 #include <QMenu>
+#include <QThread>
 #include <QTimer>
 #include <QTemporaryFile>
 #include <QPrinter>
 #include <QPrintDialog>
 #include <QPrintPreviewDialog>
+#include <QProgressDialog>
 #include <QScrollBar>
 #include <QSlider>
 #include <QSpinBox>
@@ -105,6 +108,7 @@
 #include "core/page.h"
 #include "core/fileprinter.h"
 #include <cstdio>
+#include <functional>
 #include <memory>
 
 class FileKeeper
@@ -163,6 +167,33 @@ class FileKeeper
         std::FILE * m_handle;
 };
 
+/**
+ * Runs an export out of the GUI thread.
+ */
+class ExportThread : public QThread
+{
+    public:
+        explicit ExportThread( const std::function<bool()> &exportFunction )
+            : m_exportFunction( exportFunction ), m_result( false )
+        {
+        }
+
+        bool result() const
+        {
+            return m_result;
+        }
+
+    protected:
+        void run() override
+        {
+            m_result = m_exportFunction();
+        }
+
+    private:
+        std::function<bool()> m_exportFunction;
+        bool m_result;
+};
+
 K_PLUGIN_FACTORY(OkularPartFactory, registerPlugin<Okular::Part>();)
 
 static QAction* actionForExportFormat( const Okular::ExportFormat& format, QObject *parent = Q_NULLPTR )
@@ -294,7 +325,7 @@ Part::Part(QWidget *parentWidget,
 QObject *parent,
 const QVariantList &args)
 : KParts::ReadWritePart(parent),
-m_tempfile( 0 ), m_fileWasRemoved( false ), m_showMenuBarAction( 0 ), m_showFullScreenAction( 0 ), m_actionsSearched( false ),
+m_tempfile( 0 ), m_fileWasRemoved( false ), m_exporting( false ), m_showMenuBarAction( 0 ), m_showFullScreenAction( 0 ), m_actionsSearched( false ),
 m_cliPresentation(false), m_cliPrint(false), m_embedMode(detectEmbedMode(parentWidget, parent, args)), m_generatorGuiClient(0), m_keeper( 0 )
 {
     // make sure that the component name is okular otherwise the XMLGUI .rc files are not found
@@ -1583,6 +1614,10 @@ bool Part::openUrl(const QUrl &_url)
 
 bool Part::queryClose()
 {
+    // the export thread uses the document
+    if ( m_exporting )
+        return false;
+
     if ( !isReadWrite() || !isModified() )
         return true;
 
@@ -1606,6 +1641,9 @@ bool Part::queryClose()
 
 bool Part::closeUrl(bool promptToSave)
 {
+    if ( m_exporting )
+        return false;
+
     if ( promptToSave && !queryClose() )
         return false;
 
@@ -1770,6 +1808,13 @@ void Part::slotFileDirty( const QString& path )
 
 void Part::slotDoFileDirty()
 {
+    // reload once the export is over
+    if ( m_exporting )
+    {
+        m_dirtyHandler->start( 750 );
+        return;
+    }
+
     bool tocReloadPrepared = false;
 
     // do the following the first time the file is reloaded
@@ -2695,24 +2740,57 @@ void Part::slotExportAs(QAction * act)
 
     QString fileName = QFileDialog::getSaveFileName( widget(), QString(), QString(), filter);
 
-    if ( !fileName.isEmpty() )
+    if ( fileName.isEmpty() )
+        return;
+
+    bool saved = false;
+    bool cancelled = false;
+    if ( id == 1 )
     {
-        bool saved = false;
-        switch ( id )
-        {
-            case 0:
-                saved = m_document->exportToText( fileName );
-                break;
-            case 1:
-                saved = m_document->saveDocumentArchive( fileName );
-                break;
-            default:
-                saved = m_document->exportTo( fileName, m_exportFormats.at( id - 2 ) );
-                break;
-        }
-        if ( !saved )
-            KMessageBox::information( widget(), i18n("File could not be saved in '%1'. Try to save it to another location.", fileName ) );
+        saved = m_document->saveDocumentArchive( fileName );
+    }
+    else
+    {
+        // the export runs in a thread, so the progress dialog can be updated
+        // and cancel it without processing the events from within the
+        // generator; the document can not be reloaded nor closed meanwhile
+        const Okular::ExportFormat format = id == 0 ? Okular::ExportFormat() : m_exportFormats.at( id - 2 );
+        ExportThread thread( [this, id, &fileName, &format]() {
+            return id == 0 ? m_document->exportToText( fileName ) : m_document->exportTo( fileName, format );
+        } );
+
+        QProgressDialog progressDialog( i18n("Exporting the document..."), i18n("Cancel"), 0, 0, widget() );
+        progressDialog.setWindowModality( Qt::WindowModal );
+        connect( m_document, &Okular::Document::exportProgress, &progressDialog, [&progressDialog]( int done, int total ) {
+            progressDialog.setMaximum( total );
+            progressDialog.setValue( done );
+        } );
+        connect( &progressDialog, &QProgressDialog::canceled, m_document, [this, &cancelled]() {
+            cancelled = true;
+            m_document->cancelExport();
+        } );
+
+        QEventLoop loop;
+        connect( &thread, &QThread::finished, &loop, &QEventLoop::quit );
+
+        const bool reloadEnabled = m_reload->isEnabled();
+        m_exporting = true;
+        m_exportAs->setEnabled( false );
+        m_reload->setEnabled( false );
+
+        thread.start();
+        progressDialog.show();
+        loop.exec();
+        thread.wait();
+
+        m_exporting = false;
+        m_exportAs->setEnabled( true );
+        m_reload->setEnabled( reloadEnabled );
+        saved = thread.result();
     }
+
+    if ( !saved && !cancelled )
+        KMessageBox::information( widget(), i18n("File could not be saved in '%1'. Try to save it to another location.", fileName ) );
 }
 
 
@@ -298,6 +298,7 @@ class OKULARPART_EXPORT Part : public KParts::ReadWritePart, public Okular::Docu
         bool m_wasSidebarVisible;
         bool m_wasSidebarCollapsed;
         bool m_fileWasRemoved;
+        bool m_exporting;
         Rotation m_dirtyPageRotation;
 
         // Remember the search history
@@ -0,0 +1,327 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+// Renders all the pages of the documents of a directory with okularcore,
+// without any user interface, and reports how fast it went:
+//
+//   okularrenderbench [--dpi 150] [--memory-level normal] [--no-threading]
+//                     [--json] <directory or files>
+//
+// For each document it prints the pages rendered per second, the
+// percentiles of the time the generator took for each page and the peak
+// resident memory of the process so far.
+
+#include <QApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLinkedList>
+#include <QMimeDatabase>
+#include <QSet>
+#include <QTextStream>
+#include <QTimer>
+
+#include <algorithm>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+#include "core/document.h"
+#include "core/generator.h"
+#include "core/observer.h"
+#include "core/page.h"
+#include "core/utils.h"
+#include "settings_core.h"
+
+// Quits the event loop once all the pages got a pixmap
+class RenderObserver : public Okular::DocumentObserver
+{
+    public:
+        RenderObserver()
+            : m_expectedPages( 0 ), m_loop( 0 )
+        {
+        }
+
+        void notifyPageChanged( int page, int flags ) override
+        {
+            if ( !( flags & Okular::DocumentObserver::Pixmap ) )
+                return;
+
+            m_renderedPages.insert( page );
+            if ( m_loop && m_renderedPages.count() == m_expectedPages )
+                m_loop->quit();
+        }
+
+        QSet< int > m_renderedPages;
+        int m_expectedPages;
+        QEventLoop *m_loop;
+};
+
+struct DocumentResult
+{
+    QString fileName;
+    QString error;
+    int pages;
+    int renderedPages;
+    qint64 msecs;
+    QVector< int > pageTimes;
+    qint64 peakRss;
+};
+
+// peak resident memory of the process in KiB, -1 if unknown
+static qint64 peakRss()
+{
+#if defined(Q_OS_UNIX)
+    struct rusage usage;
+    if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+        return -1;
+#if defined(Q_OS_MAC)
+    // in bytes on OS X
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+// nearest-rank percentile of sorted values
+static int percentile( const QVector< int > &sortedValues, int percent )
+{
+    if ( sortedValues.isEmpty() )
+        return 0;
+
+    const int rank = qBound( 1, ( percent * sortedValues.count() + 99 ) / 100, sortedValues.count() );
+    return sortedValues.at( rank - 1 );
+}
+
+static double pagesPerSecond( int pages, qint64 msecs )
+{
+    return msecs > 0 ? pages * 1000.0 / msecs : 0.0;
+}
+
+static DocumentResult renderDocument( Okular::Document *document, RenderObserver *observer, const QString &fileName, double dpi, int timeout )
+{
+    DocumentResult result;
+    result.fileName = fileName;
+    result.pages = 0;
+    result.renderedPages = 0;
+    result.msecs = 0;
+    result.peakRss = -1;
+
+    QMimeDatabase db;
+    const QMimeType mime = db.mimeTypeForFile( fileName );
+    if ( document->openDocument( fileName, QUrl::fromLocalFile( fileName ), mime ) != Okular::Document::OpenSuccess )
+    {
+        result.error = QStringLiteral( "could not be opened" );
+        return result;
+    }
+
+    // the page sizes are in pixels at the dpi of the screen
+    const QSizeF documentDpi = Okular::Utils::realDpi( 0 );
+    result.pages = document->pages();
+
+    QLinkedList< Okular::PixmapRequest * > requests;
+    for ( int i = 0; i < result.pages; ++i )
+    {
+        const Okular::Page *page = document->page( i );
+        const int width = qMax( 1, qRound( page->width() * dpi / documentDpi.width() ) );
+        const int height = qMax( 1, qRound( page->height() * dpi / documentDpi.height() ) );
+        // the first pages are generated first
+        requests << new Okular::PixmapRequest( observer, i, width, height, i + 1, Okular::PixmapRequest::Asynchronous );
+    }
+
+    QEventLoop loop;
+    QTimer::singleShot( timeout * 1000, &loop, &QEventLoop::quit );
+    observer->m_renderedPages.clear();
+    observer->m_expectedPages = result.pages;
+    observer->m_loop = &loop;
+
+    QElapsedTimer timer;
+    timer.start();
+    if ( !requests.isEmpty() )
+    {
+        document->requestPixmaps( requests );
+        if ( observer->m_renderedPages.count() < result.pages )
+            loop.exec();
+    }
+    result.msecs = timer.elapsed();
+    observer->m_loop = 0;
+
+    result.renderedPages = observer->m_renderedPages.count();
+    if ( result.renderedPages < result.pages )
+        result.error = QStringLiteral( "timed out" );
+
+    const Okular::RenderStatistics stats = document->renderStatistics();
+    result.pageTimes = stats.pageGenerationTime.values().toVector();
+    std::sort( result.pageTimes.begin(), result.pageTimes.end() );
+    result.peakRss = peakRss();
+
+    document->closeDocument();
+    return result;
+}
+
+static QJsonObject toJson( const DocumentResult &result )
+{
+    QJsonObject object;
+    object.insert( QStringLiteral( "file" ), result.fileName );
+    if ( !result.error.isEmpty() )
+        object.insert( QStringLiteral( "error" ), result.error );
+    object.insert( QStringLiteral( "pages" ), result.pages );
+    object.insert( QStringLiteral( "renderedPages" ), result.renderedPages );
+    object.insert( QStringLiteral( "msecs" ), (double)result.msecs );
+    object.insert( QStringLiteral( "pagesPerSecond" ), pagesPerSecond( result.renderedPages, result.msecs ) );
+    // the time the generator took for each page, not counting the wait in
+    // the request queue
+    QJsonObject generation;
+    generation.insert( QStringLiteral( "p50" ), percentile( result.pageTimes, 50 ) );
+    generation.insert( QStringLiteral( "p90" ), percentile( result.pageTimes, 90 ) );
+    generation.insert( QStringLiteral( "p99" ), percentile( result.pageTimes, 99 ) );
+    generation.insert( QStringLiteral( "max" ), result.pageTimes.isEmpty() ? 0 : result.pageTimes.last() );
+    object.insert( QStringLiteral( "pageGenerationMsecs" ), generation );
+    object.insert( QStringLiteral( "peakRssKiB" ), (double)result.peakRss );
+    return object;
+}
+
+static void printResult( QTextStream &out, const DocumentResult &result )
+{
+    out << QFileInfo( result.fileName ).fileName() << ": ";
+    if ( result.pages == 0 && !result.error.isEmpty() )
+    {
+        out << result.error << endl;
+        return;
+    }
+
+    out << result.renderedPages << "/" << result.pages << " pages in " << result.msecs << " ms, "
+        << QString::number( pagesPerSecond( result.renderedPages, result.msecs ), 'f', 1 ) << " pages/s, "
+        << "page generation p50 " << percentile( result.pageTimes, 50 ) << " ms"
+        << " p90 " << percentile( result.pageTimes, 90 ) << " ms"
+        << " p99 " << percentile( result.pageTimes, 99 ) << " ms, "
+        << "peak RSS " << result.peakRss / 1024 << " MiB";
+    if ( !result.error.isEmpty() )
+        out << " (" << result.error << ")";
+    out << endl;
+}
+
+int main( int argc, char **argv )
+{
+    // no window is ever shown
+    if ( qEnvironmentVariableIsEmpty( "QT_QPA_PLATFORM" ) )
+        qputenv( "QT_QPA_PLATFORM", "offscreen" );
+
+    QApplication app( argc, argv );
+    QApplication::setApplicationName( QStringLiteral( "okularrenderbench" ) );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( QStringLiteral( "Renders all the pages of the given documents and reports the rendering speed." ) );
+    parser.addHelpOption();
+    const QCommandLineOption dpiOption( QStringLiteral( "dpi" ), QStringLiteral( "Resolution of the rendered pages (default: 150)." ), QStringLiteral( "dpi" ), QStringLiteral( "150" ) );
+    const QCommandLineOption memoryLevelOption( QStringLiteral( "memory-level" ), QStringLiteral( "Memory level of the core: low, normal, aggressive or greedy (default: normal)." ), QStringLiteral( "level" ), QStringLiteral( "normal" ) );
+    const QCommandLineOption noThreadingOption( QStringLiteral( "no-threading" ), QStringLiteral( "Generate the pixmaps in the main thread." ) );
+    const QCommandLineOption timeoutOption( QStringLiteral( "timeout" ), QStringLiteral( "Maximum time to render a document, in seconds (default: 300)." ), QStringLiteral( "seconds" ), QStringLiteral( "300" ) );
+    const QCommandLineOption jsonOption( QStringLiteral( "json" ), QStringLiteral( "Print the results as JSON." ) );
+    parser.addOption( dpiOption );
+    parser.addOption( memoryLevelOption );
+    parser.addOption( noThreadingOption );
+    parser.addOption( timeoutOption );
+    parser.addOption( jsonOption );
+    parser.addPositionalArgument( QStringLiteral( "paths" ), QStringLiteral( "Documents, or directories whose documents are rendered." ) );
+    parser.process( app );
+
+    QTextStream out( stdout );
+    QTextStream err( stderr );
+
+    const double dpi = parser.value( dpiOption ).toDouble();
+    const int timeout = parser.value( timeoutOption ).toInt();
+    if ( dpi <= 0 || timeout <= 0 || parser.positionalArguments().isEmpty() )
+        parser.showHelp( 1 );
+
+    // the settings are not saved, so the ones of the user are left alone
+    Okular::SettingsCore::instance( QStringLiteral( "okularrenderbenchrc" ) );
+    const QString memoryLevel = parser.value( memoryLevelOption ).toLower();
+    if ( memoryLevel == QLatin1String( "low" ) )
+        Okular::SettingsCore::setMemoryLevel( Okular::SettingsCore::EnumMemoryLevel::Low );
+    else if ( memoryLevel == QLatin1String( "normal" ) )
+        Okular::SettingsCore::setMemoryLevel( Okular::SettingsCore::EnumMemoryLevel::Normal );
+    else if ( memoryLevel == QLatin1String( "aggressive" ) )
+        Okular::SettingsCore::setMemoryLevel( Okular::SettingsCore::EnumMemoryLevel::Aggressive );
+    else if ( memoryLevel == QLatin1String( "greedy" ) )
+        Okular::SettingsCore::setMemoryLevel( Okular::SettingsCore::EnumMemoryLevel::Greedy );
+    else
+    {
+        err << "Unknown memory level: " << memoryLevel << endl;
+        return 1;
+    }
+    Okular::SettingsCore::setEnableThreading( !parser.isSet( noThreadingOption ) );
+
+    QStringList files;
+    foreach ( const QString &path, parser.positionalArguments() )
+    {
+        const QFileInfo info( path );
+        if ( info.isDir() )
+        {
+            const QFileInfoList entries = QDir( path ).entryInfoList( QDir::Files | QDir::Readable, QDir::Name );
+            foreach ( const QFileInfo &entry, entries )
+                files << entry.absoluteFilePath();
+        }
+        else
+        {
+            files << info.absoluteFilePath();
+        }
+    }
+
+    Okular::Document document( 0 );
+    RenderObserver observer;
+    document.addObserver( &observer );
+
+    QJsonArray results;
+    int totalPages = 0;
+    qint64 totalMsecs = 0;
+    foreach ( const QString &fileName, files )
+    {
+        const DocumentResult result = renderDocument( &document, &observer, fileName, dpi, timeout );
+        totalPages += result.renderedPages;
+        totalMsecs += result.msecs;
+        if ( parser.isSet( jsonOption ) )
+            results.append( toJson( result ) );
+        else
+            printResult( out, result );
+    }
+
+    document.removeObserver( &observer );
+
+    if ( parser.isSet( jsonOption ) )
+    {
+        QJsonObject summary;
+        summary.insert( QStringLiteral( "dpi" ), dpi );
+        summary.insert( QStringLiteral( "memoryLevel" ), memoryLevel );
+        summary.insert( QStringLiteral( "threading" ), !parser.isSet( noThreadingOption ) );
+        summary.insert( QStringLiteral( "pages" ), totalPages );
+        summary.insert( QStringLiteral( "pagesPerSecond" ), pagesPerSecond( totalPages, totalMsecs ) );
+        summary.insert( QStringLiteral( "peakRssKiB" ), (double)peakRss() );
+        summary.insert( QStringLiteral( "documents" ), results );
+        out << QJsonDocument( summary ).toJson();
+    }
+    else
+    {
+        out << "total: " << totalPages << " pages, "
+            << QString::number( pagesPerSecond( totalPages, totalMsecs ), 'f', 1 ) << " pages/s, "
+            << "peak RSS " << peakRss() / 1024 << " MiB" << endl;
+    }
+
+    return 0;
+}
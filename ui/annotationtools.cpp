@@ -13,10 +13,14 @@
 #include <qcolor.h>
 #include <qcursor.h>
 #include <qevent.h>
+#include <qmath.h>
 #include <qpainter.h>
+#include <qpair.h>
+#include <qvector.h>
 
 // local includes
 #include "core/annotations.h"
+#include "settings.h"
 
 AnnotatorEngine::AnnotatorEngine( const QDomElement & engineElement )
     : m_engineElement( engineElement ), m_creationCompleted( false ), m_item( 0 )
@@ -82,14 +86,91 @@ QCursor AnnotatorEngine::cursor() const
     return Qt::CrossCursor;
 }
 
+/* Simplifies a path with the Ramer-Douglas-Peucker algorithm: the points that
+ * are closer than tolerance pixels to the simplified path are removed. The
+ * first and the last point are always kept. */
+static QLinkedList<Okular::NormalizedPoint> simplifyPath( const QLinkedList<Okular::NormalizedPoint> &path, double tolerance, double xScale, double yScale )
+{
+    if ( tolerance <= 0.0 || path.count() < 3 )
+        return path;
+
+    QVector<QPointF> pixelPoints;
+    pixelPoints.reserve( path.count() );
+    foreach ( const Okular::NormalizedPoint &point, path )
+        pixelPoints.append( QPointF( point.x * xScale, point.y * yScale ) );
+
+    const int lastIndex = pixelPoints.count() - 1;
+    QVector<bool> keep( pixelPoints.count(), false );
+    keep[ 0 ] = true;
+    keep[ lastIndex ] = true;
+
+    // use an explicit stack of ranges, long strokes would recurse too deep
+    const double tolerance2 = tolerance * tolerance;
+    QVector< QPair<int, int> > ranges;
+    ranges.append( qMakePair( 0, lastIndex ) );
+    while ( !ranges.isEmpty() )
+    {
+        const QPair<int, int> range = ranges.takeLast();
+        const QPointF a = pixelPoints.at( range.first );
+        const QPointF ab = pixelPoints.at( range.second ) - a;
+        const double abLength2 = QPointF::dotProduct( ab, ab );
+
+        // find the point farthest from the segment between the range ends
+        double maxDistance2 = 0.0;
+        int maxIndex = -1;
+        for ( int i = range.first + 1; i < range.second; ++i )
+        {
+            const QPointF ap = pixelPoints.at( i ) - a;
+            const double t = abLength2 > 0.0 ? qBound( 0.0, QPointF::dotProduct( ap, ab ) / abLength2, 1.0 ) : 0.0;
+            const QPointF d = ap - t * ab;
+            const double distance2 = QPointF::dotProduct( d, d );
+            if ( distance2 > maxDistance2 )
+            {
+                maxDistance2 = distance2;
+                maxIndex = i;
+            }
+        }
+
+        if ( maxIndex != -1 && maxDistance2 > tolerance2 )
+        {
+            keep[ maxIndex ] = true;
+            ranges.append( qMakePair( range.first, maxIndex ) );
+            ranges.append( qMakePair( maxIndex, range.second ) );
+        }
+    }
+
+    QLinkedList<Okular::NormalizedPoint> simplified;
+    int i = 0;
+    foreach ( const Okular::NormalizedPoint &point, path )
+    {
+        if ( keep.at( i++ ) )
+            simplified.append( point );
+    }
+    return simplified;
+}
+
 SmoothPath::SmoothPath( const QLinkedList<Okular::NormalizedPoint> &points, const QPen &pen, qreal opacity, QPainter::CompositionMode compositionMode )
     : points ( points ), pen ( pen ), opacity( opacity ), compositionMode( compositionMode )
 {
+    if ( points.isEmpty() )
+        return;
+
+    // the bounding rect is used to skip the paths out of the painted area
+    boundingRect.left = boundingRect.right = points.first().x;
+    boundingRect.top = boundingRect.bottom = points.first().y;
+    foreach ( const Okular::NormalizedPoint &point, points )
+    {
+        boundingRect.left = qMin( boundingRect.left, point.x );
+        boundingRect.top = qMin( boundingRect.top, point.y );
+        boundingRect.right = qMax( boundingRect.right, point.x );
+        boundingRect.bottom = qMax( boundingRect.bottom, point.y );
+    }
 }
 
 /** SmoothPathEngine */
 SmoothPathEngine::SmoothPathEngine( const QDomElement & engineElement )
-    : AnnotatorEngine( engineElement ), compositionMode( QPainter::CompositionMode_SourceOver )
+    : AnnotatorEngine( engineElement ), compositionMode( QPainter::CompositionMode_SourceOver ),
+      tolerance( Okular::Settings::inkSimplificationTolerance() )
 {
     // parse engine specific attributes
     if ( engineElement.attribute( QStringLiteral("compositionMode"), QStringLiteral("sourceOver") ) == QLatin1String("clear") )
@@ -114,9 +195,12 @@ QRect SmoothPathEngine::event( EventType type, Button button, double nX, double
     // add a point to the path
     else if ( type == Move && points.count() > 0 )
     {
-        //double dist = hypot( nX - points.last().x, nY - points.last().y );
-        //if ( dist > 0.0001 )
-        //{
+        // skip the points too close to the previous one, they would be
+        // removed by the simplification anyway
+        const double pixelDX = ( nX - lastPoint.x ) * xScale;
+        const double pixelDY = ( nY - lastPoint.y ) * yScale;
+        if ( pixelDX * pixelDX + pixelDY * pixelDY >= tolerance * tolerance )
+        {
             // append mouse position (as normalized point) to the list
             Okular::NormalizedPoint nextPoint = Okular::NormalizedPoint( nX, nY );
             points.append( nextPoint );
@@ -135,21 +219,27 @@ QRect SmoothPathEngine::event( EventType type, Button button, double nX, double
             incrementalRect.bottom = qMax( nextPoint.y, lastPoint.y ) + dY;
             lastPoint = nextPoint;
             return incrementalRect.geometry( (int)xScale, (int)yScale );
-        //}
+        }
     }
     // terminate process
     else if ( type == Release && points.count() > 0 )
     {
         if ( points.count() < 2 )
+        {
             points.clear();
+        }
         else
+        {
+            // simplify the stroke at the zoom it was drawn at
+            points = simplifyPath( points, tolerance, xScale, yScale );
             m_creationCompleted = true;
+        }
         return totalRect.geometry( (int)xScale, (int)yScale );
     }
     return QRect();
 }
 
-void SmoothPathEngine::paint( QPainter * painter, double xScale, double yScale, const QRect & /*clipRect*/ )
+void SmoothPathEngine::paint( QPainter * painter, double xScale, double yScale, const QRect & clipRect )
 {
     const double penWidth = m_annotElement.attribute( QStringLiteral("width"), QStringLiteral("1") ).toInt();
     const qreal opacity = m_annotElement.attribute( QStringLiteral("opacity"), QStringLiteral("1.0") ).toDouble();
@@ -157,15 +247,24 @@ void SmoothPathEngine::paint( QPainter * painter, double xScale, double yScale,
     // use engine's color for painting
     const SmoothPath path( points, QPen( m_engineColor, penWidth ), opacity, compositionMode );
 
-    // draw the path
-    path.paint( painter, xScale, yScale );
+    // draw the path, only the part in the area being updated while drawing
+    path.paint( painter, xScale, yScale, clipRect );
 }
 
-void SmoothPath::paint( QPainter * painter, double xScale, double yScale ) const
+void SmoothPath::paint( QPainter * painter, double xScale, double yScale, const QRect & clipRect ) const
 {
     // draw SmoothPaths with at least 2 points
     if ( points.count() > 1 )
     {
+        // grow the clip rect by the pen width, so that the segments just
+        // outside of it but drawn over it are not skipped
+        const int margin = qCeil( pen.widthF() / 2.0 ) + 1;
+        const QRect paintRect = clipRect.isValid() ? clipRect.adjusted( -margin, -margin, margin, margin ) : QRect();
+
+        // skip the whole path if it is out of the painted area
+        if ( paintRect.isValid() && !paintRect.intersects( boundingRect.geometry( (int)xScale, (int)yScale ).adjusted( 0, 0, 1, 1 ) ) )
+            return;
+
         painter->setCompositionMode( compositionMode );
         painter->setPen( pen );
         painter->setOpacity( opacity );
@@ -176,8 +275,10 @@ void SmoothPath::paint( QPainter * painter, double xScale, double yScale ) const
         for ( ; pIt != pEnd; ++pIt )
         {
             Okular::NormalizedPoint pB = *pIt;
-            painter->drawLine( (int)(pA.x * (double)xScale), (int)(pA.y * (double)yScale),
-                               (int)(pB.x * (double)xScale), (int)(pB.y * (double)yScale) );
+            const QPoint a( (int)(pA.x * (double)xScale), (int)(pA.y * (double)yScale) );
+            const QPoint b( (int)(pB.x * (double)xScale), (int)(pB.y * (double)yScale) );
+            if ( !paintRect.isValid() || paintRect.intersects( QRect( a, b ).normalized().adjusted( 0, 0, 1, 1 ) ) )
+                painter->drawLine( a, b );
             pA = pB;
         }
     }
@@ -73,10 +73,12 @@ class SmoothPath
 {
     public:
         SmoothPath( const QLinkedList<Okular::NormalizedPoint> &points, const QPen &pen, qreal opacity = 1.0, QPainter::CompositionMode compositionMode = QPainter::CompositionMode_SourceOver  );
-        void paint( QPainter * painter, double xScale, double yScale ) const;
+        // if clipRect is valid, only the segments that intersect it are painted
+        void paint( QPainter * painter, double xScale, double yScale, const QRect & clipRect = QRect() ) const;
 
     private:
         const QLinkedList<Okular::NormalizedPoint> points;
+        Okular::NormalizedRect boundingRect;
         const QPen pen;
         const qreal opacity;
         const QPainter::CompositionMode compositionMode;
@@ -91,7 +93,7 @@ class SmoothPathEngine
 
         QRect event( EventType type, Button button, double nX, double nY, double xScale, double yScale, const Okular::Page * /*page*/ ) override;
 
-        void paint( QPainter * painter, double xScale, double yScale, const QRect & /*clipRect*/ ) override;
+        void paint( QPainter * painter, double xScale, double yScale, const QRect & clipRect ) override;
 
         // These are two alternative ways to get the resulting path. Don't call them both!
         QList< Okular::Annotation* > end() override;
@@ -103,6 +105,8 @@ class SmoothPathEngine
         Okular::NormalizedRect totalRect;
         Okular::NormalizedPoint lastPoint;
         QPainter::CompositionMode compositionMode;
+        // pixel tolerance of the simplification, see Settings::inkSimplificationTolerance()
+        double tolerance;
 };
 
 #endif
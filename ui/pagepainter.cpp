@@ -10,6 +10,7 @@
 #include "pagepainter.h"
 
 // qt / kde includes
+#include <qcache.h>
 #include <qrect.h>
 #include <qpainter.h>
 #include <qpalette.h>
@@ -21,6 +22,10 @@
 
 // system includes
 #include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // local includes
 #include "core/area.h"
@@ -32,12 +37,87 @@
 #include "settings.h"
 #include "core/observer.h"
 #include "core/tile.h"
+#include "core/tracer_p.h"
 #include "settings_core.h"
 #include "ui/debug_ui.h"
 
 Q_GLOBAL_STATIC_WITH_ARGS( QPixmap, busyPixmap, ( KIconLoader::global()->loadIcon(QLatin1String("okular"), KIconLoader::NoGroup, 32, KIconLoader::DefaultState, QStringList(), 0, true) ) )
 
 #define TEXTANNOTATION_ICONSIZE 24
+// size of the cache of accessibility-transformed pixmaps (KiB)
+#define ACCESSIBILITY_CACHE_SIZE 65536
+// size of the cache of downscaled page images (KiB)
+#define MIPMAP_CACHE_SIZE 32768
+// size of the cache of rasterized annotation layers (KiB)
+#define ANNOTATION_LAYER_CACHE_SIZE 65536
+
+struct AccessibilityImageCache
+{
+    AccessibilityImageCache() : images( ACCESSIBILITY_CACHE_SIZE ) {}
+
+    QCache< qint64, QImage > images;
+    // signature of the settings the cached images were made with
+    QByteArray settings;
+};
+
+Q_GLOBAL_STATIC( AccessibilityImageCache, accessibilityImageCache )
+
+// the halved versions of a page image: level N is 2^(N+1) times smaller
+typedef QList< QImage > MipmapLevels;
+typedef QCache< qint64, MipmapLevels > MipmapCache;
+Q_GLOBAL_STATIC_WITH_ARGS( MipmapCache, mipmapCache, ( MIPMAP_CACHE_SIZE ) )
+
+// the composited annotations of a page at a given size
+struct AnnotationLayer
+{
+    const Okular::Page *page;
+    QSize scaledSize;
+    QRect scaledCrop;
+    // what the annotations looked like when they were drawn
+    QByteArray signature;
+    // the area of the (cropped) page the layer covers
+    QRect rect;
+    // the annotations that multiply the page colors, over white
+    QImage multiplyImage;
+    // the annotations painted over the page, over transparent
+    QImage overImage;
+};
+
+typedef QCache< qint64, AnnotationLayer > AnnotationLayerCache;
+Q_GLOBAL_STATIC_WITH_ARGS( AnnotationLayerCache, annotationLayerCache, ( ANNOTATION_LAYER_CACHE_SIZE ) )
+
+Q_GLOBAL_STATIC( PagePainter::Statistics, paintStatistics )
+
+PagePainter::Statistics::Statistics()
+    : exactPixmaps( 0 ), scaledPixmaps( 0 ), missingPixmaps( 0 ),
+      accessibilityCacheHits( 0 ), accessibilityCacheMisses( 0 ),
+      mipmapCacheHits( 0 ), mipmapCacheMisses( 0 ),
+      annotationLayerHits( 0 ), annotationLayerMisses( 0 )
+{
+}
+
+PagePainter::Statistics PagePainter::statistics()
+{
+    return *paintStatistics();
+}
+
+static QByteArray accessibilitySettingsSignature()
+{
+    QByteArray signature = QByteArray::number( Okular::SettingsCore::renderMode() );
+    switch ( Okular::SettingsCore::renderMode() )
+    {
+        case Okular::SettingsCore::EnumRenderMode::Recolor:
+            signature += ':' + QByteArray::number( Okular::Settings::recolorForeground().rgba() );
+            signature += ':' + QByteArray::number( Okular::Settings::recolorBackground().rgba() );
+            break;
+        case Okular::SettingsCore::EnumRenderMode::BlackWhite:
+            signature += ':' + QByteArray::number( Okular::Settings::bWContrast() );
+            signature += ':' + QByteArray::number( Okular::Settings::bWThreshold() );
+            break;
+        default: ;
+    }
+    return signature;
+}
 
 inline QPen buildPen( const Okular::Annotation *ann, double width, const QColor &color )
 {
@@ -62,6 +142,10 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     Okular::DocumentObserver *observer, int flags, int scaledWidth, int scaledHeight, const QRect &limits,
     const Okular::NormalizedRect &crop, Okular::NormalizedPoint *viewPortPoint )
 {
+    Okular::TraceScope trace( "paint", "PagePainter::paint" );
+    trace.setArg( QStringLiteral( "page" ), page->number() );
+    trace.setArg( QStringLiteral( "area" ), limits.width() * limits.height() );
+
     /* Calculate the cropped geometry of the page */
     QRect scaledCrop = crop.geometry( scaledWidth, scaledHeight );
     int croppedWidth = scaledCrop.width();
@@ -102,6 +186,7 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
         if ( !pixmap || pixmapRescaleRatio > 20.0 || pixmapRescaleRatio < 0.25 ||
              (scaledWidth > pixmap->width() && pixmapPixels > 60000000L) )
         {
+            ++paintStatistics()->missingPixmaps;
             // draw something on the blank page: the okular icon or a cross (as a fallback)
             if ( !busyPixmap()->isNull() )
             {
@@ -115,6 +200,11 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
             }
             return;
         }
+
+        if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
+            ++paintStatistics()->exactPixmaps;
+        else
+            ++paintStatistics()->scaledPixmaps;
     }
 
     /** 2 - FIND OUT WHAT TO PAINT (Flags + Configuration + Presence) **/
@@ -237,8 +327,9 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     /** 3 - ENABLE BACKBUFFERING IF DIRECT IMAGE MANIPULATION IS NEEDED **/
     bool bufferAccessibility = (flags & Accessibility) && Okular::SettingsCore::changeColors() && (Okular::SettingsCore::renderMode() != Okular::SettingsCore::EnumRenderMode::Paper);
     bool useBackBuffer = bufferAccessibility || bufferedHighlights || bufferedAnnotations || viewPortPoint;
-    QPixmap * backPixmap = 0;
     QPainter * mixedPainter = 0;
+    // the image over which we are going to draw (only used when back buffering)
+    QImage backImage;
     QRect limitsInPixmap = limits.translated( scaledCrop.topLeft() );
         // limits within full (scaled but uncropped) pixmap
 
@@ -258,10 +349,16 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                 if ( !limitsInTile.isEmpty() )
                 {
                     if ( tile.pixmap()->width() == tileRect.width() && tile.pixmap()->height() == tileRect.height() )
+                    {
+                        ++paintStatistics()->exactPixmaps;
                         destPainter->drawPixmap( limitsInTile.topLeft(), *(tile.pixmap()),
                                 limitsInTile.translated( -tileRect.topLeft() ) );
+                    }
                     else
+                    {
+                        ++paintStatistics()->scaledPixmaps;
                         destPainter->drawPixmap( tileRect, *(tile.pixmap()) );
+                    }
                 }
                 tIt++;
             }
@@ -276,7 +373,7 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
             else
             {
                 QImage destImage;
-                scalePixmapOnImage( destImage, pixmap, scaledWidth, scaledHeight, limitsInPixmap );
+                scalePageImageOnImage( destImage, pixmap->toImage(), scaledWidth, scaledHeight, limitsInPixmap );
                 destPainter->drawImage( limits.left(), limits.top(), destImage, 0, 0,
                                          limits.width(),limits.height() );
             }
@@ -288,9 +385,6 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     /** 4B -- BUFFERED FLOW. IMAGE PAINTING + OPERATIONS. QPAINTER OVER PIXMAP  **/
     else
     {
-        // the image over which we are going to draw
-        QImage backImage;
-
         bool has_alpha;
         if ( pixmap )
             has_alpha = pixmap->hasAlpha();
@@ -300,7 +394,7 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
         if ( hasTilesManager )
         {
             backImage = QImage( limits.width(), limits.height(), QImage::Format_ARGB32_Premultiplied );
-            backImage.fill( paperColor.rgb() );
+            backImage.fill( bufferAccessibility ? accessibleColor( paperColor ) : paperColor.rgb() );
             QPainter p( &backImage );
             const Okular::NormalizedRect normalizedLimits( limitsInPixmap, scaledWidth, scaledHeight );
             const QList<Okular::Tile> tiles = page->tilesAt( observer, normalizedLimits );
@@ -315,17 +409,21 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                     if ( !tile.pixmap()->hasAlpha() )
                         has_alpha = false;
 
+                    // the accessibility transformed tile comes from the cache
+                    const QImage tileImage = bufferAccessibility ? accessibleImage( tile.pixmap() ) : tile.pixmap()->toImage();
                     if ( tile.pixmap()->width() == tileRect.width() && tile.pixmap()->height() == tileRect.height() )
                     {
-                        p.drawPixmap( limitsInTile.translated( -limits.topLeft() ).topLeft(), *(tile.pixmap()),
+                        ++paintStatistics()->exactPixmaps;
+                        p.drawImage( limitsInTile.translated( -limits.topLeft() ).topLeft(), tileImage,
                                 limitsInTile.translated( -tileRect.topLeft() ) );
                     }
                     else
                     {
+                        ++paintStatistics()->scaledPixmaps;
                         double xScale = tile.pixmap()->width() / (double)tileRect.width();
                         double yScale = tile.pixmap()->height() / (double)tileRect.height();
                         QTransform transform( xScale, 0, 0, yScale, 0, 0 );
-                        p.drawPixmap( limitsInTile.translated( -limits.topLeft() ), *(tile.pixmap()),
+                        p.drawImage( limitsInTile.translated( -limits.topLeft() ), tileImage,
                                 transform.mapRect( limitsInTile ).translated( -transform.mapRect( tileRect ).topLeft() ) );
                     }
                 }
@@ -335,50 +433,23 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
         }
         else
         {
-            // 4B.1. draw the page pixmap: normal or scaled
-            if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
+            // 4B.1. draw the page pixmap: normal or scaled. The accessibility
+            // transforms work pixel by pixel, so they can be applied once to
+            // the whole pixmap (and cached) instead of on every paint
+            if ( bufferAccessibility )
+            {
+                const QImage srcImage = accessibleImage( pixmap );
+                if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
+                    cropImageOnImage( backImage, srcImage, limitsInPixmap );
+                else
+                    scalePageImageOnImage( backImage, srcImage, scaledWidth, scaledHeight, limitsInPixmap );
+            }
+            else if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
                 cropPixmapOnImage( backImage, pixmap, limitsInPixmap );
             else
-                scalePixmapOnImage( backImage, pixmap, scaledWidth, scaledHeight, limitsInPixmap );
+                scalePageImageOnImage( backImage, pixmap->toImage(), scaledWidth, scaledHeight, limitsInPixmap );
         }
 
-        // 4B.2. modify pixmap following accessibility settings
-        if ( bufferAccessibility )
-        {
-            switch ( Okular::SettingsCore::renderMode() )
-            {
-                case Okular::SettingsCore::EnumRenderMode::Inverted:
-                    // Invert image pixels using QImage internal function
-                    backImage.invertPixels(QImage::InvertRgb);
-                    break;
-                case Okular::SettingsCore::EnumRenderMode::Recolor:
-                    recolor(&backImage, Okular::Settings::recolorForeground(), Okular::Settings::recolorBackground());
-                    break;
-                case Okular::SettingsCore::EnumRenderMode::BlackWhite:
-                    // Manual Gray and Contrast
-                    unsigned int * data = (unsigned int *)backImage.bits();
-                    int val, pixels = backImage.width() * backImage.height(),
-                        con = Okular::Settings::bWContrast(), thr = 255 - Okular::Settings::bWThreshold();
-                    for( int i = 0; i < pixels; ++i )
-                    {
-                        val = qGray( data[i] );
-                        if ( val > thr )
-                            val = 128 + (127 * (val - thr)) / (255 - thr);
-                        else if ( val < thr )
-                            val = (128 * val) / thr;
-                        if ( con > 2 )
-                        {
-                            val = con * ( val - thr ) / 2 + thr;
-                            if ( val > 255 )
-                                val = 255;
-                            else if ( val < 0 )
-                                val = 0;
-                        }
-                        data[i] = qRgba( val, val, val, 255 );
-                    }
-                    break;
-            }
-        }
         // 4B.3. highlight rects in page
         if ( bufferedHighlights )
         {
@@ -438,188 +509,39 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
             // backImage = backImage.convertToFormat(QImage::Format_ARGB32_Premultiplied)
             // that would be almost a noop, but we'll leave the assert for now
             Q_ASSERT(backImage.format() == QImage::Format_ARGB32_Premultiplied);
-            // precalc constants for normalizing [0,1] page coordinates into normalized [0,1] limit rect coordinates
-            double pageScale = (double)croppedWidth / page->width();
-            double xOffset = (double)limits.left() / (double)scaledWidth + crop.left,
-                   xScale = (double)scaledWidth / (double)limits.width(),
-                   yOffset = (double)limits.top() / (double)scaledHeight + crop.top,
-                   yScale = (double)scaledHeight / (double)limits.height();
-
-            // paint all buffered annotations in the page
-            QList< Okular::Annotation * >::const_iterator aIt = bufferedAnnotations->constBegin(), aEnd = bufferedAnnotations->constEnd();
-            for ( ; aIt != aEnd; ++aIt )
+            const double pageScale = (double)croppedWidth / page->width();
+
+            // the annotations are composited from a layer cached for the page
+            // and zoom level; the layer can't take the transparency of the
+            // page into account, so pages with alpha are drawn directly
+            QRect layerRect;
+            QImage multiplyLayer, overLayer;
+            if ( !has_alpha && annotationLayer( page, scaledWidth, scaledHeight, scaledCrop, crop, pageScale,
+                                                layerRect, multiplyLayer, overLayer ) )
             {
-                Okular::Annotation * a = *aIt;
-                Okular::Annotation::SubType type = a->subType();
-                QColor acolor = a->style().color();
-                if ( !acolor.isValid() )
-                    acolor = Qt::yellow;
-                acolor.setAlphaF( a->style().opacity() );
-
-                // draw LineAnnotation MISSING: all
-                if ( type == Okular::Annotation::ALine )
+                const QRect area = layerRect.intersected( limits );
+                if ( !area.isEmpty() )
                 {
-                    // get the annotation
-                    Okular::LineAnnotation * la = (Okular::LineAnnotation *) a;
-
-                    NormalizedPath path;
-                    // normalize page point to image
-                    const QLinkedList<Okular::NormalizedPoint> points = la->transformedLinePoints();
-                    QLinkedList<Okular::NormalizedPoint>::const_iterator it = points.constBegin();
-                    QLinkedList<Okular::NormalizedPoint>::const_iterator itEnd = points.constEnd();
-                    for ( ; it != itEnd; ++it )
+                    QPainter p( &backImage );
+                    const QPoint target = area.topLeft() - limits.topLeft();
+                    const QRect source = area.translated( -layerRect.topLeft() );
+                    if ( !multiplyLayer.isNull() )
                     {
-                        Okular::NormalizedPoint point;
-                        point.x = ( (*it).x - xOffset) * xScale;
-                        point.y = ( (*it).y - yOffset) * yScale;
-                        path.append( point );
+                        p.setCompositionMode( QPainter::CompositionMode_Multiply );
+                        p.drawImage( target, multiplyLayer, source );
                     }
-
-                    const QPen linePen = buildPen( a, a->style().width(), a->style().color() );
-                    QBrush fillBrush;
-
-                    if ( la->lineClosed() && la->lineInnerColor().isValid() )
-                        fillBrush = QBrush( la->lineInnerColor() );
-
-                    // draw the line as normalized path into image
-                    drawShapeOnImage( backImage, path, la->lineClosed(),
-                                      linePen,
-                                      fillBrush, pageScale ,Multiply);
-
-                    if ( path.count() == 2 && fabs( la->lineLeadingForwardPoint() ) > 0.1 )
+                    if ( !overLayer.isNull() )
                     {
-                        Okular::NormalizedPoint delta( la->transformedLinePoints().last().x - la->transformedLinePoints().first().x, la->transformedLinePoints().first().y - la->transformedLinePoints().last().y );
-                        double angle = atan2( delta.y, delta.x );
-                        if ( delta.y < 0 )
-                            angle += 2 * M_PI;
-
-                        int sign = la->lineLeadingForwardPoint() > 0.0 ? 1 : -1;
-                        double LLx = fabs( la->lineLeadingForwardPoint() ) * cos( angle + sign * M_PI_2 + 2 * M_PI ) / page->width();
-                        double LLy = fabs( la->lineLeadingForwardPoint() ) * sin( angle + sign * M_PI_2 + 2 * M_PI ) / page->height();
-
-                        NormalizedPath path2;
-                        NormalizedPath path3;
-
-                        Okular::NormalizedPoint point;
-                        point.x = ( la->transformedLinePoints().first().x + LLx - xOffset ) * xScale;
-                        point.y = ( la->transformedLinePoints().first().y - LLy - yOffset ) * yScale;
-                        path2.append( point );
-                        point.x = ( la->transformedLinePoints().last().x + LLx - xOffset ) * xScale;
-                        point.y = ( la->transformedLinePoints().last().y - LLy - yOffset ) * yScale;
-                        path3.append( point );
-                        // do we have the extension on the "back"?
-                        if ( fabs( la->lineLeadingBackwardPoint() ) > 0.1 )
-                        {
-                            double LLEx = la->lineLeadingBackwardPoint() * cos( angle - sign * M_PI_2 + 2 * M_PI ) / page->width();
-                            double LLEy = la->lineLeadingBackwardPoint() * sin( angle - sign * M_PI_2 + 2 * M_PI ) / page->height();
-                            point.x = ( la->transformedLinePoints().first().x + LLEx - xOffset ) * xScale;
-                            point.y = ( la->transformedLinePoints().first().y - LLEy - yOffset ) * yScale;
-                            path2.append( point );
-                            point.x = ( la->transformedLinePoints().last().x + LLEx - xOffset ) * xScale;
-                            point.y = ( la->transformedLinePoints().last().y - LLEy - yOffset ) * yScale;
-                            path3.append( point );
-                        }
-                        else
-                        {
-                            path2.append( path[0] );
-                            path3.append( path[1] );
-                        }
-
-                        drawShapeOnImage( backImage, path2, false, linePen, QBrush(), pageScale, Multiply );
-                        drawShapeOnImage( backImage, path3, false, linePen, QBrush(), pageScale, Multiply );
+                        p.setCompositionMode( QPainter::CompositionMode_SourceOver );
+                        p.drawImage( target, overLayer, source );
                     }
                 }
-                // draw HighlightAnnotation MISSING: under/strike width, feather, capping
-                else if ( type == Okular::Annotation::AHighlight )
-                {
-                    // get the annotation
-                    Okular::HighlightAnnotation * ha = (Okular::HighlightAnnotation *) a;
-                    Okular::HighlightAnnotation::HighlightType type = ha->highlightType();
-
-                    // draw each quad of the annotation
-                    int quads = ha->highlightQuads().size();
-                    for ( int q = 0; q < quads; q++ )
-                    {
-                        NormalizedPath path;
-                        const Okular::HighlightAnnotation::Quad & quad = ha->highlightQuads()[ q ];
-                        // normalize page point to image
-                        for ( int i = 0; i < 4; i++ )
-                        {
-                            Okular::NormalizedPoint point;
-                            point.x = (quad.transformedPoint( i ).x - xOffset) * xScale;
-                            point.y = (quad.transformedPoint( i ).y - yOffset) * yScale;
-                            path.append( point );
-                        }
-                        // draw the normalized path into image
-                        switch ( type )
-                        {
-                            // highlight the whole rect
-                            case Okular::HighlightAnnotation::Highlight:
-                                drawShapeOnImage( backImage, path, true, Qt::NoPen, acolor, pageScale, Multiply );
-                                break;
-                            // highlight the bottom part of the rect
-                            case Okular::HighlightAnnotation::Squiggly:
-                                path[ 3 ].x = ( path[ 0 ].x + path[ 3 ].x ) / 2.0;
-                                path[ 3 ].y = ( path[ 0 ].y + path[ 3 ].y ) / 2.0;
-                                path[ 2 ].x = ( path[ 1 ].x + path[ 2 ].x ) / 2.0;
-                                path[ 2 ].y = ( path[ 1 ].y + path[ 2 ].y ) / 2.0;
-                                drawShapeOnImage( backImage, path, true, Qt::NoPen, acolor, pageScale, Multiply );
-                                break;
-                            // make a line at 3/4 of the height
-                            case Okular::HighlightAnnotation::Underline:
-                                path[ 0 ].x = ( 3 * path[ 0 ].x + path[ 3 ].x ) / 4.0;
-                                path[ 0 ].y = ( 3 * path[ 0 ].y + path[ 3 ].y ) / 4.0;
-                                path[ 1 ].x = ( 3 * path[ 1 ].x + path[ 2 ].x ) / 4.0;
-                                path[ 1 ].y = ( 3 * path[ 1 ].y + path[ 2 ].y ) / 4.0;
-                                path.pop_back();
-                                path.pop_back();
-                                drawShapeOnImage( backImage, path, false, QPen( acolor, 2 ), QBrush(), pageScale );
-                                break;
-                            // make a line at 1/2 of the height
-                            case Okular::HighlightAnnotation::StrikeOut:
-                                path[ 0 ].x = ( path[ 0 ].x + path[ 3 ].x ) / 2.0;
-                                path[ 0 ].y = ( path[ 0 ].y + path[ 3 ].y ) / 2.0;
-                                path[ 1 ].x = ( path[ 1 ].x + path[ 2 ].x ) / 2.0;
-                                path[ 1 ].y = ( path[ 1 ].y + path[ 2 ].y ) / 2.0;
-                                path.pop_back();
-                                path.pop_back();
-                                drawShapeOnImage( backImage, path, false, QPen( acolor, 2 ), QBrush(), pageScale );
-                                break;
-                        }
-                    }
-                }
-                // draw InkAnnotation MISSING:invar width, PENTRACER
-                else if ( type == Okular::Annotation::AInk )
-                {
-                    // get the annotation
-                    Okular::InkAnnotation * ia = (Okular::InkAnnotation *) a;
-
-                    // draw each ink path
-                    const QList< QLinkedList<Okular::NormalizedPoint> > transformedInkPaths = ia->transformedInkPaths();
-
-                    const QPen inkPen = buildPen( a, a->style().width(), acolor );
-
-                    int paths = transformedInkPaths.size();
-                    for ( int p = 0; p < paths; p++ )
-                    {
-                        NormalizedPath path;
-                        const QLinkedList<Okular::NormalizedPoint> & inkPath = transformedInkPaths[ p ];
-
-                        // normalize page point to image
-                        QLinkedList<Okular::NormalizedPoint>::const_iterator pIt = inkPath.constBegin(), pEnd = inkPath.constEnd();
-                        for ( ; pIt != pEnd; ++pIt )
-                        {
-                            const Okular::NormalizedPoint & inkPoint = *pIt;
-                            Okular::NormalizedPoint point;
-                            point.x = (inkPoint.x - xOffset) * xScale;
-                            point.y = (inkPoint.y - yOffset) * yScale;
-                            path.append( point );
-                        }
-                        // draw the normalized path into image
-                        drawShapeOnImage( backImage, path, false, inkPen, QBrush(), pageScale );
-                    }
-                }
-            } // end current annotation drawing
+            }
+            else
+            {
+                drawBufferedAnnotations( backImage, backImage, *bufferedAnnotations, page,
+                                         scaledWidth, scaledHeight, crop, limits, pageScale );
+            }
         }
 
         if(viewPortPoint)
@@ -649,11 +571,9 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
 */
         }
 
-        // 4B.5. create the back pixmap converting from the local image
-        backPixmap = new QPixmap( QPixmap::fromImage( backImage ) );
-
-        // 4B.6. create a painter over the pixmap and set it as the active one
-        mixedPainter = new QPainter( backPixmap );
+        // 4B.5. create a painter over the local image and set it as the active one
+        // (painting directly on the image saves a full QImage -> QPixmap copy)
+        mixedPainter = new QPainter( &backImage );
         mixedPainter->translate( -limits.left(), -limits.top() );
     }
 
@@ -739,10 +659,9 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                     // "gray"
                     if ( a->style().color().isValid() )
                         GuiUtils::colorizeImage( scaledImage, a->style().color(), opacity );
-                    pixmap = QPixmap::fromImage( scaledImage );
 
                 // draw the mangled image to painter
-                    mixedPainter->drawPixmap( annotRect.topLeft(), pixmap );
+                    mixedPainter->drawImage( annotRect.topLeft(), scaledImage );
                 }
 
             }
@@ -760,10 +679,9 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                                         annotBoundary.height(), innerRect, QImage::Format_ARGB32 );
                     if ( opacity < 255 )
                         changeImageAlpha( scaledImage, opacity );
-                    pixmap = QPixmap::fromImage( scaledImage );
 
                     // draw the scaled and al
-                    mixedPainter->drawPixmap( annotRect.topLeft(), pixmap );
+                    mixedPainter->drawImage( annotRect.topLeft(), scaledImage );
                 }
             }
             // draw GeomAnnotation
@@ -847,12 +765,11 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
         mixedPainter->restore();
     }
 
-    /** 7 -- BUFFERED FLOW. Copy BACKPIXMAP on DESTINATION PAINTER **/
+    /** 7 -- BUFFERED FLOW. Copy BACKIMAGE on DESTINATION PAINTER **/
     if ( useBackBuffer )
     {
         delete mixedPainter;
-        destPainter->drawPixmap( limits.left(), limits.top(), *backPixmap );
-        delete backPixmap;
+        destPainter->drawImage( limits.left(), limits.top(), backImage );
     }
 
     // delete object containers
@@ -863,13 +780,25 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
 
 
 /** Private Helpers :: Pixmap conversion **/
+void PagePainter::cropImageOnImage( QImage & dest, const QImage & src, const QRect & r )
+{
+    if ( r == src.rect() )
+        dest = src;
+    else
+        dest = src.copy( r );
+    if ( dest.format() != QImage::Format_ARGB32_Premultiplied )
+        dest = dest.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+}
+
 void PagePainter::cropPixmapOnImage( QImage & dest, const QPixmap * src, const QRect & r )
 {
-    // handle quickly the case in which the whole pixmap has to be converted
+    // handle quickly the case in which the whole pixmap has to be converted:
+    // the image shares the pixmap buffer until it gets modified
     if ( r == QRect( 0, 0, src->width(), src->height() ) )
     {
         dest = src->toImage();
-        dest = dest.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        if ( dest.format() != QImage::Format_ARGB32_Premultiplied )
+            dest = dest.convertToFormat(QImage::Format_ARGB32_Premultiplied);
     }
     // else copy a portion of the src to an internal pixmap (smaller) and convert it
     else
@@ -895,25 +824,170 @@ void PagePainter::recolor(QImage *image, const QColor &foreground, const QColor
     const float scaleGreen = background.greenF() - foreground.greenF();
     const float scaleBlue = background.blueF() - foreground.blueF();
 
+    // the result only depends on the lightness of the pixel, so precalc the
+    // color (without alpha) for each of the 256 possible values
+    QRgb table[ 256 ];
+    for (int lightness=0; lightness<256; lightness++) {
+        table[lightness] = qRgba(scaleRed * lightness + foreground.red(),
+                                 scaleGreen * lightness + foreground.green(),
+                                 scaleBlue * lightness + foreground.blue(),
+                                 0);
+    }
+
+    QVarLengthArray<uchar> gray(image->width());
     for (int y=0; y<image->height(); y++) {
         QRgb *pixels = reinterpret_cast<QRgb*>(image->scanLine(y));
+        grayScanLine(pixels, gray.data(), image->width());
 
         for (int x=0; x<image->width(); x++) {
-            const int lightness = qGray(pixels[x]);
-            pixels[x] = qRgba(scaleRed * lightness + foreground.red(),
-                           scaleGreen * lightness + foreground.green(),
-                           scaleBlue * lightness + foreground.blue(),
-                           qAlpha(pixels[x]));
+            pixels[x] = table[gray[x]] | (pixels[x] & 0xff000000);
         }
     }
 }
 
+void PagePainter::blackWhite(QImage *image, int contrast, int threshold)
+{
+    Q_ASSERT(image->format() == QImage::Format_ARGB32_Premultiplied);
+
+    // Manual Gray and Contrast, precalculated for each gray value
+    QRgb table[ 256 ];
+    const int thr = 255 - threshold;
+    for (int i=0; i<256; i++) {
+        int val = i;
+        if ( val > thr )
+            val = 128 + (127 * (val - thr)) / (255 - thr);
+        else if ( val < thr )
+            val = (128 * val) / thr;
+        if ( contrast > 2 )
+        {
+            val = contrast * ( val - thr ) / 2 + thr;
+            if ( val > 255 )
+                val = 255;
+            else if ( val < 0 )
+                val = 0;
+        }
+        table[i] = qRgba( val, val, val, 255 );
+    }
+
+    QVarLengthArray<uchar> gray(image->width());
+    for (int y=0; y<image->height(); y++) {
+        QRgb *pixels = reinterpret_cast<QRgb*>(image->scanLine(y));
+        grayScanLine(pixels, gray.data(), image->width());
+
+        for (int x=0; x<image->width(); x++) {
+            pixels[x] = table[gray[x]];
+        }
+    }
+}
+
+void PagePainter::grayScanLine(const QRgb *pixels, uchar *gray, int count)
+{
+    int x = 0;
+#ifdef __SSE2__
+    // qGray() of four pixels at a time: (r * 11 + g * 16 + b * 5) / 32
+    // the products fit in 16 bits, so the 16 bit multiplication is enough
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i redWeight = _mm_set1_epi32(11);
+    const __m128i greenWeight = _mm_set1_epi32(16);
+    const __m128i blueWeight = _mm_set1_epi32(5);
+    for (; x + 4 <= count; x += 4) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x));
+        const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), mask);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+        const __m128i b = _mm_and_si128(p, mask);
+        __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, redWeight),
+                                                  _mm_mullo_epi16(g, greenWeight)),
+                                    _mm_mullo_epi16(b, blueWeight));
+        sum = _mm_srli_epi32(sum, 5);
+        // pack the four 32 bit values (all <= 255) into four bytes
+        sum = _mm_packs_epi32(sum, sum);
+        sum = _mm_packus_epi16(sum, sum);
+        const int packed = _mm_cvtsi128_si32(sum);
+        memcpy(gray + x, &packed, sizeof(packed));
+    }
+#endif
+    for (; x < count; x++)
+        gray[x] = qGray(pixels[x]);
+}
+
+QRgb PagePainter::accessibleColor( const QColor &color )
+{
+    QImage image( 1, 1, QImage::Format_ARGB32_Premultiplied );
+    image.fill( color.rgb() );
+    transformColors( &image );
+    return image.pixel( 0, 0 );
+}
+
+void PagePainter::transformColors( QImage *image )
+{
+    switch ( Okular::SettingsCore::renderMode() )
+    {
+        case Okular::SettingsCore::EnumRenderMode::Inverted:
+            // Invert image pixels using QImage internal function
+            image->invertPixels(QImage::InvertRgb);
+            break;
+        case Okular::SettingsCore::EnumRenderMode::Recolor:
+            recolor(image, Okular::Settings::recolorForeground(), Okular::Settings::recolorBackground());
+            break;
+        case Okular::SettingsCore::EnumRenderMode::BlackWhite:
+            blackWhite(image, Okular::Settings::bWContrast(), Okular::Settings::bWThreshold());
+            break;
+        default: ;
+    }
+}
+
+QImage PagePainter::accessibleImage( const QPixmap *pixmap )
+{
+    AccessibilityImageCache *cache = accessibilityImageCache();
+
+    // the cached images are valid only for the settings they were made with
+    const QByteArray settings = accessibilitySettingsSignature();
+    if ( settings != cache->settings )
+    {
+        cache->images.clear();
+        cache->settings = settings;
+    }
+
+    // the cache key of a pixmap changes each time its contents change
+    const qint64 key = pixmap->cacheKey();
+    if ( const QImage *cached = cache->images.object( key ) )
+    {
+        ++paintStatistics()->accessibilityCacheHits;
+        return *cached;
+    }
+    ++paintStatistics()->accessibilityCacheMisses;
+
+    QImage *image = new QImage( pixmap->toImage().convertToFormat( QImage::Format_ARGB32_Premultiplied ) );
+    transformColors( image );
+    const QImage result = *image;
+    cache->images.insert( key, image, qMax( 1, image->byteCount() / 1024 ) );
+    return result;
+}
+
+bool PagePainter::isCompatibleFormat( QImage::Format srcFormat, QImage::Format destFormat )
+{
+    if ( srcFormat == destFormat )
+        return true;
+
+    // RGB32 pixels are stored as 0xffRRGGBB, that is a valid (opaque) pixel
+    // in both the ARGB32 and the premultiplied ARGB32 formats
+    return srcFormat == QImage::Format_RGB32 &&
+           ( destFormat == QImage::Format_ARGB32 || destFormat == QImage::Format_ARGB32_Premultiplied );
+}
+
 void PagePainter::scalePixmapOnImage ( QImage & dest, const QPixmap * src,
     int scaledWidth, int scaledHeight, const QRect & cropRect, QImage::Format format )
+{
+    // on raster pixmaps toImage() shares the pixmap buffer
+    scaleImageOnImage( dest, src->toImage(), scaledWidth, scaledHeight, cropRect, format );
+}
+
+void PagePainter::scaleImageOnImage ( QImage & dest, const QImage & src,
+    int scaledWidth, int scaledHeight, const QRect & cropRect, QImage::Format format )
 {
     // {source, destination, scaling} params
-    int srcWidth = src->width(),
-        srcHeight = src->height(),
+    int srcWidth = src.width(),
+        srcHeight = src.height(),
         destLeft = cropRect.left(),
         destTop = cropRect.top(),
         destWidth = cropRect.width(),
@@ -923,9 +997,11 @@ void PagePainter::scalePixmapOnImage ( QImage & dest, const QPixmap * src,
     dest = QImage( destWidth, destHeight, format );
     unsigned int * destData = (unsigned int *)dest.bits();
 
-    // source image (1:1 conversion from pixmap)
-    QImage srcImage = src->toImage().convertToFormat(format);
-    unsigned int * srcData = (unsigned int *)srcImage.bits();
+    // source image: convert (and copy) it only if the pixel layout really differs
+    QImage srcImage = src;
+    if ( !isCompatibleFormat( srcImage.format(), format ) )
+        srcImage = srcImage.convertToFormat( format );
+    const unsigned int * srcData = (const unsigned int *)srcImage.constBits();
 
     // precalc the x correspondancy conversion in a lookup table
     QVarLengthArray<unsigned int> xOffset( destWidth );
@@ -942,32 +1018,560 @@ void PagePainter::scalePixmapOnImage ( QImage & dest, const QPixmap * src,
     }
 }
 
+/** Private Helpers :: Page scaling **/
+// interpolate each channel of 'a' and 'b' giving a weight 'w' (0..256) to 'b';
+// two channels are processed in parallel in each 32 bit register
+static inline quint32 interpolatePixel( quint32 a, quint32 b, uint w )
+{
+    const uint iw = 256 - w;
+    const quint32 rb = ( ( ( a & 0x00ff00ff ) * iw + ( b & 0x00ff00ff ) * w ) >> 8 ) & 0x00ff00ff;
+    const quint32 ag = ( ( ( a >> 8 ) & 0x00ff00ff ) * iw + ( ( b >> 8 ) & 0x00ff00ff ) * w ) & 0xff00ff00;
+    return rb | ag;
+}
+
+// blend 'count' pixels of two scanlines, giving a weight 'w' (0..256) to 'bottom'
+static void interpolateScanLines( const quint32 *top, const quint32 *bottom, quint32 *dest, int count, uint w )
+{
+    int x = 0;
+#ifdef __SSE2__
+    // four pixels at a time, with each channel unpacked to 16 bits; the
+    // weighted sum of two channels is at most 255 * 256
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i topWeight = _mm_set1_epi16( 256 - w );
+    const __m128i bottomWeight = _mm_set1_epi16( w );
+    for ( ; x + 4 <= count; x += 4 )
+    {
+        const __m128i t = _mm_loadu_si128( reinterpret_cast< const __m128i * >( top + x ) );
+        const __m128i b = _mm_loadu_si128( reinterpret_cast< const __m128i * >( bottom + x ) );
+        const __m128i lo = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( t, zero ), topWeight ),
+                                                          _mm_mullo_epi16( _mm_unpacklo_epi8( b, zero ), bottomWeight ) ), 8 );
+        const __m128i hi = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( t, zero ), topWeight ),
+                                                          _mm_mullo_epi16( _mm_unpackhi_epi8( b, zero ), bottomWeight ) ), 8 );
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( dest + x ), _mm_packus_epi16( lo, hi ) );
+    }
+#endif
+    for ( ; x < count; ++x )
+        dest[ x ] = interpolatePixel( top[ x ], bottom[ x ], w );
+}
+
+// return an image with half the size of 'src', each pixel being the
+// average of a 2x2 box of the source
+static QImage halveImage( const QImage & src )
+{
+    const int width = src.width() / 2, height = src.height() / 2;
+    QImage dest( width, height, QImage::Format_ARGB32_Premultiplied );
+    for ( int y = 0; y < height; ++y )
+    {
+        const quint32 * top = reinterpret_cast< const quint32 * >( src.constScanLine( 2 * y ) );
+        const quint32 * bottom = reinterpret_cast< const quint32 * >( src.constScanLine( 2 * y + 1 ) );
+        quint32 * out = reinterpret_cast< quint32 * >( dest.scanLine( y ) );
+        int x = 0;
+#ifdef __SSE2__
+        // eight source pixels of each row give four destination pixels
+        for ( ; x + 4 <= width; x += 4 )
+        {
+            const __m128i v0 = _mm_avg_epu8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( top + 2 * x ) ),
+                                             _mm_loadu_si128( reinterpret_cast< const __m128i * >( bottom + 2 * x ) ) );
+            const __m128i v1 = _mm_avg_epu8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( top + 2 * x + 4 ) ),
+                                             _mm_loadu_si128( reinterpret_cast< const __m128i * >( bottom + 2 * x + 4 ) ) );
+            // split the even and the odd columns, then average them
+            const __m128i even = _mm_castps_si128( _mm_shuffle_ps( _mm_castsi128_ps( v0 ), _mm_castsi128_ps( v1 ), _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+            const __m128i odd = _mm_castps_si128( _mm_shuffle_ps( _mm_castsi128_ps( v0 ), _mm_castsi128_ps( v1 ), _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i * >( out + x ), _mm_avg_epu8( even, odd ) );
+        }
+#endif
+        for ( ; x < width; ++x )
+        {
+            const quint32 p0 = top[ 2 * x ], p1 = top[ 2 * x + 1 ], p2 = bottom[ 2 * x ], p3 = bottom[ 2 * x + 1 ];
+            const quint32 rb = ( ( p0 & 0x00ff00ff ) + ( p1 & 0x00ff00ff ) + ( p2 & 0x00ff00ff ) + ( p3 & 0x00ff00ff ) + 0x00020002 ) >> 2;
+            const quint32 ag = ( ( ( p0 >> 8 ) & 0x00ff00ff ) + ( ( p1 >> 8 ) & 0x00ff00ff ) + ( ( p2 >> 8 ) & 0x00ff00ff ) + ( ( p3 >> 8 ) & 0x00ff00ff ) + 0x00020002 ) >> 2;
+            out[ x ] = ( rb & 0x00ff00ff ) | ( ( ag & 0x00ff00ff ) << 8 );
+        }
+    }
+    return dest;
+}
+
+QImage PagePainter::mipmapLevel( const QImage & src, int scaledWidth, int scaledHeight )
+{
+    // no level needed when not downscaling by at least two
+    if ( src.width() < 2 * scaledWidth || src.height() < 2 * scaledHeight )
+        return src;
+
+    // the cache key of the image changes each time its contents change
+    const qint64 key = src.cacheKey();
+    MipmapLevels * levels = mipmapCache()->take( key );
+    if ( levels )
+    {
+        ++paintStatistics()->mipmapCacheHits;
+    }
+    else
+    {
+        ++paintStatistics()->mipmapCacheMisses;
+        levels = new MipmapLevels();
+    }
+
+    // compute the levels down to the smallest one not smaller than the
+    // requested size, so that the final filter does not skip pixels
+    QImage level = src;
+    int i = 0;
+    int cost = 0;
+    while ( level.width() >= 2 * scaledWidth && level.height() >= 2 * scaledHeight )
+    {
+        if ( i == levels->count() )
+        {
+            const QImage source = level.format() == QImage::Format_ARGB32_Premultiplied || level.format() == QImage::Format_RGB32
+                                  ? level : level.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+            levels->append( halveImage( source ) );
+        }
+        level = levels->at( i++ );
+    }
+    foreach ( const QImage & l, *levels )
+        cost += l.byteCount() / 1024;
+
+    mipmapCache()->insert( key, levels, qMax( 1, cost ) );
+    return level;
+}
+
+void PagePainter::scalePageImageOnImage( QImage & dest, const QImage & src,
+    int scaledWidth, int scaledHeight, const QRect & cropRect )
+{
+    // first reduce the image using the box filtered mipmaps, then do the
+    // remaining (less than 2x) scaling with a bilinear filter
+    QImage level = mipmapLevel( src, scaledWidth, scaledHeight );
+    if ( !isCompatibleFormat( level.format(), QImage::Format_ARGB32_Premultiplied ) )
+        level = level.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+
+    // {source, destination, scaling} params
+    const int srcWidth = level.width(),
+              srcHeight = level.height(),
+              destLeft = cropRect.left(),
+              destTop = cropRect.top(),
+              destWidth = cropRect.width(),
+              destHeight = cropRect.height();
+
+    dest = QImage( destWidth, destHeight, QImage::Format_ARGB32_Premultiplied );
+    if ( dest.isNull() || srcWidth <= 0 || srcHeight <= 0 )
+        return;
+
+    // precalc, for each destination column, the left source column and the
+    // weight (0..256) of its right neighbour, matching pixel centers
+    QVarLengthArray< int > xIndex( destWidth ), xWeight( destWidth );
+    for ( int x = 0; x < destWidth; ++x )
+    {
+        const qint64 fx = qMax( Q_INT64_C( 0 ), ( ( 2 * ( x + destLeft ) + 1 ) * (qint64)srcWidth * 256 ) / ( 2 * scaledWidth ) - 128 );
+        xIndex[ x ] = fx >> 8;
+        xWeight[ x ] = fx & 0xff;
+        if ( xIndex[ x ] >= srcWidth - 1 )
+        {
+            xIndex[ x ] = srcWidth - 1;
+            xWeight[ x ] = 0;
+        }
+    }
+
+    // only the columns between the first and the last one are needed
+    const int firstColumn = xIndex[ 0 ];
+    const int columns = qMin( xIndex[ destWidth - 1 ] + 2, srcWidth ) - firstColumn;
+    QVarLengthArray< quint32 > row( columns + 1 );
+    row[ columns ] = 0;
+
+    for ( int y = 0; y < destHeight; ++y )
+    {
+        const qint64 fy = qMax( Q_INT64_C( 0 ), ( ( 2 * ( y + destTop ) + 1 ) * (qint64)srcHeight * 256 ) / ( 2 * scaledHeight ) - 128 );
+        const int top = qMin( (int)( fy >> 8 ), srcHeight - 1 );
+        const int bottom = qMin( top + 1, srcHeight - 1 );
+
+        // vertical pass on the needed columns, then horizontal pass
+        interpolateScanLines( reinterpret_cast< const quint32 * >( level.constScanLine( top ) ) + firstColumn,
+                              reinterpret_cast< const quint32 * >( level.constScanLine( bottom ) ) + firstColumn,
+                              row.data(), columns, fy & 0xff );
+
+        quint32 * out = reinterpret_cast< quint32 * >( dest.scanLine( y ) );
+        for ( int x = 0; x < destWidth; ++x )
+        {
+            const int column = xIndex[ x ] - firstColumn;
+            out[ x ] = interpolatePixel( row[ column ], row[ column + 1 ], xWeight[ x ] );
+        }
+    }
+}
+
 /** Private Helpers :: Image Drawing **/
 // from Arthur - qt4
 static inline int qt_div_255(int x) { return (x + (x>>8) + 0x80) >> 8; }
 
 void PagePainter::changeImageAlpha( QImage & image, unsigned int destAlpha )
 {
-    // iterate over all pixels changing the alpha component value
+    // iterate over all pixels changing the alpha component value to the
+    // destAlpha * sourceAlpha product (that is exactly destAlpha for opaque
+    // pixels)
     unsigned int * data = (unsigned int *)image.bits();
     unsigned int pixels = image.width() * image.height();
 
-    int source, sourceAlpha;
-    for( unsigned int i = 0; i < pixels; ++i )
-    {   // optimize this loop keeping byte order into account
+    unsigned int i = 0;
+#ifdef __SSE2__
+    // four pixels at a time; the alpha product fits in 16 bits
+    const __m128i rgbMask = _mm_set1_epi32( 0x00ffffff );
+    const __m128i factor = _mm_set1_epi32( destAlpha );
+    const __m128i half = _mm_set1_epi32( 0x80 );
+    for( ; i + 4 <= pixels; i += 4 )
+    {
+        __m128i source = _mm_loadu_si128( reinterpret_cast< const __m128i * >( data + i ) );
+        __m128i alpha = _mm_mullo_epi16( _mm_srli_epi32( source, 24 ), factor );
+        // qt_div_255
+        alpha = _mm_srli_epi32( _mm_add_epi32( _mm_add_epi32( alpha, _mm_srli_epi32( alpha, 8 ) ), half ), 8 );
+        source = _mm_or_si128( _mm_and_si128( source, rgbMask ), _mm_slli_epi32( alpha, 24 ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( data + i ), source );
+    }
+#endif
+    int source;
+    for( ; i < pixels; ++i )
+    {
         source = data[i];
-        if ( (sourceAlpha = qAlpha( source )) == 255 )
+        data[i] = qRgba( qRed(source), qGreen(source), qBlue(source), qt_div_255( destAlpha * qAlpha( source ) ) );
+    }
+}
+
+void PagePainter::invalidateAnnotationLayers( const Okular::Page * page )
+{
+    AnnotationLayerCache *cache = annotationLayerCache();
+    if ( !page )
+    {
+        cache->clear();
+        return;
+    }
+
+    foreach ( qint64 key, cache->keys() )
+    {
+        const AnnotationLayer *layer = cache->object( key );
+        if ( layer && layer->page == page )
+            cache->remove( key );
+    }
+}
+
+bool PagePainter::annotationLayer( const Okular::Page * page, int scaledWidth, int scaledHeight,
+    const QRect & scaledCrop, const Okular::NormalizedRect & crop, double pageScale,
+    QRect & rect, QImage & multiplyImage, QImage & overImage )
+{
+    // collect the composited annotations of the whole page, and what they
+    // look like: the layer is drawn again if any of them moved
+    QList< Okular::Annotation * > annotations;
+    QByteArray signature;
+    QRect layerRect;
+    bool needsMultiply = false, needsOver = false;
+    QLinkedList< Okular::Annotation * >::const_iterator aIt = page->m_annotations.constBegin(), aEnd = page->m_annotations.constEnd();
+    for ( ; aIt != aEnd; ++aIt )
+    {
+        Okular::Annotation * ann = *aIt;
+        const int flags = ann->flags();
+        if ( flags & ( Okular::Annotation::Hidden | Okular::Annotation::ExternallyDrawn ) )
+            continue;
+
+        const Okular::Annotation::SubType type = ann->subType();
+        double margin = ann->style().width() * pageScale;
+        bool multiply;
+        if ( type == Okular::Annotation::ALine )
+        {
+            // the leader lines can go out of the bounding rectangle
+            const Okular::LineAnnotation * la = static_cast< const Okular::LineAnnotation * >( ann );
+            margin += ( fabs( la->lineLeadingForwardPoint() ) + fabs( la->lineLeadingBackwardPoint() ) ) * pageScale;
+            multiply = true;
+        }
+        else if ( type == Okular::Annotation::AHighlight )
+        {
+            const Okular::HighlightAnnotation::HighlightType highlightType = static_cast< const Okular::HighlightAnnotation * >( ann )->highlightType();
+            multiply = highlightType == Okular::HighlightAnnotation::Highlight || highlightType == Okular::HighlightAnnotation::Squiggly;
+        }
+        else if ( type == Okular::Annotation::AInk )
+        {
+            multiply = false;
+        }
+        else
         {
-            // use destAlpha
-            data[i] = qRgba( qRed(source), qGreen(source), qBlue(source), destAlpha );
+            continue;
         }
+
+        // drawing the whole page on every move of a drag would be slower
+        // than drawing the visible part of the annotations
+        if ( flags & ( Okular::Annotation::BeingMoved | Okular::Annotation::BeingResized ) )
+            return false;
+
+        // the multiply layer is composited before the over one, which keeps
+        // the order of the annotations only if the multiplied ones come
+        // first; otherwise they are drawn one by one, in order
+        if ( multiply && needsOver )
+            return false;
+        if ( multiply )
+            needsMultiply = true;
         else
+            needsOver = true;
+
+        annotations.append( ann );
+        const Okular::NormalizedRect bbox = ann->transformedBoundingRectangle();
+        signature.append( (const char *)&ann, sizeof( ann ) );
+        signature.append( (const char *)&flags, sizeof( flags ) );
+        signature.append( (const char *)&bbox.left, sizeof( double ) );
+        signature.append( (const char *)&bbox.top, sizeof( double ) );
+        signature.append( (const char *)&bbox.right, sizeof( double ) );
+        signature.append( (const char *)&bbox.bottom, sizeof( double ) );
+
+        const int m = (int)ceil( margin ) + 2;
+        layerRect |= bbox.geometry( scaledWidth, scaledHeight ).translated( -scaledCrop.topLeft() ).adjusted( -m, -m, m, m );
+    }
+    layerRect &= QRect( 0, 0, scaledCrop.width(), scaledCrop.height() );
+    if ( annotations.isEmpty() || layerRect.isEmpty() )
+        return false;
+
+    // don't cache the layers that would take a good part of the cache
+    const qint64 layerCost = (qint64)layerRect.width() * layerRect.height() * 4 * ( needsMultiply + needsOver ) / 1024;
+    if ( layerCost > ANNOTATION_LAYER_CACHE_SIZE / 4 )
+        return false;
+
+    AnnotationLayerCache *cache = annotationLayerCache();
+    const qint64 key = ( (qint64)page->number() << 42 ) ^ ( (qint64)scaledWidth << 21 ) ^ (qint64)scaledHeight;
+    const AnnotationLayer *layer = cache->object( key );
+    if ( !layer || layer->page != page || layer->scaledSize != QSize( scaledWidth, scaledHeight ) ||
+         layer->scaledCrop != scaledCrop || layer->signature != signature )
+    {
+        ++paintStatistics()->annotationLayerMisses;
+        AnnotationLayer *newLayer = new AnnotationLayer;
+        newLayer->page = page;
+        newLayer->scaledSize = QSize( scaledWidth, scaledHeight );
+        newLayer->scaledCrop = scaledCrop;
+        newLayer->signature = signature;
+        newLayer->rect = layerRect;
+        if ( needsMultiply )
+        {
+            // multiplying by white leaves the page as it is
+            newLayer->multiplyImage = QImage( layerRect.size(), QImage::Format_ARGB32_Premultiplied );
+            newLayer->multiplyImage.fill( Qt::white );
+        }
+        if ( needsOver )
         {
-            // use destAlpha * sourceAlpha product
-            sourceAlpha = qt_div_255( destAlpha * sourceAlpha );
-            data[i] = qRgba( qRed(source), qGreen(source), qBlue(source), sourceAlpha );
+            newLayer->overImage = QImage( layerRect.size(), QImage::Format_ARGB32_Premultiplied );
+            newLayer->overImage.fill( Qt::transparent );
         }
+        drawBufferedAnnotations( newLayer->multiplyImage, newLayer->overImage, annotations, page,
+                                 scaledWidth, scaledHeight, crop, layerRect, pageScale );
+
+        cache->insert( key, newLayer, qMax( 1, (int)layerCost ) );
+        layer = newLayer;
     }
+    else
+    {
+        ++paintStatistics()->annotationLayerHits;
+    }
+
+    rect = layer->rect;
+    multiplyImage = layer->multiplyImage;
+    overImage = layer->overImage;
+    return true;
+}
+
+void PagePainter::drawBufferedAnnotations( QImage & multiplyImage, QImage & overImage,
+    const QList< Okular::Annotation * > & annotations, const Okular::Page * page,
+    int scaledWidth, int scaledHeight, const Okular::NormalizedRect & crop, const QRect & limits, double pageScale )
+{
+    // precalc constants for normalizing [0,1] page coordinates into normalized [0,1] limit rect coordinates
+    double xOffset = (double)limits.left() / (double)scaledWidth + crop.left,
+           xScale = (double)scaledWidth / (double)limits.width(),
+           yOffset = (double)limits.top() / (double)scaledHeight + crop.top,
+           yScale = (double)scaledHeight / (double)limits.height();
+
+    // paint all buffered annotations in the page
+    QList< Okular::Annotation * >::const_iterator aIt = annotations.constBegin(), aEnd = annotations.constEnd();
+    for ( ; aIt != aEnd; ++aIt )
+    {
+        Okular::Annotation * a = *aIt;
+        Okular::Annotation::SubType type = a->subType();
+        QColor acolor = a->style().color();
+        if ( !acolor.isValid() )
+            acolor = Qt::yellow;
+        acolor.setAlphaF( a->style().opacity() );
+
+        // draw LineAnnotation MISSING: all
+        if ( type == Okular::Annotation::ALine )
+        {
+            // get the annotation
+            Okular::LineAnnotation * la = (Okular::LineAnnotation *) a;
+
+            NormalizedPath path;
+            // normalize page point to image
+            const QLinkedList<Okular::NormalizedPoint> points = la->transformedLinePoints();
+            QLinkedList<Okular::NormalizedPoint>::const_iterator it = points.constBegin();
+            QLinkedList<Okular::NormalizedPoint>::const_iterator itEnd = points.constEnd();
+            for ( ; it != itEnd; ++it )
+            {
+                Okular::NormalizedPoint point;
+                point.x = ( (*it).x - xOffset) * xScale;
+                point.y = ( (*it).y - yOffset) * yScale;
+                path.append( point );
+            }
+
+            const QPen linePen = buildPen( a, a->style().width(), a->style().color() );
+            QBrush fillBrush;
+
+            if ( la->lineClosed() && la->lineInnerColor().isValid() )
+                fillBrush = QBrush( la->lineInnerColor() );
+
+            // draw the line as normalized path into image
+            drawShapeOnImage( multiplyImage, path, la->lineClosed(),
+                              linePen,
+                              fillBrush, pageScale ,Multiply);
+
+            if ( path.count() == 2 && fabs( la->lineLeadingForwardPoint() ) > 0.1 )
+            {
+                Okular::NormalizedPoint delta( la->transformedLinePoints().last().x - la->transformedLinePoints().first().x, la->transformedLinePoints().first().y - la->transformedLinePoints().last().y );
+                double angle = atan2( delta.y, delta.x );
+                if ( delta.y < 0 )
+                    angle += 2 * M_PI;
+
+                int sign = la->lineLeadingForwardPoint() > 0.0 ? 1 : -1;
+                double LLx = fabs( la->lineLeadingForwardPoint() ) * cos( angle + sign * M_PI_2 + 2 * M_PI ) / page->width();
+                double LLy = fabs( la->lineLeadingForwardPoint() ) * sin( angle + sign * M_PI_2 + 2 * M_PI ) / page->height();
+
+                NormalizedPath path2;
+                NormalizedPath path3;
+
+                Okular::NormalizedPoint point;
+                point.x = ( la->transformedLinePoints().first().x + LLx - xOffset ) * xScale;
+                point.y = ( la->transformedLinePoints().first().y - LLy - yOffset ) * yScale;
+                path2.append( point );
+                point.x = ( la->transformedLinePoints().last().x + LLx - xOffset ) * xScale;
+                point.y = ( la->transformedLinePoints().last().y - LLy - yOffset ) * yScale;
+                path3.append( point );
+                // do we have the extension on the "back"?
+                if ( fabs( la->lineLeadingBackwardPoint() ) > 0.1 )
+                {
+                    double LLEx = la->lineLeadingBackwardPoint() * cos( angle - sign * M_PI_2 + 2 * M_PI ) / page->width();
+                    double LLEy = la->lineLeadingBackwardPoint() * sin( angle - sign * M_PI_2 + 2 * M_PI ) / page->height();
+                    point.x = ( la->transformedLinePoints().first().x + LLEx - xOffset ) * xScale;
+                    point.y = ( la->transformedLinePoints().first().y - LLEy - yOffset ) * yScale;
+                    path2.append( point );
+                    point.x = ( la->transformedLinePoints().last().x + LLEx - xOffset ) * xScale;
+                    point.y = ( la->transformedLinePoints().last().y - LLEy - yOffset ) * yScale;
+                    path3.append( point );
+                }
+                else
+                {
+                    path2.append( path[0] );
+                    path3.append( path[1] );
+                }
+
+                drawShapeOnImage( multiplyImage, path2, false, linePen, QBrush(), pageScale, Multiply );
+                drawShapeOnImage( multiplyImage, path3, false, linePen, QBrush(), pageScale, Multiply );
+            }
+        }
+        // draw HighlightAnnotation MISSING: under/strike width, feather, capping
+        else if ( type == Okular::Annotation::AHighlight )
+        {
+            // get the annotation
+            Okular::HighlightAnnotation * ha = (Okular::HighlightAnnotation *) a;
+            Okular::HighlightAnnotation::HighlightType type = ha->highlightType();
+
+            // draw each quad of the annotation
+            int quads = ha->highlightQuads().size();
+            for ( int q = 0; q < quads; q++ )
+            {
+                NormalizedPath path;
+                const Okular::HighlightAnnotation::Quad & quad = ha->highlightQuads()[ q ];
+                // normalize page point to image
+                for ( int i = 0; i < 4; i++ )
+                {
+                    Okular::NormalizedPoint point;
+                    point.x = (quad.transformedPoint( i ).x - xOffset) * xScale;
+                    point.y = (quad.transformedPoint( i ).y - yOffset) * yScale;
+                    path.append( point );
+                }
+                // draw the normalized path into image
+                switch ( type )
+                {
+                    // highlight the whole rect
+                    case Okular::HighlightAnnotation::Highlight:
+                        drawShapeOnImage( multiplyImage, path, true, Qt::NoPen, acolor, pageScale, Multiply );
+                        break;
+                    // highlight the bottom part of the rect
+                    case Okular::HighlightAnnotation::Squiggly:
+                        path[ 3 ].x = ( path[ 0 ].x + path[ 3 ].x ) / 2.0;
+                        path[ 3 ].y = ( path[ 0 ].y + path[ 3 ].y ) / 2.0;
+                        path[ 2 ].x = ( path[ 1 ].x + path[ 2 ].x ) / 2.0;
+                        path[ 2 ].y = ( path[ 1 ].y + path[ 2 ].y ) / 2.0;
+                        drawShapeOnImage( multiplyImage, path, true, Qt::NoPen, acolor, pageScale, Multiply );
+                        break;
+                    // make a line at 3/4 of the height
+                    case Okular::HighlightAnnotation::Underline:
+                        path[ 0 ].x = ( 3 * path[ 0 ].x + path[ 3 ].x ) / 4.0;
+                        path[ 0 ].y = ( 3 * path[ 0 ].y + path[ 3 ].y ) / 4.0;
+                        path[ 1 ].x = ( 3 * path[ 1 ].x + path[ 2 ].x ) / 4.0;
+                        path[ 1 ].y = ( 3 * path[ 1 ].y + path[ 2 ].y ) / 4.0;
+                        path.pop_back();
+                        path.pop_back();
+                        drawShapeOnImage( overImage, path, false, QPen( acolor, 2 ), QBrush(), pageScale );
+                        break;
+                    // make a line at 1/2 of the height
+                    case Okular::HighlightAnnotation::StrikeOut:
+                        path[ 0 ].x = ( path[ 0 ].x + path[ 3 ].x ) / 2.0;
+                        path[ 0 ].y = ( path[ 0 ].y + path[ 3 ].y ) / 2.0;
+                        path[ 1 ].x = ( path[ 1 ].x + path[ 2 ].x ) / 2.0;
+                        path[ 1 ].y = ( path[ 1 ].y + path[ 2 ].y ) / 2.0;
+                        path.pop_back();
+                        path.pop_back();
+                        drawShapeOnImage( overImage, path, false, QPen( acolor, 2 ), QBrush(), pageScale );
+                        break;
+                }
+            }
+        }
+        // draw InkAnnotation MISSING:invar width, PENTRACER
+        else if ( type == Okular::Annotation::AInk )
+        {
+            // get the annotation
+            Okular::InkAnnotation * ia = (Okular::InkAnnotation *) a;
+
+            // draw each ink path
+            const QList< QLinkedList<Okular::NormalizedPoint> > transformedInkPaths = ia->transformedInkPaths();
+
+            const QPen inkPen = buildPen( a, a->style().width(), acolor );
+
+            // the pen extent in normalized image coordinates, the paths
+            // farther than it from the image can't touch it
+            const double penExtent = inkPen.widthF() * pageScale / 2.0 + 1.0;
+            const double xMargin = penExtent / (double)limits.width(),
+                         yMargin = penExtent / (double)limits.height();
+
+            int paths = transformedInkPaths.size();
+            for ( int p = 0; p < paths; p++ )
+            {
+                const QLinkedList<Okular::NormalizedPoint> & inkPath = transformedInkPaths[ p ];
+                if ( inkPath.isEmpty() )
+                    continue;
+
+                NormalizedPath path;
+                path.reserve( inkPath.size() );
+                double minX = ( inkPath.first().x - xOffset ) * xScale, maxX = minX,
+                       minY = ( inkPath.first().y - yOffset ) * yScale, maxY = minY;
+
+                // normalize page point to image
+                QLinkedList<Okular::NormalizedPoint>::const_iterator pIt = inkPath.constBegin(), pEnd = inkPath.constEnd();
+                for ( ; pIt != pEnd; ++pIt )
+                {
+                    const Okular::NormalizedPoint & inkPoint = *pIt;
+                    Okular::NormalizedPoint point;
+                    point.x = (inkPoint.x - xOffset) * xScale;
+                    point.y = (inkPoint.y - yOffset) * yScale;
+                    path.append( point );
+                    minX = qMin( minX, point.x );
+                    minY = qMin( minY, point.y );
+                    maxX = qMax( maxX, point.x );
+                    maxY = qMax( maxY, point.y );
+                }
+
+                // skip the strokes out of the painted area
+                if ( maxX < -xMargin || minX > 1.0 + xMargin || maxY < -yMargin || minY > 1.0 + yMargin )
+                    continue;
+
+                // draw the normalized path into image
+                drawShapeOnImage( overImage, path, false, inkPen, QBrush(), pageScale );
+            }
+        }
+    } // end current annotation drawing
 }
 
 void PagePainter::drawShapeOnImage(
@@ -19,6 +19,7 @@
 class QPainter;
 class QRect;
 namespace Okular {
+    class Annotation;
     class DocumentObserver;
     class Page;
 }
@@ -52,15 +53,82 @@ class Q_DECL_EXPORT PagePainter
             int flags, int scaledWidth, int scaledHeight, const QRect & pageLimits,
             const Okular::NormalizedRect & crop, Okular::NormalizedPoint *viewPortPoint );
 
+        // drop the cached rasterization of the annotations of 'page' (of all
+        // the pages if 0), to be called when its annotations change
+        static void invalidateAnnotationLayers( const Okular::Page * page );
+
+        // counters of the painting work since the start, for diagnostics
+        struct Statistics
+        {
+            Statistics();
+
+            // pages (or tiles) painted from a pixmap of the painted size,
+            // from a scaled one, or with no pixmap at all
+            quint64 exactPixmaps;
+            quint64 scaledPixmaps;
+            quint64 missingPixmaps;
+            // lookups in the caches of the painter
+            quint64 accessibilityCacheHits;
+            quint64 accessibilityCacheMisses;
+            quint64 mipmapCacheHits;
+            quint64 mipmapCacheMisses;
+            quint64 annotationLayerHits;
+            quint64 annotationLayerMisses;
+        };
+        static Statistics statistics();
+
     private:
         static void cropPixmapOnImage( QImage & dest, const QPixmap * src, const QRect & r );
+        static void cropImageOnImage( QImage & dest, const QImage & src, const QRect & r );
         static void recolor(QImage *image, const QColor &foreground, const QColor &background);
+        static void blackWhite(QImage *image, int contrast, int threshold);
+
+        // compute qGray() of 'count' pixels
+        static void grayScanLine(const QRgb *pixels, uchar *gray, int count);
+
+        // apply the accessibility color transform of the current render mode
+        static void transformColors( QImage *image );
+        static QRgb accessibleColor( const QColor &color );
+
+        // return the accessibility transformed version of 'pixmap', taking it
+        // from the cache if it was already computed with the current settings
+        static QImage accessibleImage( const QPixmap *pixmap );
+
+        // whether the pixels of an image in 'srcFormat' can be read as they
+        // are in 'destFormat', without any conversion
+        static bool isCompatibleFormat( QImage::Format srcFormat, QImage::Format destFormat );
 
         // create an image taking the 'cropRect' portion of an image scaled
         // to 'scaledWidth' by 'scaledHeight' pixels. cropRect must be inside
         // the QRect(0,0, scaledWidth,scaledHeight)
         static void scalePixmapOnImage( QImage & dest, const QPixmap *src,
             int scaledWidth, int scaledHeight, const QRect & cropRect, QImage::Format format = QImage::Format_ARGB32_Premultiplied );
+        static void scaleImageOnImage( QImage & dest, const QImage & src,
+            int scaledWidth, int scaledHeight, const QRect & cropRect, QImage::Format format = QImage::Format_ARGB32_Premultiplied );
+
+        // same as scaleImageOnImage, but with filtering: used for the page
+        // contents while waiting for a pixmap of the right size
+        static void scalePageImageOnImage( QImage & dest, const QImage & src,
+            int scaledWidth, int scaledHeight, const QRect & cropRect );
+
+        // return the (cached) box filtered reduction of 'src' that is the
+        // nearest to, but not smaller than, 'scaledWidth' by 'scaledHeight'
+        static QImage mipmapLevel( const QImage & src, int scaledWidth, int scaledHeight );
+
+        // get the (cached) layer with the composited annotations (lines,
+        // highlights, ink) of the whole page at the given size: 'rect' is the
+        // part of the cropped page it covers, 'multiplyImage' has to be
+        // multiplied with the page and 'overImage' painted over it. Returns
+        // false if the annotations have to be drawn directly instead
+        static bool annotationLayer( const Okular::Page * page, int scaledWidth, int scaledHeight,
+            const QRect & scaledCrop, const Okular::NormalizedRect & crop, double pageScale,
+            QRect & rect, QImage & multiplyImage, QImage & overImage );
+
+        // draw the composited annotations inside 'limits' (relative to the
+        // cropped page) on the images, that can be the same one
+        static void drawBufferedAnnotations( QImage & multiplyImage, QImage & overImage,
+            const QList< Okular::Annotation * > & annotations, const Okular::Page * page,
+            int scaledWidth, int scaledHeight, const Okular::NormalizedRect & crop, const QRect & limits, double pageScale );
 
         // set the alpha component of the image to a given value
         static void changeImageAlpha( QImage & image, unsigned int alpha );
@@ -26,6 +26,7 @@
 #include <qimage.h>
 #include <qpainter.h>
 #include <qtimer.h>
+#include <QtCore/QElapsedTimer>
 #include <qset.h>
 #include <qscrollbar.h>
 #include <qtooltip.h>
@@ -116,6 +117,17 @@ TableSelectionPart::TableSelectionPart(  PageViewItem * item_p, const Okular::No
 {
 }
 
+// a page as painted by PagePainter, kept to repaint the view without painting
+// the page again when only something over it changed (selection, annotator,
+// scrolling); only 'valid' (in item coordinates) is up to date
+struct ComposedPage {
+    QPixmap pixmap;
+    QRegion valid;
+    int uncroppedWidth;
+    int uncroppedHeight;
+    Okular::NormalizedRect crop;
+};
+
 // structure used internally by PageView for data storage
 class PageViewPrivate
 {
@@ -127,12 +139,18 @@ public:
     OkularTTS* tts();
 #endif
     QString selectedText() const;
+    // returns the up to date composed image of the item for the given
+    // rect (in item coordinates), or 0 if the item is not to be cached
+    const QPixmap * composedPage( const PageViewItem * item, const QRect & rect );
+    // drops the composed image of a page, or of all the pages if -1
+    void invalidateComposedPage( int pageNumber = -1 );
 
     // the document, pageviewItems and the 'visible cache'
     PageView *q;
     Okular::Document * document;
     QVector< PageViewItem * > items;
     QLinkedList< PageViewItem * > visibleItems;
+    QHash< int, ComposedPage > composedPages;
     MagnifierView *magnifierView;
 
     // view layout (columns and continuous in Settings), zoom and mouse
@@ -187,6 +205,12 @@ public:
     QTimer * refreshTimer;
     QSet<int> refreshPages;
 
+    // performance overlay
+    QTimer * performanceOverlayTimer;
+    QRect performanceOverlayRect;       // in viewport coordinates
+    double lastPaintTime;               // ms
+    double averagePaintTime;            // ms
+
     // bbox state for Trim to Selection mode
     Okular::NormalizedRect trimBoundingBox;
 
@@ -260,6 +284,62 @@ FormWidgetsController* PageViewPrivate::formWidgetsController()
     return formsWidgetController;
 }
 
+const QPixmap * PageViewPrivate::composedPage( const PageViewItem * item, const QRect & rect )
+{
+    const QRect itemRect( QPoint( 0, 0 ), item->croppedGeometry().size() );
+    // don't keep a copy of the pages that are much bigger than the view
+    // (e.g. when zoomed in a lot), painting only the visible part is cheaper
+    const QSize viewportSize = q->viewport()->size();
+    if ( itemRect.isEmpty() || (qint64)itemRect.width() * itemRect.height() > 4 * (qint64)viewportSize.width() * viewportSize.height() )
+    {
+        composedPages.remove( item->pageNumber() );
+        return 0;
+    }
+
+    ComposedPage &composed = composedPages[ item->pageNumber() ];
+    if ( composed.pixmap.size() != itemRect.size() || composed.uncroppedWidth != item->uncroppedWidth() ||
+         composed.uncroppedHeight != item->uncroppedHeight() || !( composed.crop == item->crop() ) )
+    {
+        composed.pixmap = QPixmap( itemRect.size() );
+        composed.valid = QRegion();
+        composed.uncroppedWidth = item->uncroppedWidth();
+        composed.uncroppedHeight = item->uncroppedHeight();
+        composed.crop = item->crop();
+    }
+
+    // paint only the parts of the rect not painted yet
+    const QRegion dirty = QRegion( rect.intersected( itemRect ) ) - composed.valid;
+    if ( !dirty.isEmpty() )
+    {
+        Okular::NormalizedPoint *viewPortPoint = 0;
+        Okular::NormalizedPoint point( lastSourceLocationViewportNormalizedX, lastSourceLocationViewportNormalizedY );
+        if ( Okular::Settings::showSourceLocationsGraphically()
+             && item->pageNumber() == lastSourceLocationViewportPageNumber )
+        {
+            viewPortPoint = &point;
+        }
+
+        QPainter painter( &composed.pixmap );
+        foreach ( const QRect &dirtyRect, dirty.rects() )
+        {
+            PagePainter::paintCroppedPageOnPainter( &painter, item->page(), q, pageflags,
+                item->uncroppedWidth(), item->uncroppedHeight(), dirtyRect,
+                item->crop(), viewPortPoint );
+        }
+        composed.valid += dirty;
+    }
+
+    return &composed.pixmap;
+}
+
+void PageViewPrivate::invalidateComposedPage( int pageNumber )
+{
+    if ( pageNumber == -1 )
+        composedPages.clear();
+    else
+        composedPages.remove( pageNumber );
+}
+
 #ifdef HAVE_SPEECH
 OkularTTS* PageViewPrivate::tts()
 {
@@ -326,6 +406,9 @@ PageView::PageView( QWidget *parent, Okular::Document *document )
     d->m_tts = 0;
 #endif
     d->refreshTimer = 0;
+    d->performanceOverlayTimer = 0;
+    d->lastPaintTime = 0.0;
+    d->averagePaintTime = 0.0;
     d->aRotateClockwise = 0;
     d->aRotateCounterClockwise = 0;
     d->aRotateOriginal = 0;
@@ -413,6 +496,13 @@ PageView::PageView( QWidget *parent, Okular::Document *document )
     d->leftClickTimer.setSingleShot( true );
     connect( &d->leftClickTimer, &QTimer::timeout, this, &PageView::slotShowSizeAllCursor );
 
+    // what the performance overlay shows changes without any repaint of the view
+    d->performanceOverlayTimer = new QTimer( this );
+    d->performanceOverlayTimer->setInterval( 500 );
+    connect( d->performanceOverlayTimer, &QTimer::timeout, this, &PageView::slotUpdatePerformanceOverlay );
+    if ( Okular::Settings::debugDrawPerformanceOverlay() )
+        d->performanceOverlayTimer->start();
+
     // set a corner button to resize the view to the page size
 //    QPushButton * resizeButton = new QPushButton( viewport() );
 //    resizeButton->setPixmap( SmallIcon("crop") );
@@ -842,6 +932,11 @@ void PageView::reparseConfig()
 
     updatePageStep();
 
+    if ( Okular::Settings::debugDrawPerformanceOverlay() )
+        d->performanceOverlayTimer->start();
+    else
+        d->performanceOverlayTimer->stop();
+
     if ( d->annotator )
     {
         d->annotator->setEnabled( false );
@@ -854,6 +949,7 @@ void PageView::reparseConfig()
     // As we don't have a way to find out the old value
     // We just update the viewport, this shouldn't be that bad
     // since it's just a repaint of pixmaps we already have
+    d->invalidateComposedPage();
     viewport()->update();
 }
 
@@ -947,6 +1043,8 @@ void PageView::selectAll()
 void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setupFlags )
 {
     bool documentChanged = setupFlags & Okular::DocumentObserver::DocumentChanged;
+    // the pages may look different even if their size didn't change
+    d->invalidateComposedPage();
     // reuse current pages if nothing new
     if ( ( pageSet.count() == d->items.count() ) && !documentChanged && !( setupFlags & Okular::DocumentObserver::NewLayoutForPages ) )
     {
@@ -961,6 +1059,10 @@ void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setup
     // mouseAnnotation must not access our PageViewItem widgets any longer
     d->mouseAnnotation->reset();
 
+    // the annotation layers of the pages of another document are useless
+    if ( documentChanged )
+        PagePainter::invalidateAnnotationLayers( 0 );
+
     // delete all widgets (one for each page in pageSet)
     QVector< PageViewItem * >::const_iterator dIt = d->items.constBegin(), dEnd = d->items.constEnd();
     for ( ; dIt != dEnd; ++dIt )
@@ -1190,6 +1292,7 @@ void PageView::setLastSourceLocationViewport( const Okular::DocumentViewport& vp
         d->lastSourceLocationViewportNormalizedY = 0.0;
     }
     d->lastSourceLocationViewportPageNumber = vp.pageNumber;
+    d->invalidateComposedPage();
     viewport()->update();
 }
 
@@ -1198,6 +1301,7 @@ void PageView::clearLastSourceLocationViewport()
     d->lastSourceLocationViewportPageNumber = -1;
     d->lastSourceLocationViewportNormalizedX = 0.0;
     d->lastSourceLocationViewportNormalizedY = 0.0;
+    d->invalidateComposedPage();
     viewport()->update();
 }
 
@@ -1305,8 +1409,12 @@ void PageView::notifyPageChanged( int pageNumber, int changedFlags )
     if ( changedFlags & DocumentObserver::Bookmark )
         return;
 
+    d->invalidateComposedPage( pageNumber );
+
     if ( changedFlags & DocumentObserver::Annotations )
     {
+        PagePainter::invalidateAnnotationLayers( d->document->page( pageNumber ) );
+
         const QLinkedList< Okular::Annotation * > annots = d->document->page( pageNumber )->annotations();
         const QLinkedList< Okular::Annotation * >::ConstIterator annItEnd = annots.end();
         QHash< Okular::Annotation*, AnnotWindow * >::Iterator it = d->m_annowindows.begin();
@@ -1593,6 +1701,9 @@ void PageView::paintEvent(QPaintEvent *pe)
         qCDebug(OkularUiDebug) << "paintevent" << contentsRect;
 #endif
 
+        QElapsedTimer paintTimer;
+        paintTimer.start();
+
         // create the screen painter. a pixel painted at contentsX,contentsY
         // appears to the top-left corner of the scrollview.
         QPainter screenPainter( viewport() );
@@ -1769,6 +1880,77 @@ void PageView::paintEvent(QPaintEvent *pe)
                 }
             }
         }
+
+        if ( Okular::Settings::debugDrawPerformanceOverlay() )
+        {
+            // don't count the refreshes of the overlay alone, they would
+            // hide the time taken by the real paints
+            if ( !d->performanceOverlayRect.contains( pe->rect() ) )
+            {
+                d->lastPaintTime = paintTimer.nsecsElapsed() / 1000000.0;
+                d->averagePaintTime = d->averagePaintTime > 0.0 ? 0.9 * d->averagePaintTime + 0.1 * d->lastPaintTime : d->lastPaintTime;
+            }
+            drawPerformanceOverlay( &screenPainter );
+        }
+}
+
+static QString hitRate( quint64 hits, quint64 misses )
+{
+    if ( hits + misses == 0 )
+        return QStringLiteral( "-" );
+    return QStringLiteral( "%1%" ).arg( 100.0 * hits / ( hits + misses ), 0, 'f', 1 );
+}
+
+void PageView::drawPerformanceOverlay( QPainter * screenPainter )
+{
+    const Okular::RenderStatistics stats = d->document->renderStatistics();
+    const PagePainter::Statistics paintStats = PagePainter::statistics();
+
+    QStringList lines;
+    lines << QStringLiteral( "Pixmap requests: %1 pending, %2 executing, %3 done" )
+             .arg( stats.pendingPixmapRequests ).arg( stats.executingPixmapRequests ).arg( stats.completedPixmapRequests );
+    foreach ( const PageViewItem * item, d->visibleItems )
+    {
+        const int page = item->pageNumber();
+        if ( !stats.pageRenderLatency.contains( page ) )
+            continue;
+        lines << QStringLiteral( "Page %1: %2 ms latency, %3 ms rendering" )
+                 .arg( page + 1 ).arg( stats.pageRenderLatency.value( page ) ).arg( stats.pageGenerationTime.value( page ) );
+    }
+    lines << QStringLiteral( "Pixmaps: %1, %2 MiB" )
+             .arg( stats.allocatedPixmaps ).arg( stats.allocatedPixmapsMemory / ( 1024.0 * 1024.0 ), 0, 'f', 1 );
+    lines << QStringLiteral( "Text pages: %1, %2 KiB" )
+             .arg( stats.allocatedTextPages ).arg( stats.allocatedTextPagesMemory / 1024 );
+    const quint64 paintedPixmaps = paintStats.exactPixmaps + paintStats.scaledPixmaps + paintStats.missingPixmaps;
+    lines << QStringLiteral( "Pixmap hits: %1 (%2 scaled, %3 missing)" )
+             .arg( hitRate( paintStats.exactPixmaps, paintedPixmaps - paintStats.exactPixmaps ) )
+             .arg( paintStats.scaledPixmaps ).arg( paintStats.missingPixmaps );
+    lines << QStringLiteral( "Cache hits: accessibility %1, mipmaps %2, annotations %3" )
+             .arg( hitRate( paintStats.accessibilityCacheHits, paintStats.accessibilityCacheMisses ) )
+             .arg( hitRate( paintStats.mipmapCacheHits, paintStats.mipmapCacheMisses ) )
+             .arg( hitRate( paintStats.annotationLayerHits, paintStats.annotationLayerMisses ) );
+    lines << QStringLiteral( "Paint: %1 ms, average %2 ms" )
+             .arg( d->lastPaintTime, 0, 'f', 1 ).arg( d->averagePaintTime, 0, 'f', 1 );
+
+    // paint in viewport coordinates, in the top left corner
+    screenPainter->save();
+    screenPainter->resetTransform();
+    const QFontMetrics fm = screenPainter->fontMetrics();
+    int width = 0;
+    foreach ( const QString &line, lines )
+        width = qMax( width, fm.width( line ) );
+    const QRect rect( 4, 4, width + 8, lines.count() * fm.lineSpacing() + 8 );
+    screenPainter->fillRect( rect, QColor( 0, 0, 0, 180 ) );
+    screenPainter->setPen( Qt::white );
+    screenPainter->drawText( rect.adjusted( 4, 4, -4, -4 ), Qt::AlignLeft | Qt::AlignTop, lines.join( QLatin1Char( '\n' ) ) );
+    screenPainter->restore();
+
+    // the next refresh has to cover the whole overlay
+    if ( !d->performanceOverlayRect.contains( rect ) )
+    {
+        d->performanceOverlayRect |= rect;
+        viewport()->update( d->performanceOverlayRect );
+    }
 }
 
 void PageView::drawTableDividers(QPainter * screenPainter)
@@ -3331,6 +3513,13 @@ void PageView::scrollContentsBy( int dx, int dy )
     // thus leaving artifacts around
     QRegion rgn( r );
     rgn -= rgn & r.translated( dx, dy );
+    // the performance overlay does not move with the contents, so both it
+    // and its scrolled copy are repainted
+    if ( Okular::Settings::debugDrawPerformanceOverlay() && d->performanceOverlayRect.isValid() )
+    {
+        rgn += d->performanceOverlayRect;
+        rgn += d->performanceOverlayRect.translated( dx, dy ) & r;
+    }
     foreach ( const QRect &rect, rgn.rects() )
         viewport()->repaint( rect );
 }
@@ -3472,18 +3661,28 @@ void PageView::drawDocumentOnPainter( const QRect & contentsRect, QPainter * p )
         // draw the page using the PagePainter with all flags active
         if ( contentsRect.intersects( itemGeometry ) )
         {
-            Okular::NormalizedPoint *viewPortPoint = 0;
-            Okular::NormalizedPoint point( d->lastSourceLocationViewportNormalizedX, d->lastSourceLocationViewportNormalizedY );
-            if( Okular::Settings::showSourceLocationsGraphically()
-                && item->pageNumber() ==  d->lastSourceLocationViewportPageNumber )
-            {
-                viewPortPoint = &point;
-            }
             QRect pixmapRect = contentsRect.intersected( itemGeometry );
             pixmapRect.translate( -item->croppedGeometry().topLeft() );
-            PagePainter::paintCroppedPageOnPainter( p, item->page(), this, pageflags,
-                item->uncroppedWidth(), item->uncroppedHeight(), pixmapRect,
-                item->crop(), viewPortPoint );
+            // copy the page from its composed image if possible, painting
+            // again only the parts that changed
+            const QPixmap *composed = d->composedPage( item, pixmapRect );
+            if ( composed )
+            {
+                p->drawPixmap( pixmapRect.topLeft(), *composed, pixmapRect );
+            }
+            else
+            {
+                Okular::NormalizedPoint *viewPortPoint = 0;
+                Okular::NormalizedPoint point( d->lastSourceLocationViewportNormalizedX, d->lastSourceLocationViewportNormalizedY );
+                if( Okular::Settings::showSourceLocationsGraphically()
+                    && item->pageNumber() ==  d->lastSourceLocationViewportPageNumber )
+                {
+                    viewPortPoint = &point;
+                }
+                PagePainter::paintCroppedPageOnPainter( p, item->page(), this, pageflags,
+                    item->uncroppedWidth(), item->uncroppedHeight(), pixmapRect,
+                    item->crop(), viewPortPoint );
+            }
         }
 
         // remove painted area from 'remainingArea' and restore painter
@@ -4633,6 +4832,19 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
         }
     }
 
+    // keep the composed images of the visible pages only
+    QSet< int > visiblePages;
+    foreach ( const PageViewItem * item, d->visibleItems )
+        visiblePages.insert( item->pageNumber() );
+    QHash< int, ComposedPage >::iterator cIt = d->composedPages.begin();
+    while ( cIt != d->composedPages.end() )
+    {
+        if ( visiblePages.contains( cIt.key() ) )
+            ++cIt;
+        else
+            cIt = d->composedPages.erase( cIt );
+    }
+
     // if preloading is enabled, add the pages before and after in preloading
     if ( !d->visibleItems.isEmpty() &&
          Okular::SettingsCore::memoryLevel() != Okular::SettingsCore::EnumMemoryLevel::Low )
@@ -5310,10 +5522,16 @@ void PageView::slotProcessRenditionAction( const Okular::RenditionAction *action
     };
 }
 
+void PageView::slotUpdatePerformanceOverlay()
+{
+    viewport()->update( d->performanceOverlayRect.isValid() ? d->performanceOverlayRect : QRect( 0, 0, 400, 200 ) );
+}
+
 void PageView::slotToggleChangeColors()
 {
     Okular::SettingsCore::setChangeColors( !Okular::SettingsCore::changeColors() );
     Okular::Settings::self()->save();
+    d->invalidateComposedPage();
     viewport()->update();
 }
 
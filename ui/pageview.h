@@ -161,6 +161,8 @@ Q_OBJECT
         void selectionStart( const QPoint & pos, const QColor & color, bool aboveAll = false );
         void selectionClear( const ClearMode mode = ClearAllSelection );
         void drawTableDividers(QPainter * screenPainter);
+        // draw the rendering statistics over the view (see DebugDrawPerformanceOverlay)
+        void drawPerformanceOverlay( QPainter * screenPainter );
         void guessTableDividers();
         // update either text or rectangle selection
         void updateSelection( const QPoint & pos );
@@ -249,6 +251,8 @@ Q_OBJECT
         void slotToggleForms();
         void slotFormChanged( int pageNumber );
         void slotRefreshPage();
+        // activated by the performance overlay timer
+        void slotUpdatePerformanceOverlay();
 #ifdef HAVE_SPEECH
         void slotSpeakDocument();
         void slotSpeakCurrentPage();
@@ -950,9 +950,10 @@ void PageViewAnnotator::routePaint( QPainter * painter, const QRect & paintRect
     painter->translate( itemRect.topLeft() );
     // TODO: Clip annotation painting to cropped page.
 
-    // transform cliprect from absolute to item relative coords
-    QRect annotRect = paintRect.intersected( m_lastDrawnRect );
-    annotRect.translate( -itemRect.topLeft() );
+    // transform cliprect from absolute to item relative coords; the whole
+    // painted area is used, as it can be larger than the last drawn part
+    // of the stroke
+    const QRect annotRect = paintRect.translated( -itemRect.topLeft() );
 
     // use current engine for painting (in virtual page coordinates)
     m_engine->paint( painter, m_lockedItem->uncroppedWidth(), m_lockedItem->uncroppedHeight(), annotRect );
@@ -73,6 +73,10 @@
 // comment this to disable the top-right progress indicator
 #define ENABLE_PROGRESS_OVERLAY
 
+// the delay (ms) after which the upcoming slides are composed, so that it
+// does not delay the painting of the current one
+#define PREPARE_SLIDES_DELAY 100
+
 
 // a frame contains a pointer to the page object, its geometry and the
 // transition effect to the next frame
@@ -246,6 +250,10 @@ PresentationWidget::PresentationWidget( QWidget * parent, Okular::Document * doc
     m_overlayHideTimer = new QTimer( this );
     m_overlayHideTimer->setSingleShot( true );
     connect(m_overlayHideTimer, &QTimer::timeout, this, &PresentationWidget::slotHideOverlay);
+    m_prepareSlidesTimer = new QTimer( this );
+    m_prepareSlidesTimer->setSingleShot( true );
+    m_prepareSlidesTimer->setInterval( PREPARE_SLIDES_DELAY );
+    connect(m_prepareSlidesTimer, &QTimer::timeout, this, &PresentationWidget::slotPrepareSlides);
     m_nextPageTimer = new QTimer( this );
     m_nextPageTimer->setSingleShot( true );
     connect(m_nextPageTimer, &QTimer::timeout, this, &PresentationWidget::slotNextPage);
@@ -323,6 +331,7 @@ void PresentationWidget::notifySetup( const QVector< Okular::Page * > & pageSet,
     if ( !m_frames.isEmpty() )
         qCWarning(OkularUiDebug) << "Frames setup changed while a Presentation is in progress.";
     m_frames.clear();
+    m_preparedSlides.clear();
 
     // create the new frames
     QVector< Okular::Page * >::const_iterator setIt = pageSet.begin(), setEnd = pageSet.end();
@@ -393,6 +402,13 @@ void PresentationWidget::notifyViewportChanged( bool /*smoothMove*/ )
 
 void PresentationWidget::notifyPageChanged( int pageNumber, int changedFlags )
 {
+    if ( changedFlags & DocumentObserver::Annotations )
+        PagePainter::invalidateAnnotationLayers( m_document->page( pageNumber ) );
+
+    // the prepared slide does not show the page as it is anymore
+    if ( changedFlags & ( DocumentObserver::Pixmap | DocumentObserver::Annotations | DocumentObserver::Highlights ) )
+        m_preparedSlides.remove( pageNumber );
+
     // if we are blocking the notifications, do nothing
     if ( m_blockNotifications )
         return;
@@ -400,6 +416,9 @@ void PresentationWidget::notifyPageChanged( int pageNumber, int changedFlags )
     // check if it's the last requested pixmap. if so update the widget.
     if ( (changedFlags & ( DocumentObserver::Pixmap | DocumentObserver::Annotations | DocumentObserver::Highlights ) ) && pageNumber == m_frameIndex )
         generatePage( changedFlags & ( DocumentObserver::Annotations | DocumentObserver::Highlights ) );
+    // or compose the upcoming slide, so showing it is only a copy
+    else if ( ( changedFlags & DocumentObserver::Pixmap ) && isInPreloadWindow( pageNumber ) )
+        m_prepareSlidesTimer->start();
 }
 
 void PresentationWidget::notifyCurrentPageChanged( int previousPage, int currentPage )
@@ -459,6 +478,8 @@ void PresentationWidget::notifyCurrentPageChanged( int previousPage, int current
         {
             // make the background pixmap
             generatePage();
+            // and move the window of the preloaded slides
+            requestPixmaps();
         }
 
         // perform the page opening action, if any
@@ -485,6 +506,13 @@ void PresentationWidget::notifyCurrentPageChanged( int previousPage, int current
     }
 }
 
+void PresentationWidget::notifyContentsCleared( int changedFlags )
+{
+    // the document freed the pixmaps, e.g. after the memory level changed
+    if ( changedFlags & DocumentObserver::Pixmap )
+        m_preparedSlides.clear();
+}
+
 bool PresentationWidget::canUnloadPixmap( int pageNumber ) const
 {
     if ( Okular::SettingsCore::memoryLevel() == Okular::SettingsCore::EnumMemoryLevel::Low ||
@@ -854,11 +882,12 @@ void PresentationWidget::paintEvent( QPaintEvent * pe )
         QPainter pmPainter( &pm );
 
         pmPainter.setRenderHints( QPainter::Antialiasing );
+        const QRect drawingsRect = pe->rect().translated( -geom.topLeft() );
         foreach ( const SmoothPath &drawing, m_frames[ m_frameIndex ]->drawings )
-            drawing.paint( &pmPainter, geom.width(), geom.height() );
+            drawing.paint( &pmPainter, geom.width(), geom.height(), drawingsRect );
 
         if ( m_drawingEngine && m_drawingRect.intersects( pe->rect() ) )
-            m_drawingEngine->paint( &pmPainter, geom.width(), geom.height(), m_drawingRect.intersected( pe->rect() ) );
+            m_drawingEngine->paint( &pmPainter, geom.width(), geom.height(), m_drawingRect.intersected( pe->rect() ).translated( -geom.topLeft() ) );
 
         painter.setRenderHints( QPainter::Antialiasing );
         painter.drawPixmap( geom.topLeft() , pm );
@@ -1003,16 +1032,24 @@ void PresentationWidget::generatePage( bool disableTransition )
         m_previousPagePixmap = m_lastRenderedPixmap;
     }
 
-    // opens the painter over the pixmap
-    QPainter pixmapPainter;
-    pixmapPainter.begin( &m_lastRenderedPixmap );
-    // generate welcome page
-    if ( m_frameIndex == -1 )
-        generateIntroPage( pixmapPainter );
-    // generate a normal pixmap with extended margin filling
-    if ( m_frameIndex >= 0 && m_frameIndex < (int)m_document->pages() )
-        generateContentsPage( m_frameIndex, pixmapPainter );
-    pixmapPainter.end();
+    const QPixmap preparedSlide = m_preparedSlides.take( m_frameIndex );
+    if ( !preparedSlide.isNull() && preparedSlide.size() == m_lastRenderedPixmap.size() )
+    {
+        m_lastRenderedPixmap = preparedSlide;
+    }
+    else
+    {
+        // opens the painter over the pixmap
+        QPainter pixmapPainter;
+        pixmapPainter.begin( &m_lastRenderedPixmap );
+        // generate welcome page
+        if ( m_frameIndex == -1 )
+            generateIntroPage( pixmapPainter );
+        // generate a normal pixmap with extended margin filling
+        if ( m_frameIndex >= 0 && m_frameIndex < (int)m_document->pages() )
+            generateContentsPage( m_frameIndex, pixmapPainter );
+        pixmapPainter.end();
+    }
 
     // generate the top-right corner overlay
 #ifdef ENABLE_PROGRESS_OVERLAY
@@ -1126,6 +1163,74 @@ void PresentationWidget::generateContentsPage( int pageNum, QPainter & p )
     }
 }
 
+void PresentationWidget::slotPrepareSlides()
+{
+    // do not slow down the transition, it is done when the transition ends
+    if ( m_transitionTimer->isActive() || m_frameIndex == -1 )
+        return;
+
+    forgetPreparedSlides();
+
+    // one slide at a time, so that the events are processed in between
+    const int lastPage = qMin( m_frameIndex + (int)Okular::Settings::slidesPreloadCount(), (int)m_frames.count() - 1 );
+    for ( int i = qMax( m_frameIndex - 1, 0 ); i <= lastPage; ++i )
+    {
+        if ( isInPreloadWindow( i ) && !m_preparedSlides.contains( i ) && prepareSlide( i ) )
+        {
+            m_prepareSlidesTimer->start();
+            return;
+        }
+    }
+}
+
+bool PresentationWidget::prepareSlide( int pageNum )
+{
+    PresentationFrame * frame = m_frames[ pageNum ];
+    if ( !frame->page->hasPixmap( this, frame->geometry.width(), frame->geometry.height() ) )
+        return false;
+
+    QPixmap slide( m_width, m_height );
+    QPainter pixmapPainter( &slide );
+    generateContentsPage( pageNum, pixmapPainter );
+    pixmapPainter.end();
+    m_preparedSlides.insert( pageNum, slide );
+    return true;
+}
+
+bool PresentationWidget::isInPreloadWindow( int pageNum ) const
+{
+    if ( m_frameIndex == -1 || pageNum == m_frameIndex )
+        return false;
+
+    // the slides are full screen pixmaps the document does not account for,
+    // so how many are kept follows the memory level
+    switch ( Okular::SettingsCore::memoryLevel() )
+    {
+        case Okular::SettingsCore::EnumMemoryLevel::Low:
+            return false;
+        case Okular::SettingsCore::EnumMemoryLevel::Normal:
+            return pageNum == m_frameIndex + 1;
+        default:
+            // the previous slide is kept too, to go back to it
+            return pageNum >= m_frameIndex - 1 && pageNum <= m_frameIndex + (int)Okular::Settings::slidesPreloadCount();
+    }
+}
+
+void PresentationWidget::forgetPreparedSlides()
+{
+    // forget the slides that are behind us or too far ahead, and the ones
+    // whose pixmap the document freed because the memory is short
+    QHash< int, QPixmap >::iterator sIt = m_preparedSlides.begin();
+    while ( sIt != m_preparedSlides.end() )
+    {
+        const PresentationFrame * frame = m_frames[ sIt.key() ];
+        if ( isInPreloadWindow( sIt.key() ) && frame->page->hasPixmap( this, frame->geometry.width(), frame->geometry.height() ) )
+            ++sIt;
+        else
+            sIt = m_preparedSlides.erase( sIt );
+    }
+}
+
 // from Arthur - Qt4 - (is defined elsewhere as 'qt_div_255' to not break final compilation)
 inline int qt_div255(int x) { return (x + (x>>8) + 0x80) >> 8; }
 void PresentationWidget::generateOverlay()
@@ -1387,10 +1492,13 @@ void PresentationWidget::requestPixmaps()
     requests.push_back( new Okular::PixmapRequest( this, m_frameIndex, pixW, pixH, PRESENTATION_PRIO, Okular::PixmapRequest::NoFeature ) );
     // restore cursor
     QApplication::restoreOverrideCursor();
-    // ask for next and previous page if not in low memory usage setting
+    forgetPreparedSlides();
+
+    // ask for the upcoming pages and the previous one if not in low memory
+    // usage setting
     if ( Okular::SettingsCore::memoryLevel() != Okular::SettingsCore::EnumMemoryLevel::Low )
     {
-        int pagesToPreload = 1;
+        int pagesToPreload = qMax( (int)Okular::Settings::slidesPreloadCount(), 1 );
 
         // If greedy, preload everything
         if (Okular::SettingsCore::memoryLevel() == Okular::SettingsCore::EnumMemoryLevel::Greedy)
@@ -1411,8 +1519,9 @@ void PresentationWidget::requestPixmaps()
                     requests.push_back( new Okular::PixmapRequest( this, tailRequest, pixW, pixH, PRESENTATION_PRELOAD_PRIO, requestFeatures ) );
             }
 
+            // going back is less common than going forward
             int headRequest = m_frameIndex - j;
-            if ( headRequest >= 0 )
+            if ( headRequest >= 0 && ( j == 1 || Okular::SettingsCore::memoryLevel() == Okular::SettingsCore::EnumMemoryLevel::Greedy ) )
             {
                 PresentationFrame *prevFrame = m_frames[ headRequest ];
                 pixW = prevFrame->geometry.width();
@@ -1427,6 +1536,9 @@ void PresentationWidget::requestPixmaps()
         }
     }
     m_document->requestPixmaps( requests );
+
+    // compose the upcoming slides that already have their pixmaps
+    m_prepareSlidesTimer->start();
 }
 
 
@@ -1506,23 +1618,36 @@ void PresentationWidget::slotHideOverlay()
 
 void PresentationWidget::slotTransitionStep()
 {
+    // the steps follow the time elapsed since the start of the transition,
+    // so a late step catches up instead of making the transition longer
+    const qint64 elapsed = m_transitionClock.elapsed();
+    const double progress = m_transitionDuration > 0 ? qMin( (double)elapsed / m_transitionDuration, 1.0 ) : 1.0;
+
     switch( m_currentTransition.type() )
     {
         case Okular::PageTransition::Fade:
         {
+            // blend the two cached pages, in place
+            m_currentPixmapOpacity = progress;
+            if ( m_currentPixmapOpacity >= 1 )
+            {
+                m_lastRenderedPixmap = m_currentPagePixmap;
+                update();
+                m_prepareSlidesTimer->start();
+                return;
+            }
             QPainter pixmapPainter;
-            m_currentPixmapOpacity += 1.0 / m_transitionSteps;
-            m_lastRenderedPixmap = QPixmap( m_lastRenderedPixmap.size() );
-            m_lastRenderedPixmap.fill( Qt::transparent );
             pixmapPainter.begin( &m_lastRenderedPixmap );
             pixmapPainter.setCompositionMode( QPainter::CompositionMode_Source );
-            pixmapPainter.setOpacity( 1 - m_currentPixmapOpacity );
-            pixmapPainter.drawPixmap( 0, 0, m_previousPagePixmap );
+            if ( m_previousPagePixmap.isNull() )
+                pixmapPainter.fillRect( m_lastRenderedPixmap.rect(), Okular::Settings::slidesBackgroundColor() );
+            else
+                pixmapPainter.drawPixmap( 0, 0, m_previousPagePixmap );
+            pixmapPainter.setCompositionMode( QPainter::CompositionMode_SourceOver );
             pixmapPainter.setOpacity( m_currentPixmapOpacity );
             pixmapPainter.drawPixmap( 0, 0, m_currentPagePixmap );
+            pixmapPainter.end();
             update();
-            if( m_currentPixmapOpacity >= 1 )
-                return;
         } break;
         default:
         {
@@ -1531,10 +1656,14 @@ void PresentationWidget::slotTransitionStep()
                 // it's better to fix the transition to cover the whole screen than
                 // enabling the following line that wastes cpu for nothing
                 //update();
+                m_prepareSlidesTimer->start();
                 return;
             }
 
-            for ( int i = 0; i < m_transitionMul && !m_transitionRects.empty(); i++ )
+            // show all the rects that are due by now, and at least a step
+            const int remainingRects = qMin( m_transitionRectCount - (int)( progress * m_transitionRectCount ),
+                                             m_transitionRects.count() - m_transitionMul );
+            while ( m_transitionRects.count() > qMax( remainingRects, 0 ) )
             {
                 update( m_transitionRects.first() );
                 m_transitionRects.pop_front();
@@ -1661,6 +1790,7 @@ void PresentationWidget::applyNewScreenSize( const QSize & oldSize )
     m_height = height();
 
     // update the frames
+    m_preparedSlides.clear();
     QVector< PresentationFrame * >::const_iterator fIt = m_frames.constBegin(), fEnd = m_frames.constEnd();
     const float screenRatio = (float)m_height / (float)m_width;
     for ( ; fIt != fEnd; ++fIt )
@@ -2307,21 +2437,14 @@ void PresentationWidget::initTransition( const Okular::PageTransition *transitio
 
         case Okular::PageTransition::Fade:
         {
-            enum {FADE_TRANSITION_FPS = 20};
-            const int steps = totalTime * FADE_TRANSITION_FPS;
+            enum {FADE_TRANSITION_FPS = 60};
+            const int steps = qMax( (int)( totalTime * FADE_TRANSITION_FPS ), 1 );
             m_transitionSteps = steps;
-            QPainter pixmapPainter;
-            m_currentPixmapOpacity = (double) 1 / steps;
+            m_currentPixmapOpacity = 0;
             m_transitionDelay = (int)( totalTime * 1000 ) / steps;
-            m_lastRenderedPixmap = QPixmap( m_lastRenderedPixmap.size() );
-            m_lastRenderedPixmap.fill( Qt::transparent );
-            pixmapPainter.begin( &m_lastRenderedPixmap );
-            pixmapPainter.setCompositionMode( QPainter::CompositionMode_Source );
-            pixmapPainter.setOpacity( 1 - m_currentPixmapOpacity );
-            pixmapPainter.drawPixmap( 0, 0, m_previousPagePixmap );
-            pixmapPainter.setOpacity( m_currentPixmapOpacity );
-            pixmapPainter.drawPixmap( 0, 0, m_currentPagePixmap );
-            pixmapPainter.end();
+            // start from the previous page, the steps blend the new one in
+            if ( !m_previousPagePixmap.isNull() )
+                m_lastRenderedPixmap = m_previousPagePixmap;
             update();
         } break;
         // implement missing transitions (a binary raster engine needed here)
@@ -2338,6 +2461,10 @@ void PresentationWidget::initTransition( const Okular::PageTransition *transitio
             return;
     }
 
+    m_transitionDuration = (int)( totalTime * 1000 );
+    m_transitionRectCount = m_transitionRects.count();
+    m_transitionClock.start();
+
     // send the first start to the timer
     m_transitionTimer->start( 0 );
 }
@@ -11,6 +11,8 @@
 #define _OKULAR_PRESENTATIONWIDGET_H_
 
 #include <QDomElement>
+#include <QElapsedTimer>
+#include <qhash.h>
 #include <qlist.h>
 #include <qpixmap.h>
 #include <qstringlist.h>
@@ -57,6 +59,7 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         void notifyPageChanged( int pageNumber, int changedFlags ) override;
         bool canUnloadPixmap( int pageNumber ) const override;
         void notifyCurrentPageChanged( int previous, int current ) override;
+        void notifyContentsCleared( int changedFlags ) override;
 
     public Q_SLOTS:
         void slotFind();
@@ -84,6 +87,9 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         void generatePage( bool disableTransition = false );
         void generateIntroPage( QPainter & p );
         void generateContentsPage( int page, QPainter & p );
+        bool prepareSlide( int page );
+        bool isInPreloadWindow( int page ) const;
+        void forgetPreparedSlides();
         void generateOverlay();
         void initTransition( const Okular::PageTransition *transition );
         const Okular::PageTransition defaultTransition() const;
@@ -107,6 +113,8 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         int m_height;
         QPixmap m_lastRenderedPixmap;
         QPixmap m_lastRenderedOverlay;
+        // the upcoming slides, composed and ready to be shown
+        QHash< int, QPixmap > m_preparedSlides;
         QRect m_overlayGeometry;
         const Okular::Action * m_pressedLink;
         bool m_handCursor;
@@ -120,9 +128,13 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         QTimer * m_transitionTimer;
         QTimer * m_overlayHideTimer;
         QTimer * m_nextPageTimer;
+        QTimer * m_prepareSlidesTimer;
         int m_transitionDelay;
         int m_transitionMul;
         int m_transitionSteps;
+        int m_transitionDuration;
+        int m_transitionRectCount;
+        QElapsedTimer m_transitionClock;
         QList< QRect > m_transitionRects;
         Okular::PageTransition m_currentTransition;
         QPixmap m_currentPagePixmap;
@@ -155,6 +167,7 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         void slotLastPage();
         void slotHideOverlay();
         void slotTransitionStep();
+        void slotPrepareSlides();
         void slotDelayedEvents();
         void slotPageChanged();
         void clearDrawings();
@@ -0,0 +1,260 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "thumbnailcache.h"
+
+// qt/kde includes
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRunnable>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QThreadPool>
+#include <QtGui/QImageReader>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <utime.h>
+#endif
+
+// local includes
+#include "settings.h"
+#include "debug_ui.h"
+
+// the thumbnails that are removed when the cache is too big, so that it is
+// not trimmed at each new thumbnail (percent of the size of the cache)
+#define THUMBNAILCACHE_TRIM_PERCENT 10
+
+struct ThumbnailDir
+{
+    const char *name;
+    int size;
+};
+
+// the directories of the Freedesktop thumbnail managing standard, from the
+// smallest thumbnails to the largest ones
+static const ThumbnailDir thumbnailDirs[] = {
+    { "normal", 128 },
+    { "large", 256 },
+    { "x-large", 512 },
+    { "xx-large", 1024 }
+};
+static const int thumbnailDirCount = sizeof( thumbnailDirs ) / sizeof( thumbnailDirs[0] );
+
+// the bytes the thumbnails take on the disk, or -1 when not known yet; it
+// is shared by the documents of the process, and only used by the writer
+// thread
+static qint64 s_cacheSize = -1;
+
+// the thumbnails are encoded and written, and the cache trimmed, out of the
+// GUI thread; a single thread does it, so the writes and the trims don't
+// race each other
+class ThumbnailWriterPool : public QThreadPool
+{
+    public:
+        ThumbnailWriterPool()
+        {
+            setMaxThreadCount( 1 );
+        }
+};
+
+Q_GLOBAL_STATIC( ThumbnailWriterPool, thumbnailWriterPool )
+
+static QString cacheDir()
+{
+    return QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation ) + QLatin1String( "/okular/thumbnails/" );
+}
+
+static QString thumbnailPath( int dir, const QString &uri )
+{
+    const QByteArray hash = QCryptographicHash::hash( QFile::encodeName( uri ), QCryptographicHash::Md5 ).toHex();
+    return cacheDir() + QLatin1String( thumbnailDirs[ dir ].name ) + QLatin1Char( '/' ) + QLatin1String( hash ) + QLatin1String( ".png" );
+}
+
+static qint64 maximumCacheSize()
+{
+    return (qint64)Okular::Settings::thumbnailCacheSize() * 1024 * 1024;
+}
+
+static void trimCache( qint64 maxSize )
+{
+    QFileInfoList files;
+    for ( int dir = 0; dir < thumbnailDirCount; ++dir )
+    {
+        const QDir thumbnailDir( cacheDir() + QLatin1String( thumbnailDirs[ dir ].name ) );
+        files += thumbnailDir.entryInfoList( QStringList() << QStringLiteral( "*.png" ), QDir::Files );
+    }
+
+    s_cacheSize = 0;
+    foreach ( const QFileInfo &file, files )
+        s_cacheSize += file.size();
+
+    if ( s_cacheSize <= maxSize )
+        return;
+
+    // remove the least recently used thumbnails first
+    std::sort( files.begin(), files.end(), []( const QFileInfo &a, const QFileInfo &b ) {
+        return a.lastModified() < b.lastModified();
+    } );
+
+    const qint64 targetSize = maxSize - maxSize * THUMBNAILCACHE_TRIM_PERCENT / 100;
+    foreach ( const QFileInfo &file, files )
+    {
+        if ( s_cacheSize <= targetSize )
+            break;
+        if ( QFile::remove( file.absoluteFilePath() ) )
+            s_cacheSize -= file.size();
+    }
+}
+
+class ThumbnailWriter : public QRunnable
+{
+    public:
+        ThumbnailWriter( const QString &path, const QImage &thumbnail, qint64 maxCacheSize )
+            : m_path( path ), m_thumbnail( thumbnail ), m_maxCacheSize( maxCacheSize )
+        {
+        }
+
+        void run() override
+        {
+            if ( !QDir().mkpath( QFileInfo( m_path ).absolutePath() ) )
+                return;
+
+            // the thumbnail may replace an older one
+            const QFileInfo oldFile( m_path );
+            const qint64 oldSize = oldFile.exists() ? oldFile.size() : 0;
+
+            // other Okular instances can read the thumbnail while it is written
+            QSaveFile file( m_path );
+            if ( !file.open( QIODevice::WriteOnly ) )
+                return;
+            file.setPermissions( QFileDevice::ReadOwner | QFileDevice::WriteOwner );
+            if ( !m_thumbnail.save( &file, "png" ) || !file.commit() )
+            {
+                qCWarning(OkularUiDebug) << "Could not write the thumbnail" << m_path;
+                return;
+            }
+
+            if ( s_cacheSize >= 0 )
+                s_cacheSize += QFileInfo( m_path ).size() - oldSize;
+            if ( s_cacheSize < 0 || s_cacheSize > m_maxCacheSize )
+                trimCache( m_maxCacheSize );
+        }
+
+    private:
+        QString m_path;
+        QImage m_thumbnail;
+        qint64 m_maxCacheSize;
+};
+
+ThumbnailCache::ThumbnailCache()
+{
+}
+
+void ThumbnailCache::setDocument( const QUrl &url )
+{
+    m_documentUri.clear();
+    m_mtime.clear();
+    m_size.clear();
+
+    if ( !url.isLocalFile() )
+        return;
+
+    const QFileInfo info( url.toLocalFile() );
+    if ( !info.exists() )
+        return;
+
+    // the fingerprint of the file, as the standard tells
+    m_documentUri = QUrl::fromLocalFile( info.absoluteFilePath() ).toString( QUrl::FullyEncoded );
+    m_mtime = QString::number( info.lastModified().toTime_t() );
+    m_size = QString::number( info.size() );
+}
+
+bool ThumbnailCache::isEnabled() const
+{
+    return !m_documentUri.isEmpty() && Okular::Settings::thumbnailCacheSize() > 0;
+}
+
+QString ThumbnailCache::pageUri( int page, int rotation ) const
+{
+    QString uri = m_documentUri + QStringLiteral( "#page=%1" ).arg( page + 1 );
+    if ( rotation != 0 )
+        uri += QStringLiteral( "&rotation=%1" ).arg( rotation * 90 );
+    return uri;
+}
+
+QImage ThumbnailCache::load( int page, int rotation, int width, int height ) const
+{
+    if ( !isEnabled() )
+        return QImage();
+
+    const QString uri = pageUri( page, rotation );
+    const int size = qMax( width, height );
+    for ( int dir = 0; dir < thumbnailDirCount; ++dir )
+    {
+        if ( thumbnailDirs[ dir ].size < size )
+            continue;
+
+        const QString path = thumbnailPath( dir, uri );
+        if ( !QFile::exists( path ) )
+            continue;
+
+        QImageReader reader( path, "png" );
+        QImage image = reader.read();
+        if ( image.isNull() || image.text( QStringLiteral( "Thumb::URI" ) ) != uri )
+            continue;
+
+        // the document changed since the thumbnail was made
+        if ( image.text( QStringLiteral( "Thumb::MTime" ) ) != m_mtime || image.text( QStringLiteral( "Thumb::Size" ) ) != m_size )
+        {
+            QFile::remove( path );
+            continue;
+        }
+
+        if ( image.width() < width || image.height() < height )
+            continue;
+
+#ifdef Q_OS_UNIX
+        // the modification time of the thumbnails tells which ones were
+        // used the least recently
+        utime( QFile::encodeName( path ).constData(), nullptr );
+#endif
+
+        if ( image.width() != width || image.height() != height )
+            image = image.scaled( width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+        return image;
+    }
+    return QImage();
+}
+
+void ThumbnailCache::store( int page, int rotation, const QImage &image )
+{
+    if ( !isEnabled() || image.isNull() )
+        return;
+
+    const int size = qMax( image.width(), image.height() );
+    int dir = 0;
+    while ( dir < thumbnailDirCount && thumbnailDirs[ dir ].size < size )
+        ++dir;
+    if ( dir == thumbnailDirCount )
+        return;
+
+    const QString uri = pageUri( page, rotation );
+    QImage thumbnail = image;
+    thumbnail.setText( QStringLiteral( "Thumb::URI" ), uri );
+    thumbnail.setText( QStringLiteral( "Thumb::MTime" ), m_mtime );
+    thumbnail.setText( QStringLiteral( "Thumb::Size" ), m_size );
+    thumbnail.setText( QStringLiteral( "Software" ), QStringLiteral( "Okular" ) );
+
+    // the first write also measures the cache, scanning its directories
+    thumbnailWriterPool()->start( new ThumbnailWriter( thumbnailPath( dir, uri ), thumbnail, maximumCacheSize() ) );
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_THUMBNAILCACHE_H_
+#define _OKULAR_THUMBNAILCACHE_H_
+
+#include <QtCore/QString>
+#include <QtCore/QUrl>
+#include <QtGui/QImage>
+
+/**
+ * @short A disk cache of the thumbnails of the pages of a document.
+ *
+ * The cache is shared by all the Okular windows, tabs and sessions. The
+ * thumbnails are stored as the Freedesktop thumbnail managing standard
+ * does for files: PNG images named after the MD5 of their URI, in "normal"
+ * (up to 128 pixels), "large" (256), "x-large" (512) and "xx-large" (1024)
+ * directories, with the Thumb::URI, Thumb::MTime and Thumb::Size keys that
+ * tell whether the document changed since. As the standard only knows a
+ * thumbnail per file, the URI of a page is the one of the document with a
+ * "#page=" fragment, and the cache is in $XDG_CACHE_HOME/okular/thumbnails.
+ *
+ * When the cache is bigger than Settings::thumbnailCacheSize() the least
+ * recently used thumbnails are removed.
+ */
+class ThumbnailCache
+{
+    public:
+        ThumbnailCache();
+
+        // the document the thumbnails are of; only the local files that
+        // exist have a cache
+        void setDocument( const QUrl &url );
+        bool isEnabled() const;
+
+        // the thumbnail of the page with the given rotation, scaled to
+        // 'width' by 'height' pixels, or a null image if the cache has none
+        // at least that large
+        QImage load( int page, int rotation, int width, int height ) const;
+
+        // add the thumbnail of the page with the given rotation; it is
+        // written in a thread, so it can be loaded only a bit later
+        void store( int page, int rotation, const QImage &image );
+
+    private:
+        QString pageUri( int page, int rotation ) const;
+
+        QString m_documentUri;
+        QString m_mtime;
+        QString m_size;
+};
+
+#endif
@@ -27,12 +27,14 @@
 
 // local includes
 #include "pagepainter.h"
+#include "thumbnailcache.h"
 #include "core/area.h"
 #include "core/bookmarkmanager.h"
 #include "core/document.h"
 #include "core/generator.h"
 #include "core/page.h"
 #include "settings.h"
+#include "settings_core.h"
 #include "priorities.h"
 
 class ThumbnailWidget;
@@ -60,6 +62,7 @@ class ThumbnailListPrivate : public QWidget
         QVector<ThumbnailWidget *> m_thumbnails;
         QList<ThumbnailWidget *> m_visibleThumbnails;
         int m_vectorIndex;
+        ThumbnailCache m_thumbnailCache;
         // Grabbing variables
         QPoint m_mouseGrabPos;
         ThumbnailWidget *m_mouseGrabItem;
@@ -74,6 +77,11 @@ class ThumbnailListPrivate : public QWidget
 
         ThumbnailWidget* itemFor( const QPoint & p ) const;
         void delayedRequestVisiblePixmaps( int delayMs = 0 );
+        // whether the thumbnail of the page can come from the disk cache:
+        // the cache only has the pages as the generator renders them
+        bool canUseThumbnailCache( const Okular::Page * page ) const;
+        // add the pixmap of the thumbnail to the disk cache
+        void storeThumbnail( ThumbnailWidget * t );
 
         // SLOTS:
         // make requests for generating pixmaps for visible thumbnails
@@ -115,6 +123,11 @@ class ThumbnailWidget
         const Okular::Page * page() const { return m_page; }
         QRect visibleRect() const { return m_visibleRect.geometry( m_pixmapWidth, m_pixmapHeight ); }
 
+        // the thumbnail from the disk cache, painted until the page has a
+        // pixmap of its own
+        bool hasCachedPixmap() const { return !m_cachedPixmap.isNull(); }
+        void setCachedPixmap( const QPixmap & pixmap ) { m_cachedPixmap = pixmap; }
+
         void paint( QPainter &p, const QRect &clipRect );
 
         static int margin() { return m_margin; }
@@ -139,6 +152,7 @@ class ThumbnailWidget
         int m_labelHeight, m_labelNumber;
         Okular::NormalizedRect m_visibleRect;
         QRect m_rect;
+        QPixmap m_cachedPixmap;
 };
 
 
@@ -247,6 +261,9 @@ void ThumbnailList::notifySetup( const QVector< Okular::Page * > & pages, int se
     d->m_selected = 0;
     d->m_mouseGrabItem = 0;
 
+    if ( setupFlags & Okular::DocumentObserver::DocumentChanged )
+        d->m_thumbnailCache.setDocument( d->m_document->currentDocument() );
+
     if ( pages.count() < 1 )
     {
         widget()->resize( 0, 0 );
@@ -344,12 +361,26 @@ void ThumbnailList::notifyPageChanged( int pageNumber, int changedFlags )
     if ( !( changedFlags & interestingFlags ) )
         return;
 
+    if ( changedFlags & DocumentObserver::Annotations )
+        PagePainter::invalidateAnnotationLayers( d->m_document->page( pageNumber ) );
+
     // iterate over visible items: if page(pageNumber) is one of them, repaint it
     QList<ThumbnailWidget *>::const_iterator vIt = d->m_visibleThumbnails.constBegin(), vEnd = d->m_visibleThumbnails.constEnd();
     for ( ; vIt != vEnd; ++vIt )
         if ( (*vIt)->pageNumber() == pageNumber )
         {
-            (*vIt)->update();
+            ThumbnailWidget * t = *vIt;
+            if ( ( changedFlags & ( DocumentObserver::Annotations | DocumentObserver::Highlights ) ) && t->hasCachedPixmap() )
+            {
+                // the cached thumbnail can not show them, so render the page
+                t->setCachedPixmap( QPixmap() );
+                d->delayedRequestVisiblePixmaps();
+            }
+            else if ( changedFlags & DocumentObserver::Pixmap )
+            {
+                d->storeThumbnail( t );
+            }
+            t->update();
             break;
         }
 }
@@ -618,12 +649,25 @@ void ThumbnailListPrivate::slotRequestVisiblePixmaps( int /*newContentsY*/ )
         ThumbnailWidget * t = *tIt;
         const QRect thumbRect = t->rect();
         if ( !thumbRect.intersects( viewportRect ) )
-          continue;
+        {
+            t->setCachedPixmap( QPixmap() );
+            continue;
+        }
         // add ThumbnailWidget to visible list
         m_visibleThumbnails.push_back( t );
-        // if pixmap not present add it to requests
-        if ( !t->page()->hasPixmap( q, t->pixmapWidth(), t->pixmapHeight() ) )
+        // if pixmap not present take it from the disk cache, or add it to requests
+        if ( !t->page()->hasPixmap( q, t->pixmapWidth(), t->pixmapHeight() ) && !t->hasCachedPixmap() )
         {
+            if ( canUseThumbnailCache( t->page() ) )
+            {
+                const QImage image = m_thumbnailCache.load( t->pageNumber(), t->page()->rotation(), t->pixmapWidth(), t->pixmapHeight() );
+                if ( !image.isNull() )
+                {
+                    t->setCachedPixmap( QPixmap::fromImage( image ) );
+                    t->update();
+                    continue;
+                }
+            }
             Okular::PixmapRequest * p = new Okular::PixmapRequest( q, t->pageNumber(), t->pixmapWidth(), t->pixmapHeight(), THUMBNAILS_PRIO, Okular::PixmapRequest::Asynchronous );
             requestedPixmaps.push_back( p );
         }
@@ -649,6 +693,28 @@ void ThumbnailListPrivate::slotDelayTimeout()
 }
 //END internal SLOTS
 
+bool ThumbnailListPrivate::canUseThumbnailCache( const Okular::Page * page ) const
+{
+    return m_thumbnailCache.isEnabled() && !page->hasAnnotations() && !page->hasHighlights() &&
+           !Okular::SettingsCore::changeColors();
+}
+
+void ThumbnailListPrivate::storeThumbnail( ThumbnailWidget * t )
+{
+    const Okular::Page * page = t->page();
+    if ( t->hasCachedPixmap() || !canUseThumbnailCache( page ) ||
+         !page->hasPixmap( q, t->pixmapWidth(), t->pixmapHeight() ) )
+        return;
+
+    // the pixmap as the generator rendered it
+    QImage image( t->pixmapWidth(), t->pixmapHeight(), QImage::Format_ARGB32_Premultiplied );
+    image.fill( Qt::white );
+    QPainter p( &image );
+    PagePainter::paintPageOnPainter( &p, page, q, 0, t->pixmapWidth(), t->pixmapHeight(), image.rect() );
+    p.end();
+    m_thumbnailCache.store( page->number(), page->rotation(), image );
+}
+
 void ThumbnailListPrivate::delayedRequestVisiblePixmaps( int delayMs )
 {
     if ( !m_delayTimer )
@@ -677,6 +743,8 @@ void ThumbnailWidget::resizeFitWidth( int width )
     m_pixmapWidth = width - m_margin;
     m_pixmapHeight = qRound( m_page->ratio() * (double)m_pixmapWidth );
     m_rect.setSize( QSize( width, heightHint() ) );
+    if ( m_cachedPixmap.size() != QSize( m_pixmapWidth, m_pixmapHeight ) )
+        m_cachedPixmap = QPixmap();
 }
 
 void ThumbnailWidget::setSelected( bool selected )
@@ -950,9 +1018,16 @@ void ThumbnailWidget::paint( QPainter &p, const QRect &_clipRect )
         clipRect = clipRect.intersected( QRect( 0, 0, m_pixmapWidth, m_pixmapHeight ) );
         if ( clipRect.isValid() )
         {
-            int flags = PagePainter::Accessibility | PagePainter::Highlights |
-                        PagePainter::Annotations;
-            PagePainter::paintPageOnPainter( &p, m_page, m_parent->q, flags, m_pixmapWidth, m_pixmapHeight, clipRect );
+            if ( hasCachedPixmap() && !m_page->hasPixmap( m_parent->q, m_pixmapWidth, m_pixmapHeight ) )
+            {
+                p.drawPixmap( clipRect.topLeft(), m_cachedPixmap, clipRect );
+            }
+            else
+            {
+                int flags = PagePainter::Accessibility | PagePainter::Highlights |
+                            PagePainter::Annotations;
+                PagePainter::paintPageOnPainter( &p, m_page, m_parent->q, flags, m_pixmapWidth, m_pixmapHeight, clipRect );
+            }
         }
 
         if ( !m_visibleRect.isNull() )